@@ -0,0 +1,189 @@
+// Generated by tools/fontgen.py from font5x7.bdf; do not edit.
+//
+//   python3 tools/fontgen.py tools/fonts/font5x7.bdf --chars 0123456789 --used main.c --big 2,3 -o font5x7.h
+
+#define FONT_FIRST      0x20    // First character of font5x7_map (SPACE)
+#define FONT_LAST       0x7F    // Last character of font5x7_map
+#define FONT_COLS       5       // Columns stored per glyph
+#define FONT_ROWS       7       // Pixel rows of a glyph (bit 0 = top)
+#define FONT_GLYPHS     51      // Glyphs in font5x7
+
+// Glyph of each character; the ones left out draw as SPACE (glyph 0).
+static const uint8_t font5x7_map[FONT_LAST - FONT_FIRST + 1] = {
+     0,  0,  0,  0,  0,  1,  0,  0,  // 0x20-0x27
+     0,  0,  0,  0,  0,  2,  3,  4,  // 0x28-0x2F
+     5,  6,  7,  8,  9, 10, 11, 12,  // 0x30-0x37
+    13, 14, 15,  0,  0,  0,  0,  0,  // 0x38-0x3F
+     0, 16,  0, 17,  0, 18, 19, 20,  // 0x40-0x47
+    21,  0, 22,  0, 23,  0,  0, 24,  // 0x48-0x4F
+    25,  0, 26,  0, 27,  0,  0, 28,  // 0x50-0x57
+     0,  0,  0,  0,  0,  0,  0, 29,  // 0x58-0x5F
+     0, 30,  0, 31, 32, 33, 34, 35,  // 0x60-0x67
+    36, 37,  0,  0, 38, 39, 40, 41,  // 0x68-0x6F
+    42,  0, 43, 44, 45, 46, 47,  0,  // 0x70-0x77
+    48, 49, 50,  0,  0,  0,  0,  0,  // 0x78-0x7F
+};
+
+static const uint8_t font5x7[FONT_GLYPHS][FONT_COLS] = {
+    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000},  // SPACE
+    {0b00100011, 0b00010011, 0b00001000, 0b01100100, 0b01100010},  // %
+    {0b00001000, 0b00001000, 0b00001000, 0b00001000, 0b00001000},  // -
+    {0b00000000, 0b01100000, 0b01100000, 0b00000000, 0b00000000},  // .
+    {0b00100000, 0b00010000, 0b00001000, 0b00000100, 0b00000010},  // /
+    {0b00111110, 0b01010001, 0b01001001, 0b01000101, 0b00111110},  // 0
+    {0b00000000, 0b01000010, 0b01111111, 0b01000000, 0b00000000},  // 1
+    {0b01000010, 0b01100001, 0b01010001, 0b01001001, 0b01000110},  // 2
+    {0b00100001, 0b01000001, 0b01000101, 0b01001011, 0b00110001},  // 3
+    {0b00011000, 0b00010100, 0b00010010, 0b01111111, 0b00010000},  // 4
+    {0b00100111, 0b01000101, 0b01000101, 0b01000101, 0b00111001},  // 5
+    {0b00111100, 0b01001010, 0b01001001, 0b01001001, 0b00110000},  // 6
+    {0b00000011, 0b00000001, 0b01110001, 0b00001001, 0b00000111},  // 7
+    {0b00110110, 0b01001001, 0b01001001, 0b01001001, 0b00110110},  // 8
+    {0b00000110, 0b01001001, 0b01001001, 0b00101001, 0b00011110},  // 9
+    {0b00000000, 0b00110110, 0b00110110, 0b00000000, 0b00000000},  // :
+    {0b01111110, 0b00010001, 0b00010001, 0b00010001, 0b01111110},  // A
+    {0b00111110, 0b01000001, 0b01000001, 0b01000001, 0b00100010},  // C
+    {0b01111111, 0b01001001, 0b01001001, 0b01001001, 0b01000001},  // E
+    {0b01111111, 0b00001001, 0b00001001, 0b00001001, 0b00000001},  // F
+    {0b00111110, 0b01000001, 0b01001001, 0b01001001, 0b01111010},  // G
+    {0b01111111, 0b00001000, 0b00001000, 0b00001000, 0b01111111},  // H
+    {0b00100000, 0b01000000, 0b01000001, 0b00111111, 0b00000001},  // J
+    {0b01111111, 0b01000000, 0b01000000, 0b01000000, 0b01000000},  // L
+    {0b00111110, 0b01000001, 0b01000001, 0b01000001, 0b00111110},  // O
+    {0b01111111, 0b00001001, 0b00001001, 0b00001001, 0b00000110},  // P
+    {0b01111111, 0b00001001, 0b00011001, 0b00101001, 0b01000110},  // R
+    {0b00000001, 0b00000001, 0b01111111, 0b00000001, 0b00000001},  // T
+    {0b00111111, 0b01000000, 0b00111000, 0b01000000, 0b00111111},  // W
+    {0b01000000, 0b01000000, 0b01000000, 0b01000000, 0b01000000},  // _
+    {0b00100000, 0b01010100, 0b01010100, 0b01010100, 0b01111000},  // a
+    {0b00111000, 0b01000100, 0b01000100, 0b01000100, 0b00100000},  // c
+    {0b00111000, 0b01000100, 0b01000100, 0b01001000, 0b01111111},  // d
+    {0b00111000, 0b01010100, 0b01010100, 0b01010100, 0b00011000},  // e
+    {0b00001000, 0b01111110, 0b00001001, 0b00000001, 0b00000010},  // f
+    {0b00001100, 0b01010010, 0b01010010, 0b01010010, 0b00111110},  // g
+    {0b01111111, 0b00001000, 0b00000100, 0b00000100, 0b01111000},  // h
+    {0b00000000, 0b01000100, 0b01111101, 0b01000000, 0b00000000},  // i
+    {0b00000000, 0b01000001, 0b01111111, 0b01000000, 0b00000000},  // l
+    {0b01111100, 0b00000100, 0b00011000, 0b00000100, 0b01111000},  // m
+    {0b01111100, 0b00001000, 0b00000100, 0b00000100, 0b01111000},  // n
+    {0b00111000, 0b01000100, 0b01000100, 0b01000100, 0b00111000},  // o
+    {0b01111100, 0b00010100, 0b00010100, 0b00010100, 0b00001000},  // p
+    {0b01111100, 0b00001000, 0b00000100, 0b00000100, 0b00001000},  // r
+    {0b01001000, 0b01010100, 0b01010100, 0b01010100, 0b00100000},  // s
+    {0b00000100, 0b00111111, 0b01000100, 0b01000000, 0b00100000},  // t
+    {0b00111100, 0b01000000, 0b01000000, 0b00100000, 0b01111100},  // u
+    {0b00011100, 0b00100000, 0b01000000, 0b00100000, 0b00011100},  // v
+    {0b01000100, 0b00101000, 0b00010000, 0b00101000, 0b01000100},  // x
+    {0b00001100, 0b01010000, 0b01010000, 0b01010000, 0b00111100},  // y
+    {0b01000100, 0b01100100, 0b01010100, 0b01001100, 0b01000100}   // z
+};
+
+// Inked columns of each glyph for proportional spacing: first inked column
+// (high nibble) and number of columns from there (low nibble, 0 = blank).
+static const uint8_t font5x7_span[FONT_GLYPHS] = {
+    0x00, 0x05, 0x05, 0x12, 0x05, 0x05, 0x13, 0x05,
+    0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x12,
+    0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+    0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+    0x05, 0x05, 0x05, 0x05, 0x05, 0x13, 0x13, 0x05,
+    0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+    0x05, 0x05, 0x05,
+};
+
+// The digits 2x, one row of column bytes per page (bit 0 = top).
+static const uint8_t font_x2[10][2][FONT_COLS * 2] = {
+    {   // 0
+        {0xFC, 0xFC, 0x03, 0x03, 0xC3, 0xC3, 0x33, 0x33, 0xFC, 0xFC},
+        {0x0F, 0x0F, 0x33, 0x33, 0x30, 0x30, 0x30, 0x30, 0x0F, 0x0F},
+    },
+    {   // 1
+        {0x00, 0x00, 0x0C, 0x0C, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x30, 0x30, 0x3F, 0x3F, 0x30, 0x30, 0x00, 0x00},
+    },
+    {   // 2
+        {0x0C, 0x0C, 0x03, 0x03, 0x03, 0x03, 0xC3, 0xC3, 0x3C, 0x3C},
+        {0x30, 0x30, 0x3C, 0x3C, 0x33, 0x33, 0x30, 0x30, 0x30, 0x30},
+    },
+    {   // 3
+        {0x03, 0x03, 0x03, 0x03, 0x33, 0x33, 0xCF, 0xCF, 0x03, 0x03},
+        {0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0F, 0x0F},
+    },
+    {   // 4
+        {0xC0, 0xC0, 0x30, 0x30, 0x0C, 0x0C, 0xFF, 0xFF, 0x00, 0x00},
+        {0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x3F, 0x3F, 0x03, 0x03},
+    },
+    {   // 5
+        {0x3F, 0x3F, 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0xC3, 0xC3},
+        {0x0C, 0x0C, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0F, 0x0F},
+    },
+    {   // 6
+        {0xF0, 0xF0, 0xCC, 0xCC, 0xC3, 0xC3, 0xC3, 0xC3, 0x00, 0x00},
+        {0x0F, 0x0F, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0F, 0x0F},
+    },
+    {   // 7
+        {0x0F, 0x0F, 0x03, 0x03, 0x03, 0x03, 0xC3, 0xC3, 0x3F, 0x3F},
+        {0x00, 0x00, 0x00, 0x00, 0x3F, 0x3F, 0x00, 0x00, 0x00, 0x00},
+    },
+    {   // 8
+        {0x3C, 0x3C, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0x3C, 0x3C},
+        {0x0F, 0x0F, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x0F, 0x0F},
+    },
+    {   // 9
+        {0x3C, 0x3C, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFC, 0xFC},
+        {0x00, 0x00, 0x30, 0x30, 0x30, 0x30, 0x0C, 0x0C, 0x03, 0x03},
+    },
+};
+
+// The digits 3x, one row of column bytes per page (bit 0 = top).
+static const uint8_t font_x3[10][3][FONT_COLS * 3] = {
+    {   // 0
+        {0xF8, 0xF8, 0xF8, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0xC7, 0xC7, 0xC7, 0xF8, 0xF8, 0xF8},
+        {0xFF, 0xFF, 0xFF, 0x70, 0x70, 0x70, 0x0E, 0x0E, 0x0E, 0x01, 0x01, 0x01, 0xFF, 0xFF, 0xFF},
+        {0x03, 0x03, 0x03, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x03, 0x03, 0x03},
+    },
+    {   // 1
+        {0x00, 0x00, 0x00, 0x38, 0x38, 0x38, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x1C, 0x1C, 0x1C, 0x1F, 0x1F, 0x1F, 0x1C, 0x1C, 0x1C, 0x00, 0x00, 0x00},
+    },
+    {   // 2
+        {0x38, 0x38, 0x38, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0xF8, 0xF8, 0xF8},
+        {0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x70, 0x70, 0x70, 0x0E, 0x0E, 0x0E, 0x01, 0x01, 0x01},
+        {0x1C, 0x1C, 0x1C, 0x1F, 0x1F, 0x1F, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C},
+    },
+    {   // 3
+        {0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0xC7, 0xC7, 0xC7, 0x3F, 0x3F, 0x3F, 0x07, 0x07, 0x07},
+        {0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0},
+        {0x03, 0x03, 0x03, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x03, 0x03, 0x03},
+    },
+    {   // 4
+        {0x00, 0x00, 0x00, 0xC0, 0xC0, 0xC0, 0x38, 0x38, 0x38, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00},
+        {0x7E, 0x7E, 0x7E, 0x71, 0x71, 0x71, 0x70, 0x70, 0x70, 0xFF, 0xFF, 0xFF, 0x70, 0x70, 0x70},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00},
+    },
+    {   // 5
+        {0xFF, 0xFF, 0xFF, 0xC7, 0xC7, 0xC7, 0xC7, 0xC7, 0xC7, 0xC7, 0xC7, 0xC7, 0x07, 0x07, 0x07},
+        {0x81, 0x81, 0x81, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xFE, 0xFE, 0xFE},
+        {0x03, 0x03, 0x03, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x03, 0x03, 0x03},
+    },
+    {   // 6
+        {0xC0, 0xC0, 0xC0, 0x38, 0x38, 0x38, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x00, 0x00, 0x00},
+        {0xFF, 0xFF, 0xFF, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0},
+        {0x03, 0x03, 0x03, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x03, 0x03, 0x03},
+    },
+    {   // 7
+        {0x3F, 0x3F, 0x3F, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0xFF, 0xFF, 0xFF},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF0, 0xF0, 0xF0, 0x0E, 0x0E, 0x0E, 0x01, 0x01, 0x01},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    },
+    {   // 8
+        {0xF8, 0xF8, 0xF8, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0xF8, 0xF8, 0xF8},
+        {0xF1, 0xF1, 0xF1, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF1, 0xF1, 0xF1},
+        {0x03, 0x03, 0x03, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x03, 0x03, 0x03},
+    },
+    {   // 9
+        {0xF8, 0xF8, 0xF8, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0xF8, 0xF8, 0xF8},
+        {0x01, 0x01, 0x01, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x8E, 0x8E, 0x8E, 0x7F, 0x7F, 0x7F},
+        {0x00, 0x00, 0x00, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x03, 0x03, 0x03, 0x00, 0x00, 0x00},
+    },
+};
@@ -1,907 +1,4241 @@
-// NOTE: This code is for demonstration purposes only.
-//       It contains more comments than necessary to help explain each step.
-
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include "diag/trace.h"
-#include "cmsis/cmsis_device.h"
-
-/*--------------------------------------------------------------------------------
-
-                ECE 355 - Microprocessor-Based Systems
-                          Fall 2024
-
-               -| Karanbir Gosal & Tanvir Kahlon |-
-
---------------------------------------------------------------------------------*/
-
-#pragma GCC diagnostic push //Save Current State
-#pragma GCC diagnostic ignored "-Wunused-parameter" //Ignore warnings for unused functions
-#pragma GCC diagnostic ignored "-Wmissing-declarations" //Ignore warnings for non prior declarations
-#pragma GCC diagnostic ignored "-Wreturn-type" // Ignore when no return statement used
-
-//-------------------- Declaration Section -----------------------
-
-//Initialize and control the SPI communication with the OLED display.
-SPI_HandleTypeDef SPI_Handle;
-
-// Sends a single byte to the OLED display
-void oled_Write(unsigned char);
-
-// Sends a command byte to the OLED to control the behavior of the display, such as
-// contrast or display mode.
-void oled_Write_Cmd(unsigned char cmd);
-
-//Sends a data byte to the OLED for actual content
-void oled_Write_Data(unsigned char data);
-
-// Global variable to track if a timer-triggered event has occurred.
-int timerTriggered = 0;
-
-//Initialize and configure the OLED display.
-void oled_config(void);
-
-//Updates the OLED display with new information.
-void refresh_OLED(void);
-
-// Global variable to track the current edge state(1st or 2nd edge) for frequency
-int rising_edge = 0;
-
-// Global variable for the calculated frequency of input signal.
-int Freq = 0;
-
-// Global variable to store the calculated resistance value.
-int Res = 0;
-
-
-//Used to introduce a small delay or synchronize code.
-static inline void __nop(void) {
-    __asm("nop"); // Assembler instruction for no operation
-}
-
-//----------LED Display Initialization --------------------
-
-unsigned char oled_init_cmds[] =
-{
-    0xAE,
-    0x20, 0x00,
-    0x40,
-    0xA0 | 0x01,
-    0xA8, 0x40 - 1,
-    0xC0 | 0x08,
-    0xD3, 0x00,
-    0xDA, 0x32,
-    0xD5, 0x80,
-    0xD9, 0x22,
-    0xDB, 0x30,
-    0x81, 0xFF,
-    0xA4,
-    0xA6,
-    0xAD, 0x30,
-    0x8D, 0x10,
-    0xAE | 0x01,
-    0xC0,
-    0xA0
-};
-
-
-//
-// Character specifications for LED Display (1 row = 8 bytes = 1 ASCII character)
-// Example: to display '4', retrieve 8 data bytes stored in Characters[52][X] row
-//          (where X = 0, 1, ..., 7) and send them one by one to LED Display.
-// Row number = character ASCII code (e.g., ASCII code of '4' is 0x34 = 52)
-//
-unsigned char Characters[][8] = {
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // SPACE
-    {0b00000000, 0b00000000, 0b01011111, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // !
-    {0b00000000, 0b00000111, 0b00000000, 0b00000111, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // "
-    {0b00010100, 0b01111111, 0b00010100, 0b01111111, 0b00010100,0b00000000, 0b00000000, 0b00000000},  // #
-    {0b00100100, 0b00101010, 0b01111111, 0b00101010, 0b00010010,0b00000000, 0b00000000, 0b00000000},  // $
-    {0b00100011, 0b00010011, 0b00001000, 0b01100100, 0b01100010,0b00000000, 0b00000000, 0b00000000},  // %
-    {0b00110110, 0b01001001, 0b01010101, 0b00100010, 0b01010000,0b00000000, 0b00000000, 0b00000000},  // &
-    {0b00000000, 0b00000101, 0b00000011, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // '
-    {0b00000000, 0b00011100, 0b00100010, 0b01000001, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // (
-    {0b00000000, 0b01000001, 0b00100010, 0b00011100, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // )
-    {0b00010100, 0b00001000, 0b00111110, 0b00001000, 0b00010100,0b00000000, 0b00000000, 0b00000000},  // *
-    {0b00001000, 0b00001000, 0b00111110, 0b00001000, 0b00001000,0b00000000, 0b00000000, 0b00000000},  // +
-    {0b00000000, 0b01010000, 0b00110000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // ,
-    {0b00001000, 0b00001000, 0b00001000, 0b00001000, 0b00001000,0b00000000, 0b00000000, 0b00000000},  // -
-    {0b00000000, 0b01100000, 0b01100000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // .
-    {0b00100000, 0b00010000, 0b00001000, 0b00000100, 0b00000010,0b00000000, 0b00000000, 0b00000000},  // /
-    {0b00111110, 0b01010001, 0b01001001, 0b01000101, 0b00111110,0b00000000, 0b00000000, 0b00000000},  // 0
-    {0b00000000, 0b01000010, 0b01111111, 0b01000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // 1
-    {0b01000010, 0b01100001, 0b01010001, 0b01001001, 0b01000110,0b00000000, 0b00000000, 0b00000000},  // 2
-    {0b00100001, 0b01000001, 0b01000101, 0b01001011, 0b00110001,0b00000000, 0b00000000, 0b00000000},  // 3
-    {0b00011000, 0b00010100, 0b00010010, 0b01111111, 0b00010000,0b00000000, 0b00000000, 0b00000000},  // 4
-    {0b00100111, 0b01000101, 0b01000101, 0b01000101, 0b00111001,0b00000000, 0b00000000, 0b00000000},  // 5
-    {0b00111100, 0b01001010, 0b01001001, 0b01001001, 0b00110000,0b00000000, 0b00000000, 0b00000000},  // 6
-    {0b00000011, 0b00000001, 0b01110001, 0b00001001, 0b00000111,0b00000000, 0b00000000, 0b00000000},  // 7
-    {0b00110110, 0b01001001, 0b01001001, 0b01001001, 0b00110110,0b00000000, 0b00000000, 0b00000000},  // 8
-    {0b00000110, 0b01001001, 0b01001001, 0b00101001, 0b00011110,0b00000000, 0b00000000, 0b00000000},  // 9
-    {0b00000000, 0b00110110, 0b00110110, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // :
-    {0b00000000, 0b01010110, 0b00110110, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // ;
-    {0b00001000, 0b00010100, 0b00100010, 0b01000001, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // <
-    {0b00010100, 0b00010100, 0b00010100, 0b00010100, 0b00010100,0b00000000, 0b00000000, 0b00000000},  // =
-    {0b00000000, 0b01000001, 0b00100010, 0b00010100, 0b00001000,0b00000000, 0b00000000, 0b00000000},  // >
-    {0b00000010, 0b00000001, 0b01010001, 0b00001001, 0b00000110,0b00000000, 0b00000000, 0b00000000},  // ?
-    {0b00110010, 0b01001001, 0b01111001, 0b01000001, 0b00111110,0b00000000, 0b00000000, 0b00000000},  // @
-    {0b01111110, 0b00010001, 0b00010001, 0b00010001, 0b01111110,0b00000000, 0b00000000, 0b00000000},  // A
-    {0b01111111, 0b01001001, 0b01001001, 0b01001001, 0b00110110,0b00000000, 0b00000000, 0b00000000},  // B
-    {0b00111110, 0b01000001, 0b01000001, 0b01000001, 0b00100010,0b00000000, 0b00000000, 0b00000000},  // C
-    {0b01111111, 0b01000001, 0b01000001, 0b00100010, 0b00011100,0b00000000, 0b00000000, 0b00000000},  // D
-    {0b01111111, 0b01001001, 0b01001001, 0b01001001, 0b01000001,0b00000000, 0b00000000, 0b00000000},  // E
-    {0b01111111, 0b00001001, 0b00001001, 0b00001001, 0b00000001,0b00000000, 0b00000000, 0b00000000},  // F
-    {0b00111110, 0b01000001, 0b01001001, 0b01001001, 0b01111010,0b00000000, 0b00000000, 0b00000000},  // G
-    {0b01111111, 0b00001000, 0b00001000, 0b00001000, 0b01111111,0b00000000, 0b00000000, 0b00000000},  // H
-    {0b01000000, 0b01000001, 0b01111111, 0b01000001, 0b01000000,0b00000000, 0b00000000, 0b00000000},  // I
-    {0b00100000, 0b01000000, 0b01000001, 0b00111111, 0b00000001,0b00000000, 0b00000000, 0b00000000},  // J
-    {0b01111111, 0b00001000, 0b00010100, 0b00100010, 0b01000001,0b00000000, 0b00000000, 0b00000000},  // K
-    {0b01111111, 0b01000000, 0b01000000, 0b01000000, 0b01000000,0b00000000, 0b00000000, 0b00000000},  // L
-    {0b01111111, 0b00000010, 0b00001100, 0b00000010, 0b01111111,0b00000000, 0b00000000, 0b00000000},  // M
-    {0b01111111, 0b00000100, 0b00001000, 0b00010000, 0b01111111,0b00000000, 0b00000000, 0b00000000},  // N
-    {0b00111110, 0b01000001, 0b01000001, 0b01000001, 0b00111110,0b00000000, 0b00000000, 0b00000000},  // O
-    {0b01111111, 0b00001001, 0b00001001, 0b00001001, 0b00000110,0b00000000, 0b00000000, 0b00000000},  // P
-    {0b00111110, 0b01000001, 0b01010001, 0b00100001, 0b01011110,0b00000000, 0b00000000, 0b00000000},  // Q
-    {0b01111111, 0b00001001, 0b00011001, 0b00101001, 0b01000110,0b00000000, 0b00000000, 0b00000000},  // R
-    {0b01000110, 0b01001001, 0b01001001, 0b01001001, 0b00110001,0b00000000, 0b00000000, 0b00000000},  // S
-    {0b00000001, 0b00000001, 0b01111111, 0b00000001, 0b00000001,0b00000000, 0b00000000, 0b00000000},  // T
-    {0b00111111, 0b01000000, 0b01000000, 0b01000000, 0b00111111,0b00000000, 0b00000000, 0b00000000},  // U
-    {0b00011111, 0b00100000, 0b01000000, 0b00100000, 0b00011111,0b00000000, 0b00000000, 0b00000000},  // V
-    {0b00111111, 0b01000000, 0b00111000, 0b01000000, 0b00111111,0b00000000, 0b00000000, 0b00000000},  // W
-    {0b01100011, 0b00010100, 0b00001000, 0b00010100, 0b01100011,0b00000000, 0b00000000, 0b00000000},  // X
-    {0b00000111, 0b00001000, 0b01110000, 0b00001000, 0b00000111,0b00000000, 0b00000000, 0b00000000},  // Y
-    {0b01100001, 0b01010001, 0b01001001, 0b01000101, 0b01000011,0b00000000, 0b00000000, 0b00000000},  // Z
-    {0b01111111, 0b01000001, 0b00000000, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // [
-    {0b00010101, 0b00010110, 0b01111100, 0b00010110, 0b00010101,0b00000000, 0b00000000, 0b00000000},  // back slash
-    {0b00000000, 0b00000000, 0b00000000, 0b01000001, 0b01111111,0b00000000, 0b00000000, 0b00000000},  // ]
-    {0b00000100, 0b00000010, 0b00000001, 0b00000010, 0b00000100,0b00000000, 0b00000000, 0b00000000},  // ^
-    {0b01000000, 0b01000000, 0b01000000, 0b01000000, 0b01000000,0b00000000, 0b00000000, 0b00000000},  // _
-    {0b00000000, 0b00000001, 0b00000010, 0b00000100, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // `
-    {0b00100000, 0b01010100, 0b01010100, 0b01010100, 0b01111000,0b00000000, 0b00000000, 0b00000000},  // a
-    {0b01111111, 0b01001000, 0b01000100, 0b01000100, 0b00111000,0b00000000, 0b00000000, 0b00000000},  // b
-    {0b00111000, 0b01000100, 0b01000100, 0b01000100, 0b00100000,0b00000000, 0b00000000, 0b00000000},  // c
-    {0b00111000, 0b01000100, 0b01000100, 0b01001000, 0b01111111,0b00000000, 0b00000000, 0b00000000},  // d
-    {0b00111000, 0b01010100, 0b01010100, 0b01010100, 0b00011000,0b00000000, 0b00000000, 0b00000000},  // e
-    {0b00001000, 0b01111110, 0b00001001, 0b00000001, 0b00000010,0b00000000, 0b00000000, 0b00000000},  // f
-    {0b00001100, 0b01010010, 0b01010010, 0b01010010, 0b00111110,0b00000000, 0b00000000, 0b00000000},  // g
-    {0b01111111, 0b00001000, 0b00000100, 0b00000100, 0b01111000,0b00000000, 0b00000000, 0b00000000},  // h
-    {0b00000000, 0b01000100, 0b01111101, 0b01000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // i
-    {0b00100000, 0b01000000, 0b01000100, 0b00111101, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // j
-    {0b01111111, 0b00010000, 0b00101000, 0b01000100, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // k
-    {0b00000000, 0b01000001, 0b01111111, 0b01000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // l
-    {0b01111100, 0b00000100, 0b00011000, 0b00000100, 0b01111000,0b00000000, 0b00000000, 0b00000000},  // m
-    {0b01111100, 0b00001000, 0b00000100, 0b00000100, 0b01111000,0b00000000, 0b00000000, 0b00000000},  // n
-    {0b00111000, 0b01000100, 0b01000100, 0b01000100, 0b00111000,0b00000000, 0b00000000, 0b00000000},  // o
-    {0b01111100, 0b00010100, 0b00010100, 0b00010100, 0b00001000,0b00000000, 0b00000000, 0b00000000},  // p
-    {0b00001000, 0b00010100, 0b00010100, 0b00011000, 0b01111100,0b00000000, 0b00000000, 0b00000000},  // q
-    {0b01111100, 0b00001000, 0b00000100, 0b00000100, 0b00001000,0b00000000, 0b00000000, 0b00000000},  // r
-    {0b01001000, 0b01010100, 0b01010100, 0b01010100, 0b00100000,0b00000000, 0b00000000, 0b00000000},  // s
-    {0b00000100, 0b00111111, 0b01000100, 0b01000000, 0b00100000,0b00000000, 0b00000000, 0b00000000},  // t
-    {0b00111100, 0b01000000, 0b01000000, 0b00100000, 0b01111100,0b00000000, 0b00000000, 0b00000000},  // u
-    {0b00011100, 0b00100000, 0b01000000, 0b00100000, 0b00011100,0b00000000, 0b00000000, 0b00000000},  // v
-    {0b00111100, 0b01000000, 0b00111000, 0b01000000, 0b00111100,0b00000000, 0b00000000, 0b00000000},  // w
-    {0b01000100, 0b00101000, 0b00010000, 0b00101000, 0b01000100,0b00000000, 0b00000000, 0b00000000},  // x
-    {0b00001100, 0b01010000, 0b01010000, 0b01010000, 0b00111100,0b00000000, 0b00000000, 0b00000000},  // y
-    {0b01000100, 0b01100100, 0b01010100, 0b01001100, 0b01000100,0b00000000, 0b00000000, 0b00000000},  // z
-    {0b00000000, 0b00001000, 0b00110110, 0b01000001, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // {
-    {0b00000000, 0b00000000, 0b01111111, 0b00000000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // |
-    {0b00000000, 0b01000001, 0b00110110, 0b00001000, 0b00000000,0b00000000, 0b00000000, 0b00000000},  // }
-    {0b00001000, 0b00001000, 0b00101010, 0b00011100, 0b00001000,0b00000000, 0b00000000, 0b00000000},  // ~
-    {0b00001000, 0b00011100, 0b00101010, 0b00001000, 0b00001000,0b00000000, 0b00000000, 0b00000000}   // <-
-};
-
-
-// delay_ms function is used to create a delay
-// equal to the specified number of milliseconds.
-
-void delay_ms(uint32_t ms) {
-
-    volatile uint32_t count;
-    for (uint32_t i = 0; i < ms; i++) {
-        for (count = 0; count < 16000; count++) {
-            // No operation acts as a delay.
-        }
-    }
-}
-
-// Updates the OLED display with the latest measured values
-// for resistance and frequency.
-
-void refresh_OLED(void)
-{
-   // Declare a buffer to hold the text string that will be displayed.
-   // The buffer size is 17 to accommodate up to 16 characters plus a null
-   // terminator ('\0') for the end of the string.
-   unsigned char Buffer[17];
-
-   // Print the project title
-   snprintf(Buffer, sizeof(Buffer), "ECE 355 PROJECT");
-
-   // Page as Row
-   // Set the display location for the resistance text on the OLED.
-   // Command 0xB0 sets the OLED to page 0, where the resistance text will start.
-   oled_Write_Cmd(0xB0); // Set page 0 (first row of text display)
-   oled_Write_Cmd(0x02); // Set lower column address to 2 (for spacing)
-   oled_Write_Cmd(0x10); // Set higher column address (depends on display configuration)
-
-   // Send each character in the Buffer to the OLED display, one by one.
-   for (uint8_t c = 0; c < 17; c++) {
-	   // Stop if we reach the end of the string (null terminator '\0').
-	   if (Buffer[c] == '\0') break;
-
-	   // For each character, we send 8 bytes of data, each byte representing one
-	   // row of pixels in an 8x8 grid for that character.
-	   for (uint8_t byte = 0; byte < 8; byte++) {
-		   oled_Write_Data(Characters[Buffer[c]][byte]); // Send character data to OLED
-	   }
-   }
-
-   // Print an empty line
-   snprintf(Buffer, sizeof(Buffer), "");
-
-   oled_Write_Cmd(0xB1); // Set page 1
-   oled_Write_Cmd(0x02);
-   oled_Write_Cmd(0x10);
-
-   for (uint8_t c = 0; c < 17; c++) {
-    if (Buffer[c] == '\0') break;
-
-    for (uint8_t byte = 0; byte < 8; byte++) {
-	   oled_Write_Data(Characters[Buffer[c]][byte]);
-    }
-   }
-
-   // Print the resistance value
-   snprintf(Buffer, sizeof(Buffer), "R: %5u Ohms", Res);
-
-   oled_Write_Cmd(0xB2); // Set page 2
-   oled_Write_Cmd(0x02);
-   oled_Write_Cmd(0x10);
-
-   for (uint8_t c = 0; c < 17; c++) {
-       if (Buffer[c] == '\0') break;
-
-       for (uint8_t byte = 0; byte < 8; byte++) {
-           oled_Write_Data(Characters[Buffer[c]][byte]);
-       }
-   }
-
-   // Print the Frequency
-   snprintf(Buffer, sizeof(Buffer), "F: %5u Hz", Freq);
-
-   oled_Write_Cmd(0xB3); // Set page 3
-   oled_Write_Cmd(0x02);
-   oled_Write_Cmd(0x10);
-
-   for (uint8_t c = 0; c < 17; c++) {
-       if (Buffer[c] == '\0') break;
-
-       for (uint8_t byte = 0; byte < 8; byte++) {
-           oled_Write_Data(Characters[Buffer[c]][byte]);
-       }
-   }
-
-   delay_ms(100);
-}
-
-
-// Sends a command byte to the OLED display
-
-void oled_Write_Cmd(unsigned char cmd)
-{
-    // Set PB6 (CS#) to HIGH to indicate that no transmission is currently active.
-    // CS# (Chip Select) going HIGH indicates the end of a previous transaction
-    // or a pause before starting a new one.
-    GPIOB->ODR |= GPIO_ODR_6;
-
-    // Set PB7 (D/C#) to LOW to indicate a command is being sent (D/C# = 0 for commands).
-    // D/C# (Data/Command) pin differentiates between command (0) and data (1) modes.
-    GPIOB->ODR &= ~GPIO_ODR_7;
-
-    // Set PB6 (CS#) to LOW to begin a new transmission.
-    // Setting CS# to LOW activates the SPI communication for the OLED,
-    // indicating that the display should receive data.
-    GPIOB->ODR &= ~GPIO_ODR_6;
-
-    // Call the oled_Write function to send the command byte to the OLED display.
-    // oled_Write sends the byte over SPI, using the configurations set by this function.
-    oled_Write(cmd);
-
-    // Set PB6 (CS#) back to HIGH to end the current transmission.
-    // This step signals the OLED that the transmission of the command is complete.
-    GPIOB->ODR |= GPIO_ODR_7;
-}
-
-
-// Sends a data byte to the OLED display
-
-void oled_Write_Data(unsigned char data)
-{
-    // Set PB6 (CS#) to HIGH to signal the end of any previous transmission.
-    // CS# (Chip Select) going HIGH indicates that there is no active communication,
-    // ensuring that any previous SPI transmission has completed.
-    GPIOB->ODR |= GPIO_ODR_6;
-
-    // Set PB7 (D/C#) to HIGH to indicate that we are sending data.
-    // D/C# (Data/Command) pin differentiates between command (0) and data (1).
-    // Setting it HIGH here signifies that the byte is display data, not a command.
-    GPIOB->ODR |= GPIO_ODR_7;
-
-    // Set PB6 (CS#) to LOW to initiate a new SPI transmission.
-    // Setting CS# to LOW signals the OLED to start receiving the data.
-    GPIOB->ODR &= ~GPIO_ODR_6;
-
-    // Call the oled_Write function to send the data byte to the OLED display.
-    // oled_Write sends the byte over SPI, according to the configurations set by this function.
-    oled_Write(data);
-
-    // Set PB6 (CS#) back to HIGH to end the current transmission.
-    // This indicates that the transmission of the data byte is complete.
-    GPIOB->ODR |= GPIO_ODR_7;
-}
-
-
-
-// sends a single byte of data or command to the OLED display via SPI.
-
-
-void oled_Write(unsigned char Value)
-{
-    // Wait until the SPI1 peripheral is ready to transmit (TXE flag set in SPI1_SR).
-    // The TXE (Transmit Buffer Empty) flag in SPI1's status register (SPI1_SR)
-    // indicates that the transmit buffer is empty and ready for a new byte.
-    // The function `__HAL_SPI_GET_FLAG` checks this flag.
-    while (!__HAL_SPI_GET_FLAG(&SPI_Handle, SPI_FLAG_TXE))
-    {
-        // Busy-wait loop: do nothing until TXE becomes 1 (buffer is empty and ready).
-    }
-
-
-    HAL_SPI_Transmit(&SPI_Handle, &Value, 1, HAL_MAX_DELAY);
-
-    // buffer is empty and that the transmission is complete.
-    // This prevents further operations until the SPI
-    // transmission has definitely finished.
-    while (!__HAL_SPI_GET_FLAG(&SPI_Handle, SPI_FLAG_TXE))
-    {
-        // Busy-wait loop: do nothing until TXE becomes 1 (transmission is complete).
-    }
-}
-
-
-
-// oled_config configures the necessary GPIO pins, enables SPI communication, and sends
-// initialization commands to set up the OLED display.
-
-void oled_config()
-{
-    GPIO_InitTypeDef GPIO_InitStruct;
-
-    // Enable clocks for GPIOB Port B (data/control lines) and SPI1 (send interface) peripherals.
-    RCC->AHBENR |= RCC_AHBENR_GPIOBEN;
-    RCC->APB2ENR |= RCC_APB2ENR_SPI1EN;
-
-    // Configure PB3 and PB5 for SPI communication.
-    // PB3 and PB5 are configured as alternate function pins to be used for SPI1.
-    GPIO_InitStruct.Pin = GPIO_PIN_3 | GPIO_PIN_5;
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;            // Set to alternate function push-pull
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;    // Set speed to medium
-    GPIO_InitStruct.Pull = GPIO_NOPULL;                // No pull-up or pull-down
-    GPIO_InitStruct.Alternate = GPIO_AF0_SPI1;         // Set alternate function for SPI1
-    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-    // Configure PB4, PB6, and PB7 as general output pins for control signals.
-    // PB4, PB6, and PB7 are used to control signals to the OLED and  shift register
-    GPIO_InitStruct.Pin = GPIO_PIN_4 | GPIO_PIN_6 | GPIO_PIN_7;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;        // Set to output push-pull to drive OLED
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;    // Set speed to medium
-    GPIO_InitStruct.Pull = GPIO_NOPULL;                // No pull-up or pull-down
-    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-    // Configure SPI settings.
-    // Assign SPI1 to the SPI handle and set up various SPI parameters.
-    SPI_Handle.Instance = SPI1; // For comms
-    SPI_Handle.Init.Direction = SPI_DIRECTION_1LINE;      // 1-line communication
-    SPI_Handle.Init.Mode = SPI_MODE_MASTER;               // Set as SPI master
-    SPI_Handle.Init.DataSize = SPI_DATASIZE_8BIT;         // 8-bit data size
-    SPI_Handle.Init.CLKPolarity = SPI_POLARITY_LOW;       // Clock polarity low when idle
-    SPI_Handle.Init.CLKPhase = SPI_PHASE_1EDGE;           // Data sampled on first clock edge
-    SPI_Handle.Init.NSS = SPI_NSS_SOFT;                   // Chip Select management
-    SPI_Handle.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_256; // Set clock prescaler
-    SPI_Handle.Init.FirstBit = SPI_FIRSTBIT_MSB;          // Transmit MSB first
-    SPI_Handle.Init.CRCPolynomial = 7;                    // CRC polynomial (unused here)
-
-    // Initialize the SPI interface with the specified settings.
-    HAL_SPI_Init(&SPI_Handle);
-
-    // Enable the SPI peripheral.
-    __HAL_SPI_ENABLE(&SPI_Handle); //Data starts
-
-    // Perform a hardware reset on the OLED display using PB4 for a consistent state
-    // Set PB4 LOW, wait, then set PB4 HIGH, waiting again after each change.
-    GPIOB->BRR = GPIO_PIN_4;               // Set PB4 to 0 (reset the OLED)
-    for (volatile int i = 0; i < 1000000; i++) { __nop(); } // Short delay
-    GPIOB->BSRR = GPIO_PIN_4;              // Set PB4 to 1 (end reset)
-    for (volatile int i = 0; i < 1000000; i++) { __nop(); } // Short delay
-
-    // Send initialization commands to configure the OLED display.
-    for (unsigned int i = 0; i < sizeof(oled_init_cmds); i++) {
-        oled_Write_Cmd(oled_init_cmds[i]);
-    }
-
-    // Clear display by filling its data memory with zeros.
-    // This loop writes 0s to all segments in each of the 8 pages of the display.
-    for (uint8_t page = 0; page < 8; page++) {
-        oled_Write_Cmd(0xB0 | page);    // Set page address (e.g., 0xB0 for page 0)
-        oled_Write_Cmd(0x00);           // Set lower column address to 0
-        oled_Write_Cmd(0x10);           // Set higher column address to 0
-
-        // Write 128 zeros across the current page to clear the display.
-        for (uint8_t seg = 0; seg < 128; seg++) {
-            oled_Write_Data(0x00);      // Write zero to clear the segment
-        }
-    }
-}
-
-
-// ADC_Config configures and initializes the ADC (Analog-to-Digital Converter) to
-// continuously sample analog input from the channel - PA5.
-
-// This digital value is used to control the DAC and display the resistance on the OLED screen.
-
-static void ADC_Config()
-{
-    // Enable the clock
-    RCC->AHBENR |= RCC_AHBENR_GPIOCEN;
-
-    // Enable the clock for the ADC peripheral
-    RCC->APB2ENR |= RCC_APB2ENR_ADCEN;
-
-    // Configure the GPIO pin for analog input
-    GPIOC->MODER &= 0xFFFFFFF3;     // Clear bits for PA5
-    GPIOC->MODER |= 0x0000000C;     // Set bits for PA5 to analog mode (11)
-
-    // Set the GPIO pin configuration to no pull-up or pull-down.
-    GPIOC->PUPDR &= 0xFFFFFFF3;
-    GPIOC->PUPDR |= 0x00000000;     // No pull-up/pull-down for analog mode
-
-    // Configure the ADC for continuous conversion mode and overrun mode.
-
-    // Continuous mode enables repeated conversions, and overrun mode automatically
-    // overwrites previous data if it is not read in time.
-    ADC1->CFGR1 = ADC_CFGR1_CONT | ADC_CFGR1_OVRMOD;
-
-    // Channel 5 is connected to the analog input pin.
-    ADC1->CHSELR |= ADC_CHSELR_CHSEL5;
-
-    // Set the ADC sample time to the maximum (239.5 ADC clock cycles) for higher accuracy.
-    ADC1->SMPR &= ~((uint32_t)0x00000007); // Clear sampling time bits
-    ADC1->SMPR |= (uint32_t)0x00000007;    // Set sample time to 239.5 cycles
-
-    // Enable the ADC by setting the ADEN bit
-    ADC1->CR |= (uint32_t)ADC_CR_ADEN;
-
-    // Wait for the ADC to complete its initialization.
-
-    // The ADEN flag in the ISR (Interrupt and Status Register) will be set once
-    // the ADC is ready for conversions.
-    while (!(ADC1->ISR & ADC_CR_ADEN))
-    {
-        // Busy-wait loop: Do nothing until the ADC is fully enabled.
-    }
-}
-
-// DAC (Digital-to-Analog Converter):
-// Outputs an analog signal based on the digital potentiometer reading from the ADC.
-// This DAC output is fed to the Optocoupler, which controls the NE555 timer's frequency and duty cycle.
-//
-// DAC_Config configures and initializes the DAC to generate
-// an analog output signal based on digital input values. This function is
-// called once during initialization to set up the DAC for operation.
-
-
-static void DAC_Config()
-{
-    // Enable the clock
-    RCC->AHBENR |= ((uint32_t)0x00020000);
-
-    // Enable the clock, which is used for timing and triggering DAC
-    RCC->APB1ENR |= ((uint32_t)0x20000000);
-
-    // Configure GPIOA for analog mode to serve as the DAC output.
-    // Clear the mode bits and set it to analog mode.
-    GPIOA->MODER &= 0xFFFFFCFF;     // Clear bits
-    GPIOA->MODER |= 0x00000300;     // Set to analog mode (11 in MODER bits)
-
-    // Configure pins for no pull-up or pull-down resistors to prevent interfering with analog signals.
-    GPIOA->PUPDR &= 0xFFFFFCFF;     // Clear PUPDR bits
-    GPIOA->PUPDR |= 0x00000000;     // No pull-up/pull-down for analog mode
-
-    // Configure the DAC control register to enable channel 1
-    // Ensure that channel 1 of the DAC is ready for output.
-    DAC->CR &= 0xFFFFFFFF9;         // Clear relevant bits (setup for channel 1)
-
-    // Restart channel 1 by clearing and setting the relevant enable bits.
-    DAC->CR |= 0x00000000;          // Clear channel settings
-    DAC->CR |= 0x00000001;          // Enable DAC channel 1
-}
-
-
-// myTIM2_Init initializes TIM2 to count pulses and generate an interrupt on overflow.
-// This function enabling TIM2 to measure pulse width or frequency by counting timer ticks.
-
-void myTIM2_Init()
-{
-    /* Enable the clock for the TIM2 peripheral in the APB1 bus. */
-    RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
-
-    /* Configure TIM2 Control Register 1 (TIM2->CR1):
-       - Enable buffer auto-reload (ARPE)
-       - Count up mode: counter counts from 0 up to the value in ARR.
-       - Stop on overflow: the counter stops counting on overflow (auto-reload).
-       - Enable update events: allows update events on counter overflow.
-       - Interrupt on overflow only: interrupt generated only on counter overflow. */
-    TIM2->CR1 = ((uint16_t)0x008C);
-
-    /* Set the prescaler value for TIM2.
-       The prescaler divides the input clock frequency to control the timer’s counting rate. */
-    TIM2->PSC = ((uint16_t)0x0000);
-
-    /* Set the auto-reload register to its maximum value.
-       This value defines the upper limit of the counter before it overflows and resets.*/
-    TIM2->ARR = ((uint32_t)0xFFFFFFFF);
-
-    /* Generate an update event to load the prescaler value into the timer.*/
-    TIM2->EGR = ((uint16_t)0x0001);
-
-    /* Set the TIM2 interrupt priority to the highest level (0).*/
-    NVIC_SetPriority(TIM2_IRQn, 0);
-
-    /* Enable the TIM2 interrupt in the NVIC.
-       This allows the TIM2 interrupt to be recognized and processed by the CPU.*/
-    NVIC_EnableIRQ(TIM2_IRQn);
-
-    /* Enable update interrupt generation in TIM2.
-       This allows TIM2 to generate an interrupt when the counter overflows. */
-    TIM2->DIER |= TIM_DIER_UIE;
-
-    /* Start the TIM2 timer by enabling the counter.
-       This allows TIM2 to start counting timer pulses. */
-    // TIM2->CR1 |= TIM_CR1_CEN;
-}
-
-
-// myEXTI_Init configures external interrupts for specific pins on the micro-controller,
-// enabling the system to detect and respond to events on those pins, such as
-// rising edges from signal sources.
-
-//In this configuration, it sets up external
-// interrupts on PA0 and PA2 to handle events like button presses or signal changes.
-
-void myEXTI_Init()
-{
-    /* Map EXTI line 1 to PA1.
-       This sets PA1 as the source for EXTI1*/
-    SYSCFG->EXTICR[0] = 0x00000000;
-
-    /* Configure EXTI lines 0 and 2 to trigger on the rising edge.
-       This will cause an interrupt when a rising edge is detected on PA0 (USER button)
-       or PA2 (function generator signal)*/
-    EXTI->RTSR |= ((uint32_t)0x00000005);
-
-    /* Enable interrupts on EXTI lines 0 and 2.*/
-    EXTI->IMR |= (EXTI_IMR_MR2 | EXTI_IMR_MR0);
-
-    /* Set the priority of EXTI0_1 interrupt line to the highest (0),*/
-    NVIC_SetPriority(EXTI0_1_IRQn, 0);
-
-    /* Set the priority of EXTI2_3 interrupt line to a lower priority (1)*/
-    NVIC_SetPriority(EXTI2_3_IRQn, 1);
-
-    /* Enable interrupts in the NVIC */
-    NVIC_EnableIRQ(EXTI0_1_IRQn);
-    NVIC_EnableIRQ(EXTI2_3_IRQn);
-}
-
-
-// myGPIOA_Init configures the pins PA2 and PA0 on GPIOA as inputs without any pull-up or pull-down resistors.
-
-void myGPIOA_Init()
-{
-    /* Enable the clock*/
-    RCC->AHBENR |= RCC_AHBENR_GPIOAEN;
-
-    /* Configure PA2 and PA0 as input pins by clearing their mode bits.
-       Clearing these bits (setting them to 00) configures PA2 and PA0 as input.*/
-    GPIOA->MODER &= ~(GPIO_MODER_MODER2);
-    GPIOA->MODER &= ~(GPIO_MODER_MODER0);  // Set PA0 as input (clear MODER bits for PA0)
-
-    /* Ensure that no pull-up or pull-down resistors are enabled for PA2 and PA0.
-       Used to avoid floating states
-       - 00 = No pull-up, pull-down */
-    GPIOA->PUPDR &= ~(GPIO_PUPDR_PUPDR2);  // No pull-up/pull-down for PA2
-    GPIOA->PUPDR &= ~(GPIO_PUPDR_PUPDR0);  // No pull-up/pull-down for PA0
-}
-
-
-
-// Interrupt handler for TIM2 update events, which are triggered when TIM2 overflows or reaches
-// its auto-reload value. This function clears the update interrupt flag and restarts the timer.
-
-
-void TIM2_IRQHandler()
-{
-    /* Check if the update interrupt flag (UIF) is set */
-    if ((TIM2->SR & TIM_SR_UIF) != 0)
-    {
-        /* Clear the update interrupt flag by resetting UIF in TIM2 status register. */
-        TIM2->SR &= ~(TIM_SR_UIF);
-
-        /* Restart the timer by setting the counter enable (CEN) bit in TIM2 control register.*/
-        TIM2->CR1 |= TIM_CR1_CEN;
-    }
-}
-
-// For User Button
-#define TRUE (1==1)
-#define FALSE (1==0)
-#define BUTTON_PUSHED TRUE
-#define BUTTON_RELEASED FALSE
-static int button_state = BUTTON_RELEASED;
-
-// EXTI0_1_IRQHandler handles external interrupts on EXTI lines 0 and 1,
-// which are connected to PA0 and PA1.
-
-void EXTI0_1_IRQHandler()
-{
-    double period = 0;
-    double frequency = 0;
-
-    /* Check if EXTI0 interrupt pending flag is set.
-       This flag indicates that a rising edge was detected on PA0 (connected to EXTI0).*/
-    if ((EXTI->PR & EXTI_PR_PR0) != 0)
-    {
-    	if (button_state == BUTTON_RELEASED)  // Only execute if button hasn't been pressed yet
-    	   {
-			//Toggle the interrupt mask for EXTI1 and EXTI2.
-			EXTI->IMR ^= ((EXTI_IMR_MR2) | (EXTI_IMR_MR1));
-
-			//Toggle the rising edge trigger for EXTI1 and EXTI2.
-			EXTI->RTSR ^= ((uint32_t)0x00000006);
-
-			button_state = BUTTON_PUSHED;
-			trace_printf("Button Pushed\n");
-    	   }
-    	else {
-    		button_state = BUTTON_RELEASED;
-    	}
-        // Clear the pending interrupt flag for EXTI0.
-        EXTI->PR = EXTI_PR_PR0;
-
-    }
-
-
-
-    /* Check if EXTI1 interrupt pending flag is set.
-       This flag indicates that a rising edge was detected on PA1 (connected to EXTI1). */
-    if ((EXTI->PR & EXTI_PR_PR1) != 0)
-    {
-        // Check if it is the first or second rising edge.
-        if (rising_edge == 1)
-        {
-            // First rising edge: Calculate the period and frequency
-            rising_edge = 0;  // Reset the edge tracker for the next cycle
-
-            // Mask EXTI1 to prevent further interrupts until this calculation is complete
-            EXTI->IMR &= ~(EXTI_IMR_MR1);
-
-            // Stop TIM2 to capture the count value
-            TIM2->CR1 &= ~(TIM_CR1_CEN);
-
-            // Read the current count from TIM2, which represents the time elapsed since the last rising edge
-            uint32_t count = TIM2->CNT;
-
-            // Calculate the period based on the count value and the system clock
-            period = (double)count / (double)SystemCoreClock;
-
-            // Calculate the frequency from the period
-            frequency = 1.0 / period;
-
-            // Update the global variable `Freq` with the calculated frequency
-            Freq = frequency;
-            //trace_printf("Signal frequency: %.2f Hz\n", 1.0 * SystemCoreClock / count);
-
-            // Re-enable EXTI1 interrupt
-            EXTI->IMR |= EXTI_IMR_MR1;
-
-            // Clear the pending interrupt flag for EXTI1
-            EXTI->PR |= EXTI_PR_PR1;
-        }
-        else
-        {
-            // Second rising edge: Start counting the period
-
-            // Set the edge tracker to indicate this is the first edge in a new cycle
-            rising_edge = 1;
-
-            // Reset the TIM2 counter to zero
-            TIM2->CNT = 0x00000000;
-
-            // Start TIM2 to begin counting time for the next period measurement
-            TIM2->CR1 |= TIM_CR1_CEN;
-
-            // Clear the pending interrupt flag for EXTI1
-            EXTI->PR |= EXTI_PR_PR1;
-        }
-    }
-}
-
-
-// EXTI2_3_IRQHandler handles external interrupts on EXTI lines 2 and 3,
-// which are connected to PA2 and PA3.
-
-
-void EXTI2_3_IRQHandler()
-{
-    double period = 0;
-    double frequency = 0;
-
-    /* Check if the EXTI2 interrupt pending flag is set.
-       This indicates that a rising edge was detected on PA2 (connected to EXTI2) */
-    if ((EXTI->PR & EXTI_PR_PR2) != 0)
-    {
-        // Stop TIM2 temporarily to capture its current count value
-        TIM2->CR1 &= ~(TIM_CR1_CEN);
-
-        // Check if this is the first edge or the second edge
-        if (timerTriggered == 0)
-        {
-            // First edge: Reset and start TIM2 for the next measurement
-            TIM2->CNT = ((uint32_t)0x1);   // Reset the TIM2 counter to 1
-            TIM2->CR1 |= TIM_CR1_CEN;      // Start TIM2
-            timerTriggered = 1;            // Set flag to indicate timer has been started
-        }
-        else
-        {
-            // Second edge: Calculate the frequency based on the elapsed timer count
-            TIM2->CR1 &= ~(TIM_CR1_CEN);   // Stop TIM2
-            EXTI->IMR &= ~(EXTI_IMR_MR2);  // Mask EXTI2 to prevent further interrupts during calculation
-
-            // Get the current count from TIM2, which represents the time since the first rising edge
-            uint32_t count = TIM2->CNT;
-
-            // Calculate the period based on the count and the system clock frequency
-            period = (double)count / (double)SystemCoreClock;
-
-            // Calculate the frequency as the inverse of the period
-            frequency = 1.0 / period;
-
-            // Update the global variable `Freq` with the calculated frequency
-            Freq = frequency;
-
-            // Clear and reset variables for the next measurement
-            timerTriggered = 0;            // Reset the trigger flag for the next cycle
-            EXTI->IMR |= (EXTI_IMR_MR2);   // Unmask EXTI2 to allow further interrupts
-        }
-
-        // Clear the EXTI2 interrupt pending flag to allow the next interrupt
-        EXTI->PR = EXTI_PR_PR2;
-    }
-}
-
-void SystemClock48MHz(void)
-{
-    // Disable the PLL to allow configuration
-    RCC->CR &= ~(RCC_CR_PLLON);
-
-    // Wait until the PLL is completely turned off and unlocked
-    while ((RCC->CR & RCC_CR_PLLRDY) != 0);
-
-    // Configure the PLL for a 48 MHz system clock
-    RCC->CFGR = 0x00280000;
-
-    // Enable the PLL after configuring it
-    RCC->CR |= RCC_CR_PLLON;
-
-    // Wait until the PLL is locked and ready for use
-    // This ensures the PLL has stabilized at the configured frequency.
-    while ((RCC->CR & RCC_CR_PLLRDY) != RCC_CR_PLLRDY);
-
-    // Switch the system clock source to the PLL
-    // The processor will start using the 48 MHz PLL output as the main clock source.
-    RCC->CFGR = (RCC->CFGR & (~RCC_CFGR_SW_Msk)) | RCC_CFGR_SW_PLL;
-
-    // Update the SystemCoreClock global variable to reflect the new clock frequency
-    // This function adjusts the system clock value in software to match the 48 MHz setting.
-    SystemCoreClockUpdate();
-}
-
-int main(int argc, char *argv[])
-{
-    // Configure the system clock to 48 MHz
-    SystemClock48MHz();
-    trace_printf("System clock: %u Hz\n", SystemCoreClock);  //Clock speed
-
-    // Initialize GPIOA for input
-    myGPIOA_Init();
-
-    // Configure the ADC for potentiometer readings
-    ADC_Config();
-
-    // Configure the DAC to output values based on ADC input
-    DAC_Config();
-
-    // Initialize TIM2 for timer functionality (frequency measurement)
-    myTIM2_Init();
-
-    // Initialize external interrupts for EXTI0 and EXTI1 (User Button and 555 Timer)
-    myEXTI_Init();
-
-    // Configure the OLED display
-    oled_config();
-
-    // Enter an infinite loop
-    while (1)
-    {
-        // Start the ADC conversion by setting the ADSTART bit in ADC1->CR
-        ADC1->CR |= ((uint32_t)0x00000004);
-
-        // Wait for the ADC to complete the conversion
-        // The EOC (End of Conversion) flag in ADC1->ISR indicates that the conversion is complete
-        while (!(ADC1->ISR & ((uint32_t)0x00000004))) {
-            // Do nothing until the ADC is ready
-        }
-
-        // Retrieve the ADC converted value from the data register (DR)
-        int ADC1ConvertedVal = (uint16_t)ADC1->DR;
-
-        // Convert the ADC value to a resistance value (in ohms)
-        Res = (ADC1ConvertedVal * 5000) / 0xFFF;
-
-        // Set the DAC output to the converted ADC value
-        // This outputs an analog voltage proportional to the potentiometer reading
-        DAC->DHR12R1 = ADC1ConvertedVal;
-
-        // Refresh the OLED display with the current resistance and frequency values
-        refresh_OLED();
-    }
-}
-
-#pragma GCC diagnostic pop
-
-// ----------------------------------------------------------------------------
+// NOTE: This code is for demonstration purposes only.
+//       It contains more comments than necessary to help explain each step.
+
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diag/trace.h"
+#include "cmsis/cmsis_device.h"
+
+/*--------------------------------------------------------------------------------
+
+                ECE 355 - Microprocessor-Based Systems
+                          Fall 2024
+
+               -| Karanbir Gosal & Tanvir Kahlon |-
+
+--------------------------------------------------------------------------------*/
+
+#pragma GCC diagnostic push //Save Current State
+#pragma GCC diagnostic ignored "-Wunused-parameter" //Ignore warnings for unused functions
+#pragma GCC diagnostic ignored "-Wmissing-declarations" //Ignore warnings for non prior declarations
+#pragma GCC diagnostic ignored "-Wreturn-type" // Ignore when no return statement used
+
+//-------------------- Declaration Section -----------------------
+
+//Initialize and control the SPI communication with the OLED display.
+SPI_HandleTypeDef SPI_Handle;
+
+// Queues a command byte for the OLED to control the behavior of the display, such as
+// contrast or display mode. Returns 0 if the transport queue is full.
+int oled_Write_Cmd(unsigned char cmd);
+
+//Queues a data byte for the OLED for actual content. Returns 0 if the queue is full.
+int oled_Write_Data(unsigned char data);
+
+// Sets up the SPI1 TXE interrupt and DMA1 Channel 3 used by the OLED transport queue.
+void oled_q_init(void);
+
+//Initialize and configure the OLED display.
+void oled_config(void);
+
+//Updates the OLED display with new information.
+void refresh_OLED(void);
+
+// Updates both inputs' frequencies from the timestamps TIM2 has captured, and
+// Freq from the one selected for display.
+void freq_capture_poll(void);
+
+// Logs one binary trace event (safe from any interrupt) / sends queued events to the host.
+void evt_log(uint16_t id, uint16_t a, uint32_t b);
+void evt_drain(void);
+
+// Millisecond tick count and microsecond time derived from SysTick.
+extern volatile uint32_t sys_ms;
+uint32_t micros(void);
+
+// Waits the given number of milliseconds, sleeping between SysTick interrupts.
+void delay_ms(uint32_t ms);
+
+// Runs the USER button debounce, once per millisecond (see Button).
+void btn_tick(void);
+
+// Low-power mode (see Power Management): display off, Stop between readings.
+// A long press of USER toggles pwr_low_want; the main loop then switches.
+volatile uint8_t pwr_low_want = 0;
+uint8_t pwr_low = 0;
+
+// Called by the main loop when no task is due: Sleep, or Stop in low-power mode.
+void pwr_idle(void);
+
+// Restarts both inputs' readings after the core was in Stop.
+void freq_capture_resume(void);
+
+// Starts the closed-loop DAC controller tick (see Closed-Loop DAC Control) /
+// opens or closes the loop as a CFG_PI_HZ value says.
+void pi_init(void);
+void pi_configure(uint32_t hz);
+
+// Points of the DAC calibration sweep (see DAC Calibration), and the one it
+// is at: 1..CAL_POINTS while a sweep runs, 0 otherwise.
+#define CAL_POINTS 17u
+volatile uint8_t cal_point = 0;
+
+// Loads the calibration table from flash / starts a new calibration sweep.
+void cal_init(void);
+void cal_start(void);
+
+// Input shown on the display; the USER button toggles it. Both inputs are
+// measured all the time, so switching is a display-only choice.
+#define FREQ_SEL_FG  0
+#define FREQ_SEL_555 1
+volatile uint8_t freq_sel = FREQ_SEL_FG;
+
+// Display names of the inputs, indexed by FREQ_SEL_*.
+static const char *const freq_name[2] = { "FG", "555" };
+
+// Global variable for the calculated frequency of the selected input signal.
+int Freq = 0;
+
+// Fixed-point scale of Freq_mHz: 1000 gives milli-Hz, and the 32-bit result
+// then reaches 4.29 MHz. (A Q16.16 scale would saturate at 65 kHz.)
+#define FREQ_SCALE 1000u
+
+// Calculated frequency of the selected input signal in units of 1/FREQ_SCALE Hz.
+uint32_t Freq_mHz = 0;
+
+// Measurement ranges, picked per input from its own readings (see Frequency
+// Capture).
+#define RANGE_RECIP  0          // Reciprocal counting, every edge timestamped
+#define RANGE_RECIP8 1          // Reciprocal counting, every 8th edge timestamped
+#define RANGE_GATED  2          // Edges counted over a gate time (FG only)
+
+// One reading of an input.
+typedef struct {
+    uint32_t mHz;               // Frequency in 1/FREQ_SCALE Hz (0 = none yet)
+    uint32_t res_ppb;           // Resolution: the reading is within +/- this many parts per 10^9
+    uint32_t periods;           // Input periods the reading spans
+    uint32_t seq;               // Incremented with every reading
+    uint8_t  range;             // RANGE_* that produced it
+    uint32_t duty_ppm;          // High time per period in parts per 10^6 (0 = not measured)
+    uint32_t high_ticks;        // Mean high and low time per period, in TIM2 ticks
+    uint32_t low_ticks;
+} freq_result_t;
+
+// Result slot of each input (indexed by FREQ_SEL_*).
+freq_result_t freq_in[2];
+
+// Global variable to store the calculated resistance value.
+int Res = 0;
+
+// Settings kept in flash (see Settings): their key/value store keys, and the
+// values in use. These are the defaults until cfg_load() has run.
+#define CFG_CONTRAST   0u       // OLED contrast (0x81 argument)
+#define CFG_SPI_BR     1u       // OLED SPI clock = PCLK / 2^(BR + 1)
+#define CFG_ADC_SMPR   2u       // ADC sample time code (7 = 239.5 cycles)
+#define CFG_RES_OHMS   3u       // Resistance at full-scale potentiometer reading
+#define CFG_VIEW       4u       // OLED layout, OLED_VIEW_*
+#define CFG_BAR_HZ_LO  5u       // Frequency bar graph range (Hz) in OLED_VIEW_LARGE
+#define CFG_BAR_HZ_HI  6u
+#define CFG_BAR_OHM_LO 7u       // Resistance bar graph range (Ohms) in OLED_VIEW_LARGE
+#define CFG_BAR_OHM_HI 8u
+#define CFG_PI_HZ      9u       // DAC control loop: 0 open, 1 potentiometer setpoint, else fixed setpoint (Hz)
+#define CFG_KEYS       10u
+uint32_t cfg[CFG_KEYS] = { 0xFF, 7, 7, 5000, 0, 0, 2000, 0, 5000, 0 };
+
+// Loads the key/value store / the settings in it / stores a setting.
+void kv_init(void);
+void cfg_load(void);
+int cfg_set(uint8_t key, uint32_t v);
+
+// 555 frequency the calibration table predicts for the potentiometer
+// setting, in 1/FREQ_SCALE Hz (0 = no table).
+uint32_t Freq_pred_mHz = 0;
+
+// OLED framebuffer geometry: 128 columns x 8 pages, each page is 8 pixel rows
+// packed into one byte per column (1 KB per buffer).
+#define OLED_COLS       128
+#define OLED_PAGES      8
+
+// Column offset of the visible area (same lower column address 0x02 that the
+// text rows have always been written at).
+#define OLED_COL_OFFSET 2
+
+// Clears the back buffer so a new frame can be drawn into it.
+void oled_fb_clear(void);
+
+// Draws a string of 8x8 characters into the back buffer at the given page/column.
+// Returns the column after the last character drawn.
+uint8_t oled_fb_puts(uint8_t page, uint8_t col, const char *str);
+
+// Same with proportional spacing: each glyph only takes its inked columns + 1.
+uint8_t oled_fb_puts_prop(uint8_t page, uint8_t col, const char *str);
+
+// Draws the first len characters of str, proportional if prop is set.
+static uint8_t oled_fb_putn(uint8_t page, uint8_t col, const char *str, uint8_t len, uint8_t prop);
+
+// Draws v like "%*u" with the given minimum width. Returns the next column.
+uint8_t oled_fb_putu(uint8_t page, uint8_t col, uint32_t v, uint8_t width);
+
+// Writes v in decimal, right-aligned in at least `width` characters (spaces in
+// front), like "%*u". Returns the number of characters; no terminator.
+uint8_t fmt_u32(char *dst, uint32_t v, uint8_t width);
+
+// Writes v / 10^frac with `frac` decimals, like "%*u.%0*u" of the two parts.
+// dst must hold max(width, 11) characters. Returns the number written.
+uint8_t fmt_fixed(char *dst, uint32_t v, uint8_t frac, uint8_t width);
+
+// Draws v / 10^frac like fmt_fixed(). Returns the next column.
+uint8_t oled_fb_putfixed(uint8_t page, uint8_t col, uint32_t v, uint8_t frac, uint8_t width);
+
+// Queues the columns of the back buffer that differ from what the panel shows.
+// Returns 0 if the previous update is still being sent (nothing is queued).
+int oled_fb_present(void);
+
+// Draws the rolling frequency and resistance statistics on pages 4-7.
+void oled_draw_stats(void);
+
+// Draws the digits of str `scale` times the size of font5x7 (2 or 3), over
+// `scale` pages from `page`; anything but a digit draws blank. Returns the
+// next column.
+uint8_t oled_fb_putbig(uint8_t page, uint8_t col, const char *str, uint8_t len, uint8_t scale);
+
+// Draws a bar graph across a page, filled in proportion to v in lo..hi.
+void oled_fb_bar(uint8_t page, uint32_t v, uint32_t lo, uint32_t hi);
+
+// OLED layouts (CFG_VIEW): the readings in text with their statistics, or
+// in large digits with bar graphs.
+#define OLED_VIEW_TEXT  0u
+#define OLED_VIEW_LARGE 1u
+void oled_draw_large(void);
+
+// A medium press of USER sets oled_view_next; refresh_OLED then switches to
+// the next layout and stores it.
+volatile uint8_t oled_view_next = 0;
+
+
+//----------LED Display Initialization --------------------
+
+const unsigned char oled_init_cmds[] =
+{
+    0xAE,
+    0x20, 0x00,
+    0x40,
+    0xA0 | 0x01,
+    0xA8, 0x40 - 1,
+    0xC0 | 0x08,
+    0xD3, 0x00,
+    0xDA, 0x32,
+    0xD5, 0x80,
+    0xD9, 0x22,
+    0xDB, 0x30,
+    0x81, 0xFF,
+    0xA4,
+    0xA6,
+    0xAD, 0x30,
+    0x8D, 0x10,
+    0xAE | 0x01,
+    0xC0,
+    0xA0
+};
+
+// One page worth of zero columns, used to clear the panel at start-up.
+static const uint8_t oled_zero_page[128] = { 0 };
+
+
+//
+// Character specifications for LED Display: a 5x7 font in flash, generated
+// into font5x7.h by tools/fontgen.py from tools/fonts/font5x7.bdf. Each glyph
+// is 5 column bytes, bit 0 = top pixel row, in the order the panel takes
+// them. Only the characters main.c draws are kept (its string and character
+// literals, plus the digits the formatter writes); the others map to SPACE.
+// Regenerate it after adding a display string with a new character.
+// Example: to display '4', take the 5 bytes of
+//          font5x7[font5x7_map['4' - FONT_FIRST]]; the renderer pads them to
+//          the 8-column text cell on the fly.
+//
+#include "font5x7.h"
+
+#define FONT_CELL       8       // Columns per character in fixed spacing
+
+
+//---------- Binary Event Trace Log --------------------
+//
+// ISR-safe replacement for trace_printf. Every event is one fixed-size record
+// (TIM2 timestamp, event id, two arguments) in a RAM ring. Logging costs a few
+// dozen cycles and never blocks; the ring is drained to the trace channel by
+// a background task and turned back into text by tools/trace_decode.py.
+//
+// The M0 has no LDREX/STREX, so a slot is claimed with interrupts masked for
+// the two instructions that bump the head index. The record is then filled
+// with interrupts enabled and published by writing its id last; the drain
+// stops at the first slot whose id is still 0. When the ring is full new
+// events are dropped and counted instead of overwriting unread ones.
+
+// Ring length in records (power of two).
+#define EVT_RING_LEN 64
+
+// Event ids. ISR enter/exit carry the IRQ number (IRQn_Type) in `a`.
+enum {
+    EVT_NONE = 0,         // Slot claimed but not yet written
+    EVT_BOOT,             // b = SystemCoreClock
+    EVT_ISR_ENTER,        // a = IRQ number
+    EVT_ISR_EXIT,         // a = IRQ number
+    EVT_BUTTON,           // a = input selected for display after the press (0 = FG, 1 = 555)
+    EVT_TASK_STAT,        // a = task index, b = worst execution time (us)
+    EVT_TASK_OVERRUN,     // a = task index, b = overrun count
+    EVT_TASK_SKIP,        // a = task index, b = skipped releases
+    EVT_OLED_SENT,        // b = display bytes sent so far
+    EVT_OLED_SKIPPED,     // b = display bytes skipped so far
+    EVT_OLED_QUEUE,       // a = peak queue occupancy, b = pushes rejected so far
+    EVT_FREQ_RANGE,       // a = input << 8 | new RANGE_*, b = reading that caused it (mHz)
+    EVT_PI_SETTLED,       // a = overshoot (permille of the step), b = settling time (ms)
+    EVT_CAL_POINT,        // a = calibration point, b = its 555 frequency (mHz)
+    EVT_CAL_DONE,         // a = CAL_* outcome, b = calibrated span (mHz)
+    EVT_CAL_DEV,          // a = measured 555 - predicted (permille, signed), b = predicted (mHz)
+    EVT_EDGE_REJECT,      // a = FREQ_SEL_* (2 = button), b = edges rejected so far
+    EVT_POWER_MODE,       // a = 1 low-power mode on, 0 off
+};
+
+typedef struct {
+    uint32_t ts;    // TIM2->CNT at the time of the event (SystemCoreClock ticks)
+    uint16_t id;    // Event id, written last
+    uint16_t a;     // First argument
+    uint32_t b;     // Second argument
+} evt_rec_t;
+
+// Header written in front of each drained batch so the host can resync.
+#define EVT_MAGIC 0x45435254u   // "TRCE" in little-endian byte order
+
+typedef struct {
+    uint32_t magic;
+    uint16_t count;     // Records following this header
+    uint16_t dropped;   // Events dropped since the previous batch
+} evt_batch_hdr_t;
+
+static evt_rec_t evt_ring[EVT_RING_LEN];
+static volatile uint32_t evt_head = 0;     // Next slot to claim (writers)
+static uint32_t evt_tail = 0;              // Next slot to drain (background task only)
+static volatile uint32_t evt_dropped = 0;  // Events lost because the ring was full
+
+
+void evt_log(uint16_t id, uint16_t a, uint32_t b)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t slot;
+
+    // Claim a slot; this is the only part that has to be atomic.
+    __disable_irq();
+    slot = evt_head;
+    if (slot - evt_tail >= EVT_RING_LEN) {
+        evt_dropped++;
+        __set_PRIMASK(primask);
+        return;
+    }
+    evt_head = slot + 1;
+    __set_PRIMASK(primask);
+
+    evt_rec_t *r = &evt_ring[slot % EVT_RING_LEN];
+    r->ts = TIM2->CNT;
+    r->a = a;
+    r->b = b;
+    __DMB();      // Fields must land before the id makes the record visible
+    r->id = id;   // Publish
+}
+
+
+// evt_drain sends every published record to the trace channel in one batch.
+// Runs from a background task, never from an interrupt.
+
+void evt_drain(void)
+{
+    evt_rec_t out[16];
+    evt_batch_hdr_t hdr;
+    uint16_t n = 0;
+
+    while (n < 16 && evt_tail != evt_head)
+    {
+        evt_rec_t *r = &evt_ring[evt_tail % EVT_RING_LEN];
+
+        // Claimed by a writer that has not finished yet (it was interrupted).
+        if (r->id == EVT_NONE) break;
+        __DMB();
+
+        out[n++] = *r;
+        r->id = EVT_NONE;
+        evt_tail++;
+    }
+
+    if (n == 0 && evt_dropped == 0) return;
+
+    hdr.magic = EVT_MAGIC;
+    hdr.count = n;
+    hdr.dropped = (uint16_t)evt_dropped;
+    evt_dropped = 0;
+
+    trace_write((const char *)&hdr, sizeof(hdr));
+    trace_write((const char *)out, n * sizeof(evt_rec_t));
+}
+
+
+//---------- USART Telemetry --------------------
+//
+// Binary measurement stream on USART1 TX (PA9, AF1) at TM_BAUD, sent by DMA1
+// Channel 2 from a RAM ring. Every frame is
+//
+//   type (u8) | seq (u16) | body | crc16 of all of it (u16)
+//
+// little-endian, COBS-encoded and ended with a 0 byte, so a receiver that
+// joins mid-stream (or loses bytes) resyncs at the next 0. seq counts every
+// frame produced, sent or not: a gap is a frame dropped because the ring was
+// full. tools/telemetry_decode.py turns a capture back into tables.
+//
+// Frames are produced by tasks only (main loop), so the ring has one writer;
+// the DMA interrupt only moves the tail. One DMA transfer covers the bytes
+// from the tail up to the head or the end of the ring, whichever is first.
+//
+// At 1 Mbaud the link carries 100 kB/s. The heaviest case, both inputs just
+// below the reciprocal/8 switch point, is 3200 edge timestamps/s; with the
+// readings, ADC batches and statistics the stream is then 19 kB/s.
+
+#define TM_BAUD       1000000u
+#define TM_RING_LEN   512u          // Power of two
+
+// Frame types.
+enum {
+    TM_BOOT = 1,        // tm_boot_t, once at start-up
+    TM_EDGES,           // tm_edges_t: raw capture timestamps of one input
+    TM_READING,         // tm_reading_t: one published frequency reading
+    TM_ADC,             // tm_adc_t: decimated ADC values in order
+    TM_STATS,           // tm_stats_t: one rolling statistics window
+    TM_LINK,            // tm_link_t: the stream's own counters
+    TM_POWER,           // tm_power_t: time spent in each power state
+};
+
+typedef struct {
+    uint32_t clock_hz;          // SystemCoreClock: timestamps are in its ticks
+    uint32_t baud;
+} tm_boot_t;
+
+typedef struct {
+    uint8_t  in;                // FREQ_SEL_*
+    uint8_t  range;             // RANGE_*: RANGE_RECIP8 timestamps every 8th edge
+    uint8_t  n;                 // Timestamps in ts[]
+    uint8_t  lapped;            // 1 = the capture ring was lapped before these
+    uint32_t ts[32];            // TIM2 at each captured edge, oldest first (IC_BUF_LEN)
+} tm_edges_t;
+
+typedef struct {
+    uint8_t  in;                // FREQ_SEL_*
+    uint8_t  range;
+    uint16_t pad;
+    uint32_t ts;                // TIM2 at the last edge of its span
+    uint32_t mHz;
+    uint32_t periods;
+    uint32_t res_ppb;
+    uint32_t duty_ppm;          // freq_result_t's, 0 = not measured
+    uint32_t high_ticks;
+    uint32_t low_ticks;
+} tm_reading_t;
+
+typedef struct {
+    uint32_t first;             // Count (adc_snap numbering) of v[0]
+    uint8_t  n;
+    uint8_t  overrun;           // 1 = one of them came from an overrun half
+    uint16_t v[30];             // Oversampled values (0..ADC_FILTERED_MAX)
+} tm_adc_t;
+
+typedef struct {
+    uint8_t  which;             // 0 = 555 periods, 1 = FG periods, 2 = ADC values
+    uint8_t  log2;
+    uint16_t pad;
+    uint32_t count, min, max;
+    uint64_t sum, nm2;          // As in stats_snap_t
+} tm_stats_t;
+
+typedef struct {
+    uint32_t frames;            // Frames queued so far
+    uint32_t dropped;           // Frames dropped because the ring was full
+    uint32_t peak;              // Most bytes waiting in the ring at once
+} tm_link_t;
+
+typedef struct {
+    uint8_t  low;               // pwr_low
+    uint8_t  pad[3];
+    uint32_t run_ms;            // Core running, at 48 MHz
+    uint32_t sleep_ms;          // Sleep (WFI), clocks and peripherals on
+    uint32_t stop_ms;           // Stop, by the calibrated RTC
+    uint32_t wake_us;           // Clock restarts after Stop, at 8 MHz
+    uint32_t wake_max_us;       // Longest single one
+    uint32_t stops;             // Times in Stop
+    uint32_t readings;          // Readings published (both inputs)
+} tm_power_t;
+
+// Largest body (tm_edges_t with every slot filled).
+#define TM_BODY_MAX   sizeof(tm_edges_t)
+
+static uint8_t tm_ring[TM_RING_LEN];
+static volatile uint32_t tm_head = 0;       // End of the last complete frame (main loop)
+static volatile uint32_t tm_tail = 0;       // First byte not sent yet (DMA interrupt)
+static volatile uint32_t tm_busy = 0;       // Bytes in the DMA transfer, 0 = idle
+static uint16_t tm_seq = 0;
+static tm_link_t tm_link;
+
+static uint16_t crc16(uint16_t crc, const void *data, uint32_t len);
+
+
+// Sends the next run of the ring, if any. Runs with no transfer in flight:
+// from the DMA interrupt, or from tm_send() while idle.
+static void tm_kick(void)
+{
+    uint32_t off = tm_tail % TM_RING_LEN;
+    uint32_t n = tm_head - tm_tail;
+
+    if (n > TM_RING_LEN - off) n = TM_RING_LEN - off;
+    tm_busy = n;
+    if (n == 0) return;
+
+    DMA1_Channel2->CCR &= ~DMA_CCR_EN;
+    DMA1_Channel2->CMAR = (uint32_t)&tm_ring[off];
+    DMA1_Channel2->CNDTR = n;
+    DMA1_Channel2->CCR |= DMA_CCR_EN;
+}
+
+
+// Called by DMA1_Channel2_3_IRQHandler when a transfer has completed.
+static void tm_dma_done(void)
+{
+    DMA1_Channel2->CCR &= ~DMA_CCR_EN;
+    tm_tail += tm_busy;
+    tm_kick();
+}
+
+
+// COBS-encodes len bytes into the ring at w, followed by the 0 delimiter.
+// Returns the position after it.
+static uint32_t tm_cobs(uint32_t w, const uint8_t *src, uint32_t len)
+{
+    uint32_t code_at = w++;
+    uint8_t code = 1;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (src[i] == 0) {
+            tm_ring[code_at % TM_RING_LEN] = code;
+            code_at = w++;
+            code = 1;
+            continue;
+        }
+        tm_ring[w++ % TM_RING_LEN] = src[i];
+        if (++code == 0xFF) {
+            tm_ring[code_at % TM_RING_LEN] = code;
+            code_at = w++;
+            code = 1;
+        }
+    }
+    tm_ring[code_at % TM_RING_LEN] = code;
+    tm_ring[w++ % TM_RING_LEN] = 0;
+    return w;
+}
+
+
+// Queues one frame. Returns 0 (and counts it) if the ring has no room.
+// Main loop only.
+int tm_send(uint8_t type, const void *body, uint32_t len)
+{
+    uint8_t raw[3 + TM_BODY_MAX + 2];
+    uint32_t n = 3 + len;
+    uint32_t used;
+    uint16_t crc;
+
+    raw[0] = type;
+    raw[1] = (uint8_t)tm_seq;
+    raw[2] = (uint8_t)(tm_seq >> 8);
+    tm_seq++;
+    memcpy(&raw[3], body, len);
+    crc = crc16(0xFFFF, raw, n);
+    raw[n++] = (uint8_t)crc;
+    raw[n++] = (uint8_t)(crc >> 8);
+
+    // Worst case: one code byte per 254 data bytes, plus the first and the 0.
+    used = tm_head - tm_tail;
+    if (used + n + n / 254 + 2 > TM_RING_LEN) {
+        tm_link.dropped++;
+        return 0;
+    }
+
+    tm_head = tm_cobs(tm_head, raw, n);
+    tm_link.frames++;
+    if (tm_head - tm_tail > tm_link.peak) tm_link.peak = tm_head - tm_tail;
+
+    // An active transfer picks the new head up when it completes.
+    if (tm_busy == 0) tm_kick();
+    return 1;
+}
+
+
+// tm_init sets up USART1 TX on PA9 and its DMA channel, and sends TM_BOOT.
+
+void tm_init(void)
+{
+    tm_boot_t boot = { SystemCoreClock, TM_BAUD };
+
+    RCC->AHBENR |= RCC_AHBENR_GPIOAEN | RCC_AHBENR_DMA1EN;
+    RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+
+    // PA9 alternate function 1 (USART1_TX).
+    GPIOA->MODER = (GPIOA->MODER & ~GPIO_MODER_MODER9) | GPIO_MODER_MODER9_1;
+    GPIOA->AFR[1] = (GPIOA->AFR[1] & ~GPIO_AFRH_AFRH1) | (1u << 4);
+
+    // 8N1, transmitter only, DMA requests on TXE. PCLK = SystemCoreClock.
+    USART1->CR1 = 0;
+    USART1->BRR = SystemCoreClock / TM_BAUD;
+    USART1->CR3 = USART_CR3_DMAT;
+    USART1->CR1 = USART_CR1_TE | USART_CR1_UE;
+
+    // DMA1 Channel 2 (USART1_TX without remap): memory -> TDR, bytes,
+    // lowest priority, so it never holds the capture or ADC transfers up.
+    DMA1_Channel2->CCR = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_TCIE;
+    DMA1_Channel2->CPAR = (uint32_t)&USART1->TDR;
+
+    NVIC_SetPriority(DMA1_Channel2_3_IRQn, 2);
+    NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+
+    // A leading 0 ends whatever a receiver caught before the reset.
+    tm_ring[0] = 0;
+    tm_head = 1;
+    tm_send(TM_BOOT, &boot, sizeof(boot));
+}
+
+
+//---------- SysTick Time Base --------------------
+//
+// SysTick interrupts once per millisecond and counts sys_ms. micros() adds the
+// sub-millisecond part from the SysTick down-counter, so both clocks come from
+// the same hardware counter and never drift against each other.
+
+volatile uint32_t sys_ms = 0;   // Milliseconds since SysTick_Init()
+
+
+// SysTick_Init starts the 1 ms tick. Must be called after the system clock is
+// set, since the reload value is derived from SystemCoreClock.
+
+void SysTick_Init(void)
+{
+    SysTick_Config(SystemCoreClock / 1000);
+
+    // Lowest priority: the tick only counts time, it must never delay capture.
+    NVIC_SetPriority(SysTick_IRQn, 3);
+}
+
+
+void SysTick_Handler()
+{
+    evt_log(EVT_ISR_ENTER, (uint16_t)SysTick_IRQn, 0);
+    sys_ms++;
+    btn_tick();
+    evt_log(EVT_ISR_EXIT, (uint16_t)SysTick_IRQn, 0);
+}
+
+
+// Returns microseconds since SysTick_Init() (wraps after ~71 minutes).
+uint32_t micros(void)
+{
+    uint32_t ms, val;
+
+    // Re-read if the millisecond tick happened in between, so the pair is consistent.
+    do {
+        ms = sys_ms;
+        val = SysTick->VAL;
+    } while (ms != sys_ms);
+
+    return ms * 1000u + (SysTick->LOAD - val) / (SystemCoreClock / 1000000u);
+}
+
+
+// delay_ms function is used to create a delay
+// equal to the specified number of milliseconds.
+// The core sleeps between ticks instead of spinning.
+
+void delay_ms(uint32_t ms) {
+
+    uint32_t start = sys_ms;
+    while ((uint32_t)(sys_ms - start) < ms) {
+        __WFI();   // Wake up on the next SysTick (or any other interrupt)
+    }
+}
+
+//---------- Integer Formatting --------------------
+//
+// Replaces snprintf in the render path. The M0 has no divide instruction, so
+// every "%u" costs a library division per digit on top of newlib's varargs
+// and format parsing. Here each digit is found by subtracting its power of
+// ten (at most 9 times), and the characters go straight to the caller's
+// buffer or the glyph stream with no terminator and no varargs.
+
+// Longest uint32_t in decimal.
+#define FMT_U32_DIGITS 10
+
+static const uint32_t fmt_pow10[FMT_U32_DIGITS] = {
+    1000000000u, 100000000u, 10000000u, 1000000u, 100000u,
+    10000u, 1000u, 100u, 10u, 1u
+};
+
+
+// Writes the decimal digits of v, at least `min_digits` of them (zeros in
+// front). Returns the number of digits.
+static uint8_t fmt_digits(char *dst, uint32_t v, uint8_t min_digits)
+{
+    uint8_t n = 0;
+
+    for (uint8_t i = 0; i < FMT_U32_DIGITS; i++)
+    {
+        uint32_t p = fmt_pow10[i];
+        char d = '0';
+
+        while (v >= p) {
+            v -= p;
+            d++;
+        }
+
+        // Leading zeros are skipped until a digit or the minimum width is reached.
+        if (n != 0 || d != '0' || FMT_U32_DIGITS - i <= min_digits) {
+            dst[n++] = d;
+        }
+    }
+    return n;
+}
+
+
+// Number of decimal digits of v (1 for 0).
+static uint8_t fmt_len(uint32_t v)
+{
+    uint8_t n = 1;
+
+    while (n < FMT_U32_DIGITS && v >= fmt_pow10[FMT_U32_DIGITS - 1 - n]) n++;
+    return n;
+}
+
+
+uint8_t fmt_u32(char *dst, uint32_t v, uint8_t width)
+{
+    uint8_t len = fmt_len(v);
+    uint8_t pad = (width > len) ? width - len : 0;
+
+    memset(dst, ' ', pad);
+    return pad + fmt_digits(dst + pad, v, 1);
+}
+
+
+uint8_t fmt_fixed(char *dst, uint32_t v, uint8_t frac, uint8_t width)
+{
+    uint8_t len, pad, n;
+
+    if (frac == 0) return fmt_u32(dst, v, width);
+    if (frac > FMT_U32_DIGITS - 1) frac = FMT_U32_DIGITS - 1;
+
+    // At least one integer digit in front of the point.
+    len = fmt_len(v);
+    if (len <= frac) len = frac + 1;
+    pad = (width > len + 1) ? width - len - 1 : 0;
+
+    memset(dst, ' ', pad);
+    n = fmt_digits(dst + pad, v, frac + 1);
+
+    // Open a gap for the point in front of the last `frac` digits.
+    memmove(dst + pad + n - frac + 1, dst + pad + n - frac, frac);
+    dst[pad + n - frac] = '.';
+    return pad + n + 1;
+}
+
+
+// Draws the input not selected ("   %5u Hz FG") on a page, or the progress
+// of a calibration sweep ("CAL %2u/17").
+static void oled_draw_other(uint8_t page)
+{
+   uint8_t col;
+
+   if (cal_point != 0) {
+      col = oled_fb_puts(page, 0, "CAL ");
+      col = oled_fb_putu(page, col, cal_point, 2);
+      col = oled_fb_puts(page, col, "/");
+      oled_fb_putu(page, col, CAL_POINTS, 2);
+   } else {
+      col = oled_fb_putu(page, 3 * FONT_CELL, freq_in[freq_sel ^ 1].mHz / FREQ_SCALE, 5);
+      col = oled_fb_puts(page, col, " Hz ");
+      oled_fb_puts(page, col, freq_name[freq_sel ^ 1]);
+   }
+}
+
+
+// Updates the OLED display with the latest measured values
+// for resistance and frequency.
+
+void refresh_OLED(void)
+{
+   uint8_t col;
+
+   // The next layout, kept across resets. The flash write is left to this
+   // task rather than the button's SysTick; a layout the flash cannot take
+   // is still shown until then.
+   if (oled_view_next) {
+      uint32_t v = (cfg[CFG_VIEW] == OLED_VIEW_LARGE) ? OLED_VIEW_TEXT : cfg[CFG_VIEW] + 1u;
+
+      oled_view_next = 0;
+      if (!cfg_set(CFG_VIEW, v)) cfg[CFG_VIEW] = v;
+   }
+
+   // Blanked in low-power mode; the panel keeps the last frame in its RAM.
+   if (pwr_low) return;
+
+   // Start from a blank back buffer; the transport may still be sending
+   // the previous update out of the front buffer while we draw here.
+   oled_fb_clear();
+
+   // The large layout replaces all of the text one.
+   if (cfg[CFG_VIEW] == OLED_VIEW_LARGE) {
+      oled_draw_large();
+      oled_fb_present();
+      return;
+   }
+
+   // Print the project title on page 0 (first row of text display).
+   oled_fb_puts(0, 0, "ECE 355 PROJECT");
+
+   // The input not selected on page 1, under the title
+   oled_draw_other(1);
+
+   // Print the resistance value on page 2 ("R: %5u Ohms")
+   col = oled_fb_puts(2, 0, "R: ");
+   col = oled_fb_putu(2, col, (uint32_t)Res, 5);
+   oled_fb_puts(2, col, " Ohms");
+
+   // Print the selected input's Frequency on page 3 ("F: %5u Hz 555"),
+   // and its duty cycle if measured ("60%"). The unit, name and duty are
+   // proportional so that all of it fits in the row.
+   col = oled_fb_puts(3, 0, "F: ");
+   col = oled_fb_putu(3, col, (uint32_t)Freq, 5);
+   col = oled_fb_puts_prop(3, col, " Hz ");
+   col = oled_fb_puts_prop(3, col, freq_name[freq_sel]);
+   if (freq_in[freq_sel].duty_ppm != 0) {
+      char duty[FMT_U32_DIGITS + 2];   // " ", "%"
+      uint8_t n;
+
+      duty[0] = ' ';
+      n = 1 + fmt_u32(duty + 1, (freq_in[freq_sel].duty_ppm + 5000u) / 10000u, 0);
+      duty[n++] = '%';
+      oled_fb_putn(3, col, duty, n, 1);
+   }
+
+   // Stability of both readings over the last window on pages 4-7
+   oled_draw_stats();
+
+   // Send whatever changed since the last frame. If the last update is still
+   // in flight this one is skipped and the next refresh picks up the change.
+   oled_fb_present();
+}
+
+
+//---------- Asynchronous OLED Transport --------------------
+//
+// Everything sent to the panel goes through a queue of tagged segments. A
+// segment is a run of command bytes (D/C# = 0) or display data (D/C# = 1).
+// The queue is drained entirely from interrupts:
+//
+//   - short segments are fed byte by byte from the SPI1 TXE interrupt,
+//   - long segments are handed to DMA1 Channel 3 (SPI1_TX),
+//   - D/C# may only change, and CS# only rise, once the shifter has drained.
+//     DMA TC and TXE come while the last bytes are still in the TX FIFO, so
+//     the queue then stops and TIM17 looks at the SPI once per byte time
+//     until it is idle, instead of an ISR spinning on it.
+//
+// Payloads of up to 4 bytes are copied into the queue slot, so callers can
+// pass temporaries; longer payloads are sent in place and must stay valid
+// until the segment's completion callback has run. A zero-length segment
+// sends nothing and only fires its callback, which makes it a cheap fence.
+
+#define OLED_SEG_CMD     0   // D/C# = 0
+#define OLED_SEG_DATA    1   // D/C# = 1
+
+// Queue depth in segments (power of two).
+#define OLED_Q_LEN       32
+
+// Segments at least this long go by DMA, shorter ones by the TXE interrupt.
+#define OLED_DMA_MIN_LEN 8
+
+// One byte on the wire in PCLK cycles at the CFG_SPI_BR prescaler
+// (2^(BR + 1)), the TIM17 poll period while waiting for the SPI to drain.
+#define OLED_SPI_BYTE_TICKS (8u << (cfg[CFG_SPI_BR] + 1u))
+
+// Completion callback, called from interrupt context once a segment is out.
+typedef void (*oled_q_cb_t)(void);
+
+typedef struct {
+    uint8_t  tag;          // OLED_SEG_CMD or OLED_SEG_DATA
+    uint8_t  is_inline;    // 1 if the payload lives in u.bytes
+    uint16_t len;          // Payload length in bytes
+    union {
+        const uint8_t *ptr;
+        uint8_t bytes[4];
+    } u;
+    oled_q_cb_t done;
+} oled_seg_t;
+
+static oled_seg_t oled_q[OLED_Q_LEN];
+static volatile uint32_t oled_q_head = 0;     // Next free slot (main loop)
+static volatile uint32_t oled_q_tail = 0;     // Segment being sent (interrupts)
+static volatile uint8_t oled_q_active = 0;    // 1 while the ISRs own the transport
+static uint8_t oled_q_dc = 0xFF;              // Current D/C# level (0xFF = unknown)
+static uint8_t oled_q_cs_low = 0;             // 1 while CS# is held low
+
+static const uint8_t *oled_q_src;             // TXE path: next byte to send
+static uint16_t oled_q_left;                  // TXE path: bytes still to send
+
+// Back-pressure counters.
+uint32_t oled_q_rejected = 0;   // Pushes refused because the queue was full
+uint32_t oled_q_peak = 0;       // Highest queue occupancy seen
+
+
+// 1 once the SPI has shifted out everything it was given.
+static inline int oled_spi_idle(void)
+{
+    return (SPI1->SR & (SPI_SR_FTLVL | SPI_SR_BSY)) == 0;
+}
+
+
+// Parks the queue until the SPI has drained: TIM17_IRQHandler calls
+// oled_q_start_next() again once it sees the SPI idle.
+static void oled_q_wait_idle(void)
+{
+    TIM17->CNT = 0;
+    TIM17->CR1 |= TIM_CR1_CEN;
+}
+
+
+// Starts one DMA burst from buf on DMA1 Channel 3 into SPI1->DR.
+static void oled_dma_start(const uint8_t *buf, uint16_t len)
+{
+    DMA1_Channel3->CCR &= ~DMA_CCR_EN;
+    DMA1_Channel3->CMAR = (uint32_t)buf;
+    DMA1_Channel3->CNDTR = len;
+    DMA1_Channel3->CCR |= DMA_CCR_EN;
+}
+
+
+// Drops the finished segment at the tail and runs its callback.
+static void oled_q_retire(void)
+{
+    oled_q_cb_t done = oled_q[oled_q_tail % OLED_Q_LEN].done;
+
+    oled_q_tail++;
+    if (done) done();
+}
+
+
+// Starts the segment at the tail, or releases the panel if none is left.
+// Runs in the ISRs, or from oled_q_push() while the transport is idle.
+static void oled_q_start_next(void)
+{
+    while (oled_q_tail != oled_q_head)
+    {
+        oled_seg_t *seg = &oled_q[oled_q_tail % OLED_Q_LEN];
+        const uint8_t *src;
+
+        // Fence: nothing to send, just signal it.
+        if (seg->len == 0) {
+            oled_q_retire();
+            continue;
+        }
+
+        // Switch D/C# (and open CS#) only when the SPI has gone quiet.
+        if (seg->tag != oled_q_dc || !oled_q_cs_low)
+        {
+            if (!oled_spi_idle()) {
+                oled_q_wait_idle();
+                return;
+            }
+            if (seg->tag == OLED_SEG_DATA) GPIOB->BSRR = GPIO_PIN_7;  // D/C# = 1
+            else                           GPIOB->BRR = GPIO_PIN_7;   // D/C# = 0
+            oled_q_dc = seg->tag;
+
+            if (!oled_q_cs_low) {
+                GPIOB->BRR = GPIO_PIN_6;   // CS# low until the queue is empty
+                oled_q_cs_low = 1;
+            }
+        }
+
+        src = seg->is_inline ? seg->u.bytes : seg->u.ptr;
+        if (seg->len >= OLED_DMA_MIN_LEN) {
+            oled_dma_start(src, seg->len);
+        } else {
+            oled_q_src = src;
+            oled_q_left = seg->len;
+            SPI1->CR2 |= SPI_CR2_TXEIE;
+        }
+        return;
+    }
+
+    // Queue drained: let the last bytes out and release the panel.
+    if (!oled_spi_idle()) {
+        oled_q_wait_idle();
+        return;
+    }
+    GPIOB->BSRR = GPIO_PIN_6;  // CS# high
+    oled_q_cs_low = 0;
+    oled_q_active = 0;
+}
+
+
+// Number of free segment slots, for callers that need to plan ahead.
+uint8_t oled_q_free(void)
+{
+    return (uint8_t)(OLED_Q_LEN - (oled_q_head - oled_q_tail));
+}
+
+
+// oled_q_push appends one segment and starts the transport if it is idle.
+// Returns 0 (and counts a rejection) if the queue is full. Main loop only.
+
+int oled_q_push(uint8_t tag, const uint8_t *buf, uint16_t len, oled_q_cb_t done)
+{
+    uint32_t used = oled_q_head - oled_q_tail;
+    oled_seg_t *seg;
+
+    if (used >= OLED_Q_LEN) {
+        oled_q_rejected++;
+        return 0;
+    }
+    if (used + 1 > oled_q_peak) oled_q_peak = used + 1;
+
+    seg = &oled_q[oled_q_head % OLED_Q_LEN];
+    seg->tag = tag;
+    seg->len = len;
+    seg->done = done;
+    seg->is_inline = (len <= sizeof(seg->u.bytes));
+    if (!seg->is_inline) seg->u.ptr = buf;
+    else if (len != 0)   memcpy(seg->u.bytes, buf, len);     // A fence may have no buffer
+
+    oled_q_head++;
+
+    // The ISRs pick up the new segment by themselves while they are active.
+    if (!oled_q_active) {
+        oled_q_active = 1;
+        oled_q_start_next();
+    }
+    return 1;
+}
+
+
+// Sends a command byte to the OLED display (queued, returns 0 if the queue is full)
+
+int oled_Write_Cmd(unsigned char cmd)
+{
+    return oled_q_push(OLED_SEG_CMD, &cmd, 1, 0);
+}
+
+
+// Sends a data byte to the OLED display (queued, returns 0 if the queue is full)
+
+int oled_Write_Data(unsigned char data)
+{
+    return oled_q_push(OLED_SEG_DATA, &data, 1, 0);
+}
+
+
+// oled_q_init enables the SPI1 TXE interrupt, DMA1 Channel 3 (SPI1 TX) and
+// the TIM17 drain poll used by the transport.
+
+void oled_q_init(void)
+{
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+
+    // Memory -> peripheral, byte sized, memory increment, transfer complete interrupt.
+    DMA1_Channel3->CCR = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_TCIE | DMA_CCR_TEIE;
+    DMA1_Channel3->CPAR = (uint32_t)&SPI1->DR;
+
+    // Keep the SPI in transmit direction and let it request data from the DMA.
+    SPI1->CR1 |= SPI_CR1_BIDIOE;
+    SPI1->CR2 |= SPI_CR2_TXDMAEN;
+
+    // TIM17 counts PCLK and updates once per SPI byte; it only runs while the
+    // queue waits for the SPI to drain.
+    RCC->APB2ENR |= RCC_APB2ENR_TIM17EN;
+    TIM17->PSC = 0;
+    TIM17->ARR = OLED_SPI_BYTE_TICKS - 1;
+    TIM17->DIER = TIM_DIER_UIE;
+
+    NVIC_SetPriority(DMA1_Channel2_3_IRQn, 2);
+    NVIC_EnableIRQ(DMA1_Channel2_3_IRQn);
+    NVIC_SetPriority(SPI1_IRQn, 2);
+    NVIC_EnableIRQ(SPI1_IRQn);
+    NVIC_SetPriority(TIM17_IRQn, 2);
+    NVIC_EnableIRQ(TIM17_IRQn);
+}
+
+
+// SPI1_IRQHandler feeds short segments into the TX FIFO one byte per TXE.
+
+void SPI1_IRQHandler()
+{
+    evt_log(EVT_ISR_ENTER, SPI1_IRQn, 0);
+
+    if ((SPI1->CR2 & SPI_CR2_TXEIE) && (SPI1->SR & SPI_SR_TXE))
+    {
+        if (oled_q_left != 0)
+        {
+            // 8-bit access, otherwise the F0 SPI packs two bytes per write.
+            *(volatile uint8_t *)&SPI1->DR = *oled_q_src++;
+            oled_q_left--;
+        }
+        else
+        {
+            // Whole segment is in the FIFO: move on.
+            SPI1->CR2 &= ~SPI_CR2_TXEIE;
+            oled_q_retire();
+            oled_q_start_next();
+        }
+    }
+
+    evt_log(EVT_ISR_EXIT, SPI1_IRQn, 0);
+}
+
+
+// DMA1_Channel2_3_IRQHandler moves on to the next segment once a DMA segment
+// has been handed to the SPI (channel 3), and on to the next run of the
+// telemetry ring once the USART has taken the last one (channel 2).
+
+void DMA1_Channel2_3_IRQHandler()
+{
+    evt_log(EVT_ISR_ENTER, DMA1_Channel2_3_IRQn, 0);
+
+    if (DMA1->ISR & (DMA_ISR_TCIF2 | DMA_ISR_TEIF2))
+    {
+        DMA1->IFCR = DMA_IFCR_CGIF2;
+        tm_dma_done();
+    }
+
+    if (DMA1->ISR & (DMA_ISR_TCIF3 | DMA_ISR_TEIF3))
+    {
+        // Clear all channel 3 flags
+        DMA1->IFCR = DMA_IFCR_CGIF3;
+        DMA1_Channel3->CCR &= ~DMA_CCR_EN;
+
+        oled_q_retire();
+        oled_q_start_next();
+    }
+
+    evt_log(EVT_ISR_EXIT, DMA1_Channel2_3_IRQn, 0);
+}
+
+
+// TIM17_IRQHandler resumes the queue once the SPI has drained, so that D/C#
+// or CS# can change. It runs once per byte time, at most a FIFO's worth.
+
+void TIM17_IRQHandler()
+{
+    evt_log(EVT_ISR_ENTER, TIM17_IRQn, 0);
+
+    TIM17->SR = 0;
+    if (oled_spi_idle())
+    {
+        TIM17->CR1 &= ~TIM_CR1_CEN;
+        oled_q_start_next();
+    }
+
+    evt_log(EVT_ISR_EXIT, TIM17_IRQn, 0);
+}
+
+
+//---------- OLED Framebuffer --------------------
+//
+// Frames are drawn into the back buffer in RAM. The front buffer is a copy of
+// what the panel is currently showing. oled_fb_present() compares the two,
+// copies only the changed column runs into the front buffer and queues each
+// run on the transport as its own address + data pair:
+//
+//   CMD  0xB0|page, 0x0X, 0x1X   (inline)
+//   DATA changed column bytes    (sent in place from the front buffer)
+//
+// A fence at the end clears oled_fb_busy once the last run is out, so the
+// front buffer is never touched while DMA may still be reading it. When the
+// reading is steady nothing differs and nothing is sent at all.
+
+// Two runs closer than this are merged, since a new run costs 3 address bytes.
+#define OLED_RUN_MERGE_GAP 3
+
+static uint8_t oled_back[OLED_PAGES][OLED_COLS];   // Being drawn by refresh_OLED
+static uint8_t oled_front[OLED_PAGES][OLED_COLS];  // Mirror of the panel, sent by the queue
+
+static volatile uint8_t oled_fb_busy = 0;   // 1 while an update is in flight
+
+// Traffic counters (display data bytes only; address bytes counted separately).
+uint32_t oled_bytes_sent = 0;      // Column bytes actually sent to the panel
+uint32_t oled_bytes_skipped = 0;   // Column bytes that were unchanged and not sent
+uint32_t oled_cmd_bytes_sent = 0;  // Address command bytes spent on the runs
+
+
+void oled_fb_clear(void)
+{
+    memset(oled_back, 0x00, sizeof(oled_back));
+}
+
+
+// Columns a blank glyph (SPACE) advances in proportional spacing.
+#define FONT_PROP_SPACE 3
+
+// Draws `len` characters; anything past the right edge is clipped. Fixed
+// spacing gives every character an 8-column cell (glyph + 3 blank columns);
+// proportional spacing takes only the inked columns plus one blank column.
+static uint8_t oled_fb_putn(uint8_t page, uint8_t col, const char *str, uint8_t len, uint8_t prop)
+{
+    if (page >= OLED_PAGES) return col;
+
+    uint8_t *row = oled_back[page];
+
+    for (; len != 0; str++, len--)
+    {
+        uint8_t c = (unsigned char)*str & 0x7F;
+        const uint8_t *glyph;
+        uint8_t g, first = 0, width = FONT_COLS, cell = FONT_CELL;
+
+        // Control characters have no glyph and draw as SPACE, like the
+        // characters the font was generated without.
+        if (c < FONT_FIRST) c = ' ';
+        g = font5x7_map[c - FONT_FIRST];
+        glyph = font5x7[g];
+
+        if (prop) {
+            first = font5x7_span[g] >> 4;
+            width = font5x7_span[g] & 0x0F;
+            cell = width ? width + 1 : FONT_PROP_SPACE;
+        }
+        // A fixed cell must fit whole; a proportional glyph may lose its gap.
+        if (col + (prop ? width : cell) > OLED_COLS) break;
+        if (col + cell > OLED_COLS) cell = OLED_COLS - col;
+
+        // Expand the glyph columns into the page row and blank the rest of the cell.
+        memcpy(&row[col], &glyph[first], width);
+        memset(&row[col + width], 0x00, cell - width);
+        col += cell;
+    }
+    return col;
+}
+
+
+uint8_t oled_fb_puts(uint8_t page, uint8_t col, const char *str)
+{
+    return oled_fb_putn(page, col, str, (uint8_t)strnlen(str, OLED_COLS / FONT_CELL), 0);
+}
+
+
+uint8_t oled_fb_puts_prop(uint8_t page, uint8_t col, const char *str)
+{
+    return oled_fb_putn(page, col, str, (uint8_t)strnlen(str, OLED_COLS), 1);
+}
+
+
+uint8_t oled_fb_putu(uint8_t page, uint8_t col, uint32_t v, uint8_t width)
+{
+    char digits[FMT_U32_DIGITS];
+
+    if (width > FMT_U32_DIGITS) width = FMT_U32_DIGITS;   // A page row is 16 characters anyway
+    return oled_fb_putn(page, col, digits, fmt_u32(digits, v, width), 0);
+}
+
+
+uint8_t oled_fb_putfixed(uint8_t page, uint8_t col, uint32_t v, uint8_t frac, uint8_t width)
+{
+    char digits[FMT_U32_DIGITS + 1];
+
+    if (width > FMT_U32_DIGITS + 1) width = FMT_U32_DIGITS + 1;
+    return oled_fb_putn(page, col, digits, fmt_fixed(digits, v, frac, width), 0);
+}
+
+
+// Fence callback: the last run of the update has been handed to the SPI.
+static void oled_fb_sent(void)
+{
+    oled_fb_busy = 0;
+}
+
+
+// Scans one page for columns that differ between the back and front buffers
+// and queues the merged runs. Returns the number of data bytes queued, or -1
+// once the queue has no room for another run (one slot is kept for the fence).
+static int oled_queue_runs(uint8_t page)
+{
+    const uint8_t *back = oled_back[page];
+    uint8_t *front = oled_front[page];
+    uint8_t col = 0;
+    int sent = 0;
+
+    while (col < OLED_COLS)
+    {
+        // Skip over unchanged columns.
+        if (back[col] == front[col]) { col++; continue; }
+
+        uint8_t start = col;
+        uint8_t end = col + 1;   // One past the last changed column
+        uint8_t gap = 0;
+        uint8_t cmd[3];
+
+        // Extend the run, swallowing short unchanged gaps.
+        for (col = end; col < OLED_COLS && gap < OLED_RUN_MERGE_GAP; col++) {
+            if (back[col] != front[col]) { end = col + 1; gap = 0; }
+            else gap++;
+        }
+        col = end;
+
+        if (oled_q_free() < 3) return -1;
+
+        // Only now take the new bytes into the mirror, so anything that did
+        // not fit in the queue is still seen as dirty next time.
+        memcpy(&front[start], &back[start], end - start);
+
+        cmd[0] = 0xB0 | page;                                // Page address
+        cmd[1] = 0x00 | ((start + OLED_COL_OFFSET) & 0x0F);  // Lower column address
+        cmd[2] = 0x10 | ((start + OLED_COL_OFFSET) >> 4);    // Higher column address
+        oled_q_push(OLED_SEG_CMD, cmd, sizeof(cmd), 0);
+        oled_q_push(OLED_SEG_DATA, &front[start], end - start, 0);
+
+        oled_cmd_bytes_sent += sizeof(cmd);
+        sent += end - start;
+    }
+    return sent;
+}
+
+
+int oled_fb_present(void)
+{
+    uint32_t sent = 0;
+    int n = 0;
+
+    if (oled_fb_busy) return 0;
+
+    // Set before queuing: the runs may be finished before we get to the fence.
+    oled_fb_busy = 1;
+
+    for (uint8_t page = 0; page < OLED_PAGES; page++) {
+        n = oled_queue_runs(page);
+        if (n < 0) break;
+        sent += n;
+    }
+
+    oled_bytes_sent += sent;
+    oled_bytes_skipped += sizeof(oled_front) - sent;
+
+    if (sent == 0) {
+        // Nothing changed (or no room yet): nothing is in flight.
+        oled_fb_busy = 0;
+    } else {
+        // oled_queue_runs() always leaves a slot for this fence.
+        oled_q_push(OLED_SEG_DATA, 0, 0, oled_fb_sent);
+    }
+    return 1;
+}
+
+
+// oled_config configures the necessary GPIO pins, enables SPI communication, and sends
+// initialization commands to set up the OLED display.
+
+void oled_config()
+{
+    GPIO_InitTypeDef GPIO_InitStruct;
+
+    // Enable clocks for GPIOB Port B (data/control lines) and SPI1 (send interface) peripherals.
+    RCC->AHBENR |= RCC_AHBENR_GPIOBEN;
+    RCC->APB2ENR |= RCC_APB2ENR_SPI1EN;
+
+    // Configure PB3 and PB5 for SPI communication.
+    // PB3 and PB5 are configured as alternate function pins to be used for SPI1.
+    GPIO_InitStruct.Pin = GPIO_PIN_3 | GPIO_PIN_5;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;            // Set to alternate function push-pull
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;    // Set speed to medium
+    GPIO_InitStruct.Pull = GPIO_NOPULL;                // No pull-up or pull-down
+    GPIO_InitStruct.Alternate = GPIO_AF0_SPI1;         // Set alternate function for SPI1
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    // Configure PB4, PB6, and PB7 as general output pins for control signals.
+    // PB4, PB6, and PB7 are used to control signals to the OLED and  shift register
+    GPIO_InitStruct.Pin = GPIO_PIN_4 | GPIO_PIN_6 | GPIO_PIN_7;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;        // Set to output push-pull to drive OLED
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;    // Set speed to medium
+    GPIO_InitStruct.Pull = GPIO_NOPULL;                // No pull-up or pull-down
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    // Configure SPI settings.
+    // Assign SPI1 to the SPI handle and set up various SPI parameters.
+    SPI_Handle.Instance = SPI1; // For comms
+    SPI_Handle.Init.Direction = SPI_DIRECTION_1LINE;      // 1-line communication
+    SPI_Handle.Init.Mode = SPI_MODE_MASTER;               // Set as SPI master
+    SPI_Handle.Init.DataSize = SPI_DATASIZE_8BIT;         // 8-bit data size
+    SPI_Handle.Init.CLKPolarity = SPI_POLARITY_LOW;       // Clock polarity low when idle
+    SPI_Handle.Init.CLKPhase = SPI_PHASE_1EDGE;           // Data sampled on first clock edge
+    SPI_Handle.Init.NSS = SPI_NSS_SOFT;                   // Chip Select management
+    SPI_Handle.Init.BaudRatePrescaler = cfg[CFG_SPI_BR] << SPI_CR1_BR_Pos; // Set clock prescaler (/256 by default)
+    SPI_Handle.Init.FirstBit = SPI_FIRSTBIT_MSB;          // Transmit MSB first
+    SPI_Handle.Init.CRCPolynomial = 7;                    // CRC polynomial (unused here)
+
+    // Initialize the SPI interface with the specified settings.
+    HAL_SPI_Init(&SPI_Handle);
+
+    // Enable the SPI peripheral.
+    __HAL_SPI_ENABLE(&SPI_Handle); //Data starts
+
+    // Perform a hardware reset on the OLED display using PB4 for a consistent state
+    // Set PB4 LOW, wait, then set PB4 HIGH, waiting again after each change.
+    GPIOB->BRR = GPIO_PIN_4;               // Set PB4 to 0 (reset the OLED)
+    delay_ms(100);                         // Short delay
+    GPIOB->BSRR = GPIO_PIN_4;              // Set PB4 to 1 (end reset)
+    delay_ms(100);                         // Short delay
+
+    // From here on the panel is written through the asynchronous transport.
+    oled_q_init();
+
+    // Queue the initialization commands to configure the OLED display,
+    // then the contrast from the settings.
+    oled_q_push(OLED_SEG_CMD, oled_init_cmds, sizeof(oled_init_cmds), 0);
+    oled_Write_Cmd(0x81);
+    oled_Write_Cmd((unsigned char)cfg[CFG_CONTRAST]);
+
+    // Clear display by filling its data memory with zeros.
+    // This loop queues 0s for all visible segments in each of the 8 pages of
+    // the display. 8 pages of 4 segments do not fit in the queue next to the
+    // init commands, so each page waits for room while the ISRs drain it.
+    for (uint8_t page = 0; page < 8; page++) {
+        while (oled_q_free() < 4) __WFI();
+        oled_Write_Cmd(0xB0 | page);    // Set page address (e.g., 0xB0 for page 0)
+        oled_Write_Cmd(0x00 | (OLED_COL_OFFSET & 0x0F));  // Lower column address
+        oled_Write_Cmd(0x10 | (OLED_COL_OFFSET >> 4));    // Higher column address
+
+        // Write 128 zeros across the current page to clear the display.
+        oled_q_push(OLED_SEG_DATA, oled_zero_page, sizeof(oled_zero_page), 0);
+    }
+}
+
+
+//---------- Large Digits and Bar Graphs --------------------
+//
+// For reading the display from across the bench. The digits are font5x7's,
+// scaled 2x (10 x 14 pixels over 2 pages) or 3x (15 x 21 over 3 pages), and
+// stored in flash already scaled and split into pages (font_x2 and font_x3,
+// from fontgen.py --big 2,3): drawing one is a memcpy per page, like a small
+// character, with no per-pixel work. Only the digits are stored (200 + 450
+// bytes). hostsim --font checks the tables against font5x7.
+//
+// A bar graph takes one page: an outline 6 pixels high between end caps,
+// filled from the left.
+
+#define OLED_BAR_END    0x7E    // End cap column
+#define OLED_BAR_FULL   0x7E    // Filled column
+#define OLED_BAR_EMPTY  0x42    // Outline only
+#define OLED_BAR_INNER  (OLED_COLS - 2)
+
+
+uint8_t oled_fb_putbig(uint8_t page, uint8_t col, const char *str, uint8_t len, uint8_t scale)
+{
+    uint8_t width = FONT_COLS * scale;
+
+    if ((scale != 2 && scale != 3) || page + scale > OLED_PAGES) return col;
+
+    // A scaled cell keeps font5x7's proportions: the glyph and one scaled
+    // blank column. The last digit may lose its gap at the right edge.
+    for (; len != 0 && col + width <= OLED_COLS; str++, len--)
+    {
+        uint8_t d = (uint8_t)(*str - '0');
+        uint8_t cell = (col + width + scale > OLED_COLS) ? OLED_COLS - col : width + scale;
+
+        for (uint8_t p = 0; p < scale; p++)
+        {
+            uint8_t *dst = &oled_back[page + p][col];
+
+            if (d > 9) memset(dst, 0x00, width);
+            else if (scale == 2) memcpy(dst, font_x2[d][p], width);
+            else memcpy(dst, font_x3[d][p], width);
+            memset(dst + width, 0x00, cell - width);
+        }
+        col += cell;
+    }
+    return col;
+}
+
+
+void oled_fb_bar(uint8_t page, uint32_t v, uint32_t lo, uint32_t hi)
+{
+    uint8_t *row;
+    uint32_t fill = 0;
+
+    if (page >= OLED_PAGES) return;
+    row = oled_back[page];
+
+    if (v >= hi) fill = OLED_BAR_INNER;
+    else if (v > lo) fill = (v - lo) * OLED_BAR_INNER / (hi - lo);
+
+    row[0] = row[OLED_COLS - 1] = OLED_BAR_END;
+    memset(&row[1], OLED_BAR_FULL, fill);
+    memset(&row[1 + fill], OLED_BAR_EMPTY, OLED_BAR_INNER - fill);
+}
+
+
+// refresh_OLED's OLED_VIEW_LARGE layout:
+//
+//   pages 0-2  Freq in 3x digits, the input's name and "Hz" on the right
+//   page  3    Freq bar, CFG_BAR_HZ_LO to CFG_BAR_HZ_HI
+//   pages 4-5  Res in 2x digits, "Ohms" on the right
+//   page  6    Res bar, CFG_BAR_OHM_LO to CFG_BAR_OHM_HI
+//   page  7    the other input, as on page 1 of the text layout
+//
+// The values are 6 digits wide; a frequency of a MHz or more loses its
+// last digit at the edge.
+
+void oled_draw_large(void)
+{
+    char digits[FMT_U32_DIGITS];
+    uint8_t col;
+
+    col = oled_fb_putbig(0, 0, digits, fmt_u32(digits, (uint32_t)Freq, 6), 3);
+    oled_fb_puts_prop(0, col, freq_name[freq_sel]);
+    oled_fb_puts_prop(2, col, "Hz");
+    oled_fb_bar(3, (uint32_t)Freq, cfg[CFG_BAR_HZ_LO], cfg[CFG_BAR_HZ_HI]);
+
+    col = oled_fb_putbig(4, 0, digits, fmt_u32(digits, (uint32_t)Res, 6), 2);
+    oled_fb_puts_prop(5, col, "Ohms");
+    oled_fb_bar(6, (uint32_t)Res, cfg[CFG_BAR_OHM_LO], cfg[CFG_BAR_OHM_HI]);
+
+    oled_draw_other(7);
+}
+
+
+//---------- Snapshot Channel --------------------
+//
+// Hands a measurement record from one writer (an ISR) to any number of
+// readers without masking interrupts. The writer fills the slot that is not
+// published and then publishes it with one store of the sequence number. A
+// reader copies the published slot and keeps the copy if the sequence number
+// has not moved meanwhile; otherwise the writer ran in between and it copies
+// again. A reader that preempts the writer (a higher-priority ISR) never
+// retries: the writer is filling the other slot.
+
+// Status bits of a record.
+#define MEAS_OVERRUN  0x0001u   // Input data was lost just before this record
+
+typedef struct {
+    uint32_t value;
+    uint32_t ts;                // TIM2->CNT when it was produced
+    uint32_t count;             // Records produced since reset (this one included)
+    uint32_t status;            // MEAS_* bits
+} meas_t;
+
+typedef struct {
+    volatile uint32_t seq;      // Records published; slot[seq & 1] is the latest
+    volatile meas_t slot[2];
+} snap_chan_t;
+
+
+// Publishes *m. One writer per channel, and it must not preempt itself.
+void snap_publish(snap_chan_t *c, const meas_t *m)
+{
+    uint32_t next = c->seq + 1;
+
+    c->slot[next & 1] = *m;
+    __DMB();      // The record must land before the sequence number points at it
+    c->seq = next;
+}
+
+
+// Copies the latest record into *out and returns its sequence number
+// (0 = nothing published yet, *out is then all zero).
+uint32_t snap_read(const snap_chan_t *c, meas_t *out)
+{
+    uint32_t seq;
+
+    do {
+        seq = c->seq;
+        __DMB();
+        *out = c->slot[seq & 1];
+        __DMB();
+    } while (c->seq != seq);
+
+    return seq;
+}
+
+
+//---------- Rolling Statistics --------------------
+//
+// Streaming min/max, mean, standard deviation and peak-to-peak spread over
+// the last 2^log2 samples of a measurement, at O(1) cost per sample so it can
+// be fed per edge and per decimated ADC value.
+//
+// The mean and variance use Welford's sliding-window update, kept exact in
+// integers: with a power-of-two window N the state is the window sum S
+// (mean = S / N) and N * M2 (M2 = sum of squared deviations), and replacing
+// sample `old` by `x` changes N * M2 by
+//
+//   (x - old) * (N * (x + old) - (S_new + S_old))
+//
+// so nothing is divided and nothing drifts. Min and max come from two
+// monotonic queues of window positions (amortised O(1)). Until a window has
+// filled it is padded with the first sample.
+
+// Largest window (log2 of samples); each stats_t holds 3 arrays of this size.
+#define STATS_WIN_MAX_LOG2 6
+#define STATS_WIN_MAX      (1u << STATS_WIN_MAX_LOG2)
+
+// Window of the frequency and resistance statistics (log2 of samples).
+#define STATS_FREQ_LOG2    6
+#define STATS_RES_LOG2     6
+
+// A sample that would stretch the window's spread (max - min) this far
+// restarts it: that is a new signal, not jitter (2^24 TIM2 ticks = 350 ms).
+// It keeps N * M2 below 2^58 and every intermediate product inside 64 bits.
+#define STATS_SPREAD_MAX   (1u << 24)
+
+typedef struct {
+    uint32_t win[STATS_WIN_MAX];    // Samples, slot = sequence number % N
+    uint16_t qmin[STATS_WIN_MAX];   // Sequence numbers, values increasing
+    uint16_t qmax[STATS_WIN_MAX];   // Sequence numbers, values decreasing
+    uint8_t  qmin_h, qmin_n;        // Head and length of qmin
+    uint8_t  qmax_h, qmax_n;        // Head and length of qmax
+    uint8_t  log2;                  // Window is 1 << log2 samples
+    uint16_t seq;                   // Sequence number of the next sample
+    uint32_t count;                 // Samples since the last reset (saturates)
+    uint32_t restarts;              // Windows restarted by a step
+    uint64_t sum;                   // S: sum of the window
+    uint64_t nm2;                   // N * M2
+} stats_t;
+
+// Consistent summary of a window, taken by stats_read().
+typedef struct {
+    uint32_t count;         // Samples since the last reset (0 = no data)
+    uint32_t min, max;      // Over the window; max - min is the peak-to-peak spread
+    uint64_t sum;           // Mean = sum >> log2
+    uint64_t nm2;           // N * M2
+    uint8_t  log2;
+} stats_snap_t;
+
+stats_t stats_555  = { .log2 = STATS_FREQ_LOG2 };   // Periods of the 555 input (TIM2 ticks), per edge
+stats_t stats_fg   = { .log2 = STATS_FREQ_LOG2 };   // Periods of the FG input (TIM2 ticks), per edge
+stats_t stats_res  = { .log2 = STATS_RES_LOG2 };    // Oversampled ADC values, per decimated value
+
+
+// Empties the window and sets its length to 2^log2 (at most STATS_WIN_MAX).
+void stats_init(stats_t *s, uint8_t log2)
+{
+    memset(s, 0, sizeof(*s));
+    s->log2 = (log2 > STATS_WIN_MAX_LOG2) ? STATS_WIN_MAX_LOG2 : log2;
+}
+
+
+// Drops the samples but keeps the window length.
+static void stats_restart(stats_t *s)
+{
+    s->qmin_n = s->qmax_n = 0;
+    s->count = 0;
+}
+
+
+void stats_add(stats_t *s, uint32_t x)
+{
+    const uint32_t n = 1u << s->log2;
+    const uint32_t mask = n - 1;
+    uint16_t seq = s->seq;
+    uint32_t old;
+    uint64_t sum_old;
+
+    if (s->count != 0)
+    {
+        uint32_t lo = s->win[s->qmin[s->qmin_h] & mask];
+        uint32_t hi = s->win[s->qmax[s->qmax_h] & mask];
+
+        if (x < lo) lo = x;
+        if (x > hi) hi = x;
+        if (hi - lo >= STATS_SPREAD_MAX) {
+            s->restarts++;
+            stats_restart(s);
+        }
+    }
+
+    if (s->count == 0)
+    {
+        // First sample: pad the whole window with it.
+        for (uint32_t i = 0; i < n; i++) s->win[i] = x;
+        s->sum = (uint64_t)x << s->log2;
+        s->nm2 = 0;
+    }
+
+    // The sample leaving the window is the one whose slot we take over.
+    old = s->win[seq & mask];
+    sum_old = s->sum;
+    s->sum = sum_old - old + x;
+    s->nm2 += (uint64_t)((int64_t)x - old) *
+              (uint64_t)((((int64_t)x + old) << s->log2) - (int64_t)(s->sum + sum_old));
+
+    // Retire queue heads that fell out of the window.
+    if (s->qmin_n && (uint16_t)(seq - s->qmin[s->qmin_h]) >= n) { s->qmin_h = (s->qmin_h + 1) & mask; s->qmin_n--; }
+    if (s->qmax_n && (uint16_t)(seq - s->qmax[s->qmax_h]) >= n) { s->qmax_h = (s->qmax_h + 1) & mask; s->qmax_n--; }
+
+    // Samples that can no longer be the minimum (maximum) leave from the back.
+    while (s->qmin_n && s->win[s->qmin[(s->qmin_h + s->qmin_n - 1) & mask] & mask] >= x) s->qmin_n--;
+    while (s->qmax_n && s->win[s->qmax[(s->qmax_h + s->qmax_n - 1) & mask] & mask] <= x) s->qmax_n--;
+
+    s->win[seq & mask] = x;
+    s->qmin[(s->qmin_h + s->qmin_n++) & mask] = seq;
+    s->qmax[(s->qmax_h + s->qmax_n++) & mask] = seq;
+
+    s->seq = seq + 1;
+    if (s->count != 0xFFFFFFFFu) s->count++;
+}
+
+
+// Copies the summary of the window. Safe against a stats_add() from an
+// interrupt: only the copy itself runs with interrupts masked.
+void stats_read(const stats_t *s, stats_snap_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+    const uint32_t mask = (1u << s->log2) - 1;
+
+    __disable_irq();
+    out->count = s->count;
+    out->log2 = s->log2;
+    out->sum = s->sum;
+    out->nm2 = s->nm2;
+    out->min = s->win[s->qmin[s->qmin_h] & mask];
+    out->max = s->win[s->qmax[s->qmax_h] & mask];
+    __set_PRIMASK(primask);
+}
+
+
+// Integer square root (rounded down), bit by bit: no division on the M0.
+static uint32_t isqrt64(uint64_t v)
+{
+    uint64_t r = 0;
+    uint64_t bit = 1ull << 62;
+
+    while (bit > v) bit >>= 2;
+    while (bit != 0)
+    {
+        if (v >= r + bit) {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+
+// Standard deviation of the window in 1/16 units: sqrt(N * M2) / N.
+uint32_t stats_std_q4(const stats_snap_t *st)
+{
+    uint8_t f = 4;
+
+    // Take as many of the 4 fraction bits into the root as N * M2 has room for.
+    while (f != 0 && (st->nm2 >> (64 - 2 * f)) != 0) f--;
+    return (uint32_t)(((uint64_t)isqrt64(st->nm2 << (2 * f)) << (4 - f)) >> st->log2);
+}
+
+
+// ADC_Config configures and initializes the ADC (Analog-to-Digital Converter) to
+// sample analog input from the channel - PA5 at a fixed rate.
+
+// TIM3 triggers every conversion, DMA1 Channel 1 stores the results in a
+// circular buffer and the half/full transfer interrupts decimate each half
+// into one oversampled value. Sampling therefore keeps running at
+// ADC_SAMPLE_HZ no matter how long the main loop or the display takes.
+// This digital value is used to control the DAC and display the resistance on the OLED screen.
+
+// Conversion rate set by TIM3 (Hz).
+#define ADC_SAMPLE_HZ     16000u
+
+// Samples summed per output value. 16x gives 2 extra bits: 12-bit -> 14-bit.
+#define ADC_OVERSAMPLE    16u
+#define ADC_OVERSAMPLE_SHIFT 2u
+#define ADC_FILTERED_MAX  (0xFFFu << ADC_OVERSAMPLE_SHIFT)
+
+// Two halves of ADC_OVERSAMPLE samples each: one is decimated while DMA fills the other.
+static volatile uint16_t adc_buf[2 * ADC_OVERSAMPLE];
+
+// Latest oversampled reading (value 0..ADC_FILTERED_MAX, count = values
+// produced, MEAS_OVERRUN when a half was refilled before it was decimated).
+snap_chan_t adc_snap;
+
+// Values produced; written by the DMA interrupt only.
+volatile uint32_t adc_filtered_count = 0;
+
+// Interrupts that found both halves complete: the handler ran more than a
+// half late and the first half was already being refilled.
+volatile uint32_t adc_overruns = 0;
+
+// The last values for the telemetry stream, slot = count % ADC_HIST_LEN
+// (bit 15 set when it came from an overrun half). adc_send_batch() runs
+// every 10 ms, 10 values apart, so the decimator stays well clear of the
+// slots it copies.
+#define ADC_HIST_LEN 32u
+static volatile uint16_t adc_hist[ADC_HIST_LEN];
+static uint32_t adc_sent = 0;   // Count of the last value sent
+
+static void ADC_Config()
+{
+    // Enable the clock
+    RCC->AHBENR |= RCC_AHBENR_GPIOCEN;
+
+    // Enable the clock for the ADC peripheral
+    RCC->APB2ENR |= RCC_APB2ENR_ADCEN;
+
+    // Enable the clock for the DMA and for TIM3 (conversion trigger)
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+    RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+
+    // Configure the GPIO pin for analog input
+    GPIOC->MODER &= 0xFFFFFFF3;     // Clear bits for PA5
+    GPIOC->MODER |= 0x0000000C;     // Set bits for PA5 to analog mode (11)
+
+    // Set the GPIO pin configuration to no pull-up or pull-down.
+    GPIOC->PUPDR &= 0xFFFFFFF3;
+    GPIOC->PUPDR |= 0x00000000;     // No pull-up/pull-down for analog mode
+
+    // Configure the ADC for hardware-triggered conversions with circular DMA.
+
+    // EXTSEL = 011 (TRG3 = TIM3_TRGO) with EXTEN = 01 starts one conversion on
+    // every TIM3 update. DMACFG keeps the DMA requests going after the buffer
+    // wraps, and overrun mode overwrites old data if DMA ever falls behind.
+    ADC1->CFGR1 = ADC_CFGR1_EXTEN_0 | ADC_CFGR1_EXTSEL_0 | ADC_CFGR1_EXTSEL_1
+                | ADC_CFGR1_DMACFG | ADC_CFGR1_DMAEN | ADC_CFGR1_OVRMOD;
+
+    // Channel 5 is connected to the analog input pin.
+    ADC1->CHSELR |= ADC_CHSELR_CHSEL5;
+
+    // Set the ADC sample time from the settings, by default the maximum (239.5 ADC clock
+    // cycles) for higher accuracy. 252 cycles of the 14 MHz ADC clock is ~18 us, well
+    // inside the 62.5 us trigger period.
+    ADC1->SMPR &= ~((uint32_t)0x00000007); // Clear sampling time bits
+    ADC1->SMPR |= cfg[CFG_ADC_SMPR];       // Set sample time
+
+    // DMA1 Channel 1: ADC data register -> adc_buf, 16-bit, circular,
+    // half and full transfer interrupts drive the decimator.
+    DMA1_Channel1->CCR = 0;
+    DMA1_Channel1->CPAR = (uint32_t)&ADC1->DR;
+    DMA1_Channel1->CMAR = (uint32_t)adc_buf;
+    DMA1_Channel1->CNDTR = 2 * ADC_OVERSAMPLE;
+    DMA1_Channel1->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0
+                       | DMA_CCR_HTIE | DMA_CCR_TCIE | DMA_CCR_EN;
+
+    NVIC_SetPriority(DMA1_Channel1_IRQn, 2);
+    NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+
+    // Enable the ADC by setting the ADEN bit
+    ADC1->CR |= (uint32_t)ADC_CR_ADEN;
+
+    // Wait for the ADC to complete its initialization.
+
+    // The ADEN flag in the ISR (Interrupt and Status Register) will be set once
+    // the ADC is ready for conversions.
+    while (!(ADC1->ISR & ADC_CR_ADEN))
+    {
+        // Busy-wait loop: Do nothing until the ADC is fully enabled.
+    }
+
+    // Arm the ADC; conversions now only start on TIM3 triggers.
+    ADC1->CR |= ADC_CR_ADSTART;
+
+    // TIM3 runs at ADC_SAMPLE_HZ and outputs its update event on TRGO (MMS = 010).
+    TIM3->PSC = 0;
+    TIM3->ARR = (SystemCoreClock / ADC_SAMPLE_HZ) - 1;
+    TIM3->CR2 = TIM_CR2_MMS_1;
+    TIM3->EGR = TIM_EGR_UG;
+    TIM3->CR1 = TIM_CR1_CEN;
+}
+
+
+// Reduces one completed half of adc_buf to one 14-bit value and publishes it.
+static uint16_t adc_decimate(const volatile uint16_t *half, uint32_t status)
+{
+    uint32_t sum = 0;
+    meas_t m;
+
+    for (uint8_t i = 0; i < ADC_OVERSAMPLE; i++) {
+        sum += half[i];
+    }
+
+    // Sum of 16 x 12-bit samples is 16 bits; dropping 2 keeps 14 bits.
+    m.value = sum >> ADC_OVERSAMPLE_SHIFT;
+    m.ts = TIM2->CNT;
+    m.count = ++adc_filtered_count;
+    m.status = status;
+    snap_publish(&adc_snap, &m);
+    stats_add(&stats_res, m.value);
+    adc_hist[m.count % ADC_HIST_LEN] = (uint16_t)(m.value | (status ? 0x8000u : 0));
+    return (uint16_t)m.value;
+}
+
+
+// Sends the values decimated since the last call as TM_ADC frames. Values
+// the decimator overwrote before they were sent are skipped; the receiver
+// sees the gap in the counts.
+void adc_send_batch(void)
+{
+    uint32_t count = adc_filtered_count;
+    tm_adc_t b;
+
+    if (count - adc_sent > ADC_HIST_LEN - 2) adc_sent = count - (ADC_HIST_LEN - 2);
+
+    while (adc_sent != count)
+    {
+        b.first = adc_sent + 1;
+        b.n = 0;
+        b.overrun = 0;
+        while (adc_sent != count && b.n < sizeof(b.v) / sizeof(b.v[0])) {
+            uint16_t v = adc_hist[++adc_sent % ADC_HIST_LEN];
+            if (v & 0x8000u) b.overrun = 1;
+            b.v[b.n++] = v & 0x7FFFu;
+        }
+        tm_send(TM_ADC, &b, offsetof(tm_adc_t, v) + 2u * b.n);
+    }
+}
+
+
+// DMA1_Channel1_IRQHandler runs every time half of adc_buf has been filled and
+// decimates it. HT and TC are cleared and handled one by one, so a handler
+// held off past the next half (a flash erase, a long ISR) still gets both.
+
+void DMA1_Channel1_IRQHandler()
+{
+    uint32_t isr = DMA1->ISR;
+    uint32_t status = 0;
+    uint16_t value = 0;
+
+    evt_log(EVT_ISR_ENTER, DMA1_Channel1_IRQn, 0);
+
+    if ((isr & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)) == (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)) {
+        adc_overruns++;
+        status = MEAS_OVERRUN;
+    }
+    if (isr & DMA_ISR_HTIF1) {
+        DMA1->IFCR = DMA_IFCR_CHTIF1;
+        value = adc_decimate(&adc_buf[0], status);                 // First half is complete
+    }
+    if (isr & DMA_ISR_TCIF1) {
+        DMA1->IFCR = DMA_IFCR_CTCIF1;
+        value = adc_decimate(&adc_buf[ADC_OVERSAMPLE], status);    // Second half is complete
+    }
+
+    evt_log(EVT_ISR_EXIT, DMA1_Channel1_IRQn, value);
+}
+
+// DAC (Digital-to-Analog Converter):
+// Outputs an analog signal based on the digital potentiometer reading from the ADC.
+// This DAC output is fed to the Optocoupler, which controls the NE555 timer's frequency and duty cycle.
+//
+// DAC_Config configures and initializes the DAC to generate
+// an analog output signal based on digital input values. This function is
+// called once during initialization to set up the DAC for operation.
+
+
+static void DAC_Config()
+{
+    // Enable the clock
+    RCC->AHBENR |= ((uint32_t)0x00020000);
+
+    // Enable the clock, which is used for timing and triggering DAC
+    RCC->APB1ENR |= ((uint32_t)0x20000000);
+
+    // Configure GPIOA for analog mode to serve as the DAC output.
+    // Clear the mode bits and set it to analog mode.
+    GPIOA->MODER &= 0xFFFFFCFF;     // Clear bits
+    GPIOA->MODER |= 0x00000300;     // Set to analog mode (11 in MODER bits)
+
+    // Configure pins for no pull-up or pull-down resistors to prevent interfering with analog signals.
+    GPIOA->PUPDR &= 0xFFFFFCFF;     // Clear PUPDR bits
+    GPIOA->PUPDR |= 0x00000000;     // No pull-up/pull-down for analog mode
+
+    // Configure the DAC control register to enable channel 1
+    // Ensure that channel 1 of the DAC is ready for output.
+    DAC->CR &= 0xFFFFFFFF9;         // Clear relevant bits (setup for channel 1)
+
+    // Restart channel 1 by clearing and setting the relevant enable bits.
+    DAC->CR |= 0x00000000;          // Clear channel settings
+    DAC->CR |= 0x00000001;          // Enable DAC channel 1
+}
+
+
+// myTIM2_Init sets TIM2 up as a free-running 32-bit timebase and captures the
+// rising edges of both signal inputs in hardware:
+//
+//   PA1 (555 timer)          -> TI2 -> IC1 (CC1S = 10) -> DMA1 Channel 5
+//                                   -> IC2 (CC2S = 01, falling edges)
+//   PA2 (function generator) -> TI3 -> IC4 (CC4S = 10) -> DMA1 Channel 4
+//
+// The inputs are cross-mapped (TI2 onto IC1, TI3 onto IC4) because the DMA
+// requests of CC2/CC3 share channels with SPI1_TX and the ADC. Every edge
+// latches TIM2->CNT into the CCR and the DMA copies it into a circular
+// buffer, so no edge is missed and no interrupt runs per edge. Both captures
+// stay enabled; each input has its own ring, state and result.
+//
+// The 555 is captured in PWM input mode, for its duty cycle: TI2 also feeds
+// IC2, which latches the falling edges. IC2 has no DMA channel of its own,
+// so the rising edge's request drives a DMA burst (TIM2->DCR) that copies
+// CCR1 and then CCR2 through TIM2->DMAR: each slot of the 555's ring is a
+// pair {rising edge, falling edge before it}. The low time of the period
+// ending at the rising edge is their difference, and its high time is the
+// period minus that; with the /8 prescaler the low time is that of the
+// last period in the group, taken as that of all 8. A reading's duty cycle is taken over the
+// periods it accepted, leaving out the one after an edge it did not accept
+// (whose falling edge may be a glitch's) and taking back the one before a
+// glitch (which may have ended on it). Only one burst can be set up per
+// timer, so the function generator has no duty cycle.
+//
+// Each input is auto-ranged between three ways of measuring it:
+//
+//   RANGE_RECIP   every rising edge is timestamped. A reading is the number
+//                 of whole periods over their span of at least RANGE_GATE_MS,
+//                 so the resolution is +/- 1 tick over the span rather than
+//                 over one period. Timestamps are extended to 64 bits, so a
+//                 period may be longer than the 89 s TIM2 takes to wrap.
+//   RANGE_RECIP8  the same with the capture prescaler at /8, for rates the
+//                 ring would not keep up with one edge per timestamp.
+//   RANGE_GATED   (function generator only) PA2 is handed to TIM15_CH1 and
+//                 TIM15 counts its edges as an external clock over the
+//                 gate. The resolution is +/- 1 edge over the gate, which
+//                 beats timestamping once the ring would overflow.
+//
+// A range is left upwards at 16 timestamps per measure period and downwards
+// 25% below that, so a frequency near a switch point does not flap. A ring
+// the DMA lapped between two polls would alias to a plausible but wrong
+// rate, so the poll also watches the channel's half/complete flags (set on
+// every pass, interrupts or not): a lap always sets both, and fewer than 16
+// new timestamps never do. Either way the input moves up a range.
+//
+// Edges are qualified twice. The inputs' digital filter (ICxF = 0011: 8
+// samples at the timer clock) drops pulses under 167 ns; it samples
+// every tick, so it delays every edge by the same amount and costs no
+// resolution. Longer glitches and lost edges are caught per timestamp: the
+// span since the last accepted one is compared with the median of the last
+// IC_MED_N accepted periods, and one more than 1/IC_MED_TOL_SHIFT of it away
+// is an outlier (a glitch splits a period in two, a lost edge doubles one,
+// and either shifts a /8 group by one edge, 12.5%). A short span means the
+// timestamp is a glitch and is dropped, so the next one spans the whole
+// period; a long one is kept as the start of the next period, but its span
+// is left out. A reading is then the periods it accepted over their summed
+// span, and each unbroken run of them adds +/- 1 tick to the resolution.
+// IC_MED_N outliers in a row are taken as a real frequency step.
+
+// Number of timestamps held by each capture ring.
+#define IC_BUF_LEN 32
+
+// Period outlier rejection: median of the last IC_MED_N periods, tolerance
+// median >> IC_MED_TOL_SHIFT (6.25%).
+#define IC_MED_N          5u
+#define IC_MED_TOL_SHIFT  4u
+
+// ic_qualify() verdicts.
+enum { IC_EDGE_OK, IC_EDGE_EARLY, IC_EDGE_LATE, IC_EDGE_SKIP };
+
+// Shortest span of one reading.
+#define RANGE_GATE_MS 100u
+
+// Switch points in Hz, with 25% hysteresis. 16 timestamps per 10 ms poll is
+// half the ring.
+#define RANGE_RECIP8_UP_HZ   1600u
+#define RANGE_RECIP8_DOWN_HZ 1200u
+#define RANGE_GATED_UP_HZ    12800u
+#define RANGE_GATED_DOWN_HZ  9600u
+
+typedef struct {
+    DMA_Channel_TypeDef *dma;       // DMA channel streaming the CCR values
+    volatile uint32_t *buf;         // Circular buffer filled by the DMA
+    uint8_t  pwm;                   // 1 if each slot is a {rise, fall} pair (PWM input)
+    stats_t *stats;                 // Rolling statistics of the periods
+    freq_result_t *res;             // Result slot in freq_in[]
+    volatile uint32_t *ccmr;        // Capture mode register holding the prescaler
+    uint32_t psc_mask;              // ICxPSC field in *ccmr (both bits = /8)
+    uint32_t ccer_en;               // CCxE bit in TIM2->CCER
+    uint32_t dma_flags;             // HTIFx | TCIFx of the DMA channel
+    uint8_t  in;                    // FREQ_SEL_* of the input
+    uint8_t  can_gate;              // 1 if the input can be counted by TIM15
+    uint8_t  range;                 // RANGE_* in use
+    uint8_t  primed;                // 1 once `last` holds a valid timestamp
+    uint16_t rd;                    // Next buffer index to consume
+    uint16_t gate_cnt;              // TIM15->CNT at the last gated poll
+    uint64_t last;                  // Last timestamp consumed (64-bit TIM2 time)
+    uint64_t gate_t0;               // Start of the reading being built
+    uint32_t gate_n;                // Periods (or edges when gated) since gate_t0
+    uint64_t gate_ticks;            // Span of those periods (reciprocal ranges)
+    uint32_t gate_runs;             // Unbroken runs of periods in gate_ticks
+    uint32_t med[IC_MED_N];         // Last periods (ticks), oldest overwritten first
+    uint8_t  med_n;                 // Periods in med[] (< IC_MED_N: not judged yet)
+    uint8_t  med_i;                 // Slot of the next period
+    uint8_t  med_run;               // Outliers in a row
+    uint8_t  med_dropped;           // The last timestamp judged was dropped as early
+    uint32_t rejected;              // Timestamps dropped as glitches, spans as lost edges
+    uint8_t  duty_skip;             // Leave the next period's low time out (PWM input)
+    uint32_t duty_n;                // Periods (groups of 8) with a low time since gate_t0
+    uint64_t duty_ticks;            // Their span
+    uint64_t duty_low;              // Sum of their low times
+    uint32_t duty_last_gap;         // Last period added to them, 0 = none
+    uint32_t duty_last_low;
+} ic_stream_t;
+
+static volatile uint32_t ic_buf_555[2 * IC_BUF_LEN];
+static volatile uint32_t ic_buf_fg[IC_BUF_LEN];
+
+// Latest reading of each input for interrupt handlers (indexed by
+// FREQ_SEL_*): value = mHz, ts = TIM2 at the end of its span, count =
+// periods, status = RANGE_*.
+snap_chan_t freq_snap[2];
+
+static ic_stream_t ic_555 = { .dma = DMA1_Channel5, .buf = ic_buf_555, .pwm = 1, .stats = &stats_555,
+                              .res = &freq_in[FREQ_SEL_555], .ccmr = &TIM2->CCMR1,
+                              .psc_mask = TIM_CCMR1_IC1PSC, .ccer_en = TIM_CCER_CC1E,
+                              .dma_flags = DMA_ISR_HTIF5 | DMA_ISR_TCIF5, .in = FREQ_SEL_555 };
+static ic_stream_t ic_fg  = { .dma = DMA1_Channel4, .buf = ic_buf_fg,  .stats = &stats_fg,
+                              .res = &freq_in[FREQ_SEL_FG], .ccmr = &TIM2->CCMR2,
+                              .psc_mask = TIM_CCMR2_IC4PSC, .ccer_en = TIM_CCER_CC4E,
+                              .dma_flags = DMA_ISR_HTIF4 | DMA_ISR_TCIF4, .in = FREQ_SEL_FG, .can_gate = 1 };
+
+
+// Points a DMA channel at a capture register (or TIM2->DMAR, for a burst of
+// `words` registers per request) and starts streaming into buf.
+static void ic_dma_init(DMA_Channel_TypeDef *ch, volatile uint32_t *ccr, volatile uint32_t *buf, uint8_t words)
+{
+    ch->CCR = 0;
+    ch->CPAR = (uint32_t)ccr;
+    ch->CMAR = (uint32_t)buf;
+    ch->CNDTR = IC_BUF_LEN * words;
+
+    // Peripheral -> memory, 32-bit both sides, memory increment, circular.
+    ch->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1 | DMA_CCR_PL_1 | DMA_CCR_EN;
+}
+
+
+void myTIM2_Init()
+{
+    /* Enable the clock for the TIM2 peripheral in the APB1 bus and for the DMA. */
+    RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+
+    /* Configure TIM2 Control Register 1 (TIM2->CR1):
+       - Enable buffer auto-reload (ARPE)
+       - Count up mode, free running: the counter wraps at ARR and keeps going,
+         so timestamps are never lost between edges. */
+    TIM2->CR1 = TIM_CR1_ARPE;
+
+    /* Count at the full system clock. */
+    TIM2->PSC = ((uint16_t)0x0000);
+
+    /* Set the auto-reload register to its maximum value so period differences
+       can be taken with plain unsigned 32-bit subtraction. */
+    TIM2->ARR = ((uint32_t)0xFFFFFFFF);
+
+    /* Generate an update event to load the prescaler value into the timer.*/
+    TIM2->EGR = TIM_EGR_UG;
+
+    /* IC1 and IC2 <- TI2 (PA1), IC4 <- TI3 (PA2), no prescaler. The filter
+       belongs to the pin's TIx (IC2F for TI2, IC3F for TI3): 0011 = 8
+       samples at the timer clock, so pulses under 167 ns never reach the
+       capture. */
+    TIM2->CCMR1 = TIM_CCMR1_CC1S_1 | TIM_CCMR1_CC2S_0 | TIM_CCMR1_IC2F_0 | TIM_CCMR1_IC2F_1;
+    TIM2->CCMR2 = TIM_CCMR2_CC4S_1 | TIM_CCMR2_IC3F_0 | TIM_CCMR2_IC3F_1;
+
+    /* Rising edge polarity (CCxP = 0), falling for IC2; all captured all
+       the time. */
+    TIM2->CCER = TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC2P | TIM_CCER_CC4E;
+
+    /* Stream the capture registers into their rings: CCR4 alone, CCR1 and
+       CCR2 as a 2-register burst from CCR1 (DBA = 13) on the CC1 request. */
+    TIM2->DCR = TIM_DCR_DBL_0 | (((uint32_t)&TIM2->CCR1 - (uint32_t)&TIM2->CR1) >> 2);
+    ic_dma_init(ic_555.dma, &TIM2->DMAR, ic_555.buf, 2);
+    ic_dma_init(ic_fg.dma,  &TIM2->CCR4, ic_fg.buf, 1);
+    TIM2->DIER = TIM_DIER_CC1DE | TIM_DIER_CC4DE;
+
+    /* Start the TIM2 timer by enabling the counter. */
+    TIM2->CR1 |= TIM_CR1_CEN;
+}
+
+
+// 64 / 32-bit division: the high word with one 32-bit division, the low word
+// bit by bit. The Cortex-M0 has no divide instruction, and a plain 64-bit
+// division would call the 64 / 64-bit library routine (__aeabi_uldivmod)
+// for a divisor that is never wider than 32 bits.
+static uint64_t udiv64_32(uint64_t n, uint32_t d)
+{
+    uint32_t lo = (uint32_t)n;
+    uint32_t q = (uint32_t)(n >> 32) / d;
+    uint32_t r = (uint32_t)(n >> 32) % d;
+    uint32_t qlo = 0;
+    uint8_t i;
+
+    for (i = 0; i < 32; i++)
+    {
+        uint32_t carry = r >> 31;
+
+        r = (r << 1) | (lo >> 31);
+        lo <<= 1;
+        qlo <<= 1;
+        if (carry || r >= d) {
+            r -= d;
+            qlo |= 1;
+        }
+    }
+    return ((uint64_t)q << 32) | qlo;
+}
+
+
+// Converts `periods` input periods spanning `ticks` TIM2 counts into
+// frequency * FREQ_SCALE with a single 64 / 32-bit division. A span wider
+// than 32 bits (periods over 89 s) is shifted down together with the
+// dividend first; it keeps 32 significant bits, far more than the result
+// has. Truncates, and saturates when the result does not fit in 32 bits.
+static uint32_t freq_from_span(uint32_t periods, uint64_t ticks)
+{
+    uint64_t n = (uint64_t)SystemCoreClock * FREQ_SCALE * periods;
+    uint64_t scaled;
+
+    while (ticks >> 32) {
+        ticks >>= 1;
+        n >>= 1;
+    }
+    if (ticks == 0) return 0xFFFFFFFFu;
+    scaled = udiv64_32(n, (uint32_t)ticks);
+    return (scaled > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)scaled;
+}
+
+
+// Converts a period of `ticks` TIM2 counts into frequency * FREQ_SCALE with a
+// single 64 / 32-bit division. The result is truncated, so dividing it by
+// FREQ_SCALE gives the whole-Hz value the old (double) math produced, except
+// at some counts that divide SystemCoreClock exactly (11 of the 154 at
+// 48 MHz): there the double quotient landed just below the integer and came
+// out 1 Hz low.
+// Saturates for periods too short to fit the scaled result in 32 bits.
+static inline uint32_t freq_from_ticks(uint32_t ticks)
+{
+    return freq_from_span(1, ticks);
+}
+
+
+// TIM2 time extended to 64 bits. The measure task calls this far more often
+// than the 89 s the counter takes to wrap, so a smaller count than last time
+// is one wrap.
+static uint64_t tim2_now64(void)
+{
+    static uint32_t hi, prev;
+    uint32_t cnt = TIM2->CNT;
+
+    if (cnt < prev) hi++;
+    prev = cnt;
+    return ((uint64_t)hi << 32) | cnt;
+}
+
+
+// Extends a timestamp captured less than one wrap before `now` to 64 bits.
+static inline uint64_t tim2_extend(uint64_t now, uint32_t ts)
+{
+    return now - (uint32_t)((uint32_t)now - ts);
+}
+
+
+// Returns the ring slot the DMA will write next. A pair the burst is still
+// writing is not complete yet.
+static inline uint16_t ic_write_index(const ic_stream_t *s)
+{
+    return (uint16_t)((((IC_BUF_LEN << s->pwm) - s->dma->CNDTR) >> s->pwm) % IC_BUF_LEN);
+}
+
+
+// Share of `part` in `whole` (part <= whole) in parts per 10^6.
+static uint32_t ic_ppm(uint64_t part, uint64_t whole)
+{
+    while (whole >> 32) {
+        whole >>= 1;
+        part >>= 1;
+    }
+    return whole ? (uint32_t)udiv64_32(part * 1000000u, (uint32_t)whole) : 0;
+}
+
+
+// Publishes a reading of `periods` periods over `ticks` TIM2 counts. `units`
+// is the count the method is off by less than one of (ticks, or edges when
+// gated), so the true count is above units - 1; the 1/FREQ_SCALE Hz
+// truncation is added to that. The duty cycle comes from the low times
+// gathered since the reading started, if any.
+static void ic_publish(ic_stream_t *s, uint32_t periods, uint64_t ticks, uint64_t units)
+{
+    freq_result_t *r = s->res;
+    uint32_t mHz = freq_from_span(periods, ticks);
+    uint32_t ppb = 1000000000u;
+    uint8_t shift = (s->range == RANGE_RECIP8) ? 3 : 0;
+    meas_t m;
+    tm_reading_t t = { 0 };
+
+    if (units > 1) ppb = ((units - 1) >> 32) ? 0 : (uint32_t)udiv64_32(1000000000u, (uint32_t)(units - 1));
+    if (mHz != 0) ppb += (uint32_t)udiv64_32(1000000000u, mHz);
+
+    r->mHz = mHz;
+    r->res_ppb = ppb;
+    r->periods = periods;
+    r->range = s->range;
+    r->duty_ppm = r->high_ticks = r->low_ticks = 0;
+    if (s->duty_n != 0) {
+        r->duty_ppm = 1000000u - ic_ppm(s->duty_low << shift, s->duty_ticks);
+        r->low_ticks = (uint32_t)udiv64_32(s->duty_low, s->duty_n);
+        r->high_ticks = (uint32_t)udiv64_32(s->duty_ticks, s->duty_n << shift) - r->low_ticks;
+    }
+    r->seq++;
+
+    m.value = mHz;
+    m.ts = (uint32_t)s->last;
+    m.count = periods;
+    m.status = s->range;
+    snap_publish(&freq_snap[s->in], &m);
+
+    t.in = s->in;
+    t.range = s->range;
+    t.ts = m.ts;
+    t.mHz = mHz;
+    t.periods = periods;
+    t.res_ppb = ppb;
+    t.duty_ppm = r->duty_ppm;
+    t.high_ticks = r->high_ticks;
+    t.low_ticks = r->low_ticks;
+    tm_send(TM_READING, &t, sizeof(t));
+}
+
+
+// Starts a new reading at `t`.
+static inline void ic_gate_open(ic_stream_t *s, uint64_t t)
+{
+    s->gate_t0 = t;
+    s->gate_n = 0;
+    s->gate_ticks = 0;
+    s->gate_runs = 1;
+    s->duty_n = 0;
+    s->duty_ticks = 0;
+    s->duty_low = 0;
+    s->duty_last_gap = 0;
+}
+
+
+// Moves an input to another range: the capture prescaler for the reciprocal
+// ranges; PA2 and TIM15 for the gated one. Whatever was being built is
+// dropped, as its timestamps or counts no longer match the new setting.
+static void ic_set_range(ic_stream_t *s, uint8_t range, uint32_t mHz)
+{
+    if (range == RANGE_GATED)
+    {
+        /* TIM15 counts rising edges of TI1 (external clock mode 1, TS = TI1FP1). */
+        RCC->APB2ENR |= RCC_APB2ENR_TIM15EN;
+        TIM15->CR1 = 0;
+        TIM15->PSC = 0;
+        TIM15->ARR = 0xFFFF;
+        TIM15->CCMR1 = TIM_CCMR1_CC1S_0;
+        TIM15->CCER = 0;
+        TIM15->SMCR = TIM_SMCR_TS_2 | TIM_SMCR_TS_0 | TIM_SMCR_SMS;
+        TIM15->EGR = TIM_EGR_UG;
+        TIM15->CR1 = TIM_CR1_CEN;
+
+        /* PA2 to AF0 (TIM15_CH1). */
+        GPIOA->AFR[0] &= ~GPIO_AFRL_AFRL2;
+    }
+    else
+    {
+        if (s->range == RANGE_GATED) {
+            /* PA2 back to AF2 (TIM2_CH3) and TIM15 off. */
+            GPIOA->AFR[0] |= (2u << 8);
+            TIM15->CR1 = 0;
+        }
+
+        /* The prescaler is reset while the capture is disabled. */
+        TIM2->CCER &= ~s->ccer_en;
+        if (range == RANGE_RECIP8) *s->ccmr |= s->psc_mask;
+        else *s->ccmr &= ~s->psc_mask;
+        TIM2->CCER |= s->ccer_en;
+    }
+
+    s->range = range;
+    s->primed = 0;
+    s->med_n = 0;
+    s->med_run = 0;
+    s->med_dropped = 0;
+    s->rd = ic_write_index(s);
+    stats_restart(s->stats);
+    evt_log(EVT_FREQ_RANGE, (uint16_t)(s->in << 8 | range), mHz);
+}
+
+
+// Picks the range for the next reading from the last one.
+static void ic_autorange(ic_stream_t *s)
+{
+    uint32_t hz = s->res->mHz / FREQ_SCALE;
+
+    switch (s->range)
+    {
+    case RANGE_RECIP:
+        if (hz > RANGE_RECIP8_UP_HZ) ic_set_range(s, RANGE_RECIP8, s->res->mHz);
+        break;
+    case RANGE_RECIP8:
+        if (hz < RANGE_RECIP8_DOWN_HZ) ic_set_range(s, RANGE_RECIP, s->res->mHz);
+        else if (hz > RANGE_GATED_UP_HZ && s->can_gate) ic_set_range(s, RANGE_GATED, s->res->mHz);
+        break;
+    default:
+        if (hz < RANGE_GATED_DOWN_HZ) ic_set_range(s, RANGE_RECIP8, s->res->mHz);
+        break;
+    }
+}
+
+
+// Gated range: adds up TIM15's edge count and closes the gate once it spans
+// RANGE_GATE_MS. TIM2 and TIM15 are read back to back with interrupts
+// masked, so the gate edges are the same instant for both. TIM15 is 16 bits
+// and read every 10 ms, which bounds this range at 6.5 MHz.
+static void ic_gate_poll(ic_stream_t *s, uint64_t now)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t cnt2;
+    uint16_t cnt15;
+    uint64_t t;
+
+    __disable_irq();
+    cnt2 = TIM2->CNT;
+    cnt15 = (uint16_t)TIM15->CNT;
+    __set_PRIMASK(primask);
+    t = now + (uint32_t)(cnt2 - (uint32_t)now);
+
+    if (!s->primed) {
+        s->gate_cnt = cnt15;
+        s->primed = 1;
+        ic_gate_open(s, t);
+        return;
+    }
+    s->gate_n += (uint16_t)(cnt15 - s->gate_cnt);
+    s->gate_cnt = cnt15;
+
+    if (t - s->gate_t0 >= (uint64_t)SystemCoreClock / 1000u * RANGE_GATE_MS)
+    {
+        if (s->gate_n != 0) ic_publish(s, s->gate_n, t - s->gate_t0, s->gate_n);
+        ic_gate_open(s, t);
+        ic_autorange(s);
+    }
+}
+
+
+// Returns 1 if `period` is within 1/2^IC_MED_TOL_SHIFT of `ref`.
+static inline int ic_near(uint32_t period, uint32_t ref)
+{
+    uint32_t dev = (period > ref) ? period - ref : ref - period;
+
+    return dev <= (ref >> IC_MED_TOL_SHIFT);
+}
+
+
+// Judges the span from the last accepted timestamp against the median of
+// the last IC_MED_N accepted periods: IC_EDGE_OK (recorded), IC_EDGE_EARLY
+// (a glitch: drop the timestamp) or IC_EDGE_LATE (lost edges: take the
+// timestamp but not its span). IC_MED_N outliers in a row are a real
+// frequency change, and the median starts over. A span that ends right
+// after a dropped timestamp does not break the row: once the input runs
+// at a multiple of the old frequency, every other span is the old median
+// again. Until it has IC_MED_N
+// periods a span is judged against the one before: a mismatch starts the
+// window again from it, and the first span of a window is IC_EDGE_SKIP
+// (taken like a late one, but not an outlier), as there is nothing to
+// judge it by. Insertion sort of a copy: 10 compares at most, per
+// timestamp.
+static int ic_qualify(ic_stream_t *s, uint32_t period)
+{
+    uint32_t sorted[IC_MED_N];
+    uint32_t med;
+    uint8_t i, j;
+    int verdict = IC_EDGE_OK;
+
+    if (s->med_n == IC_MED_N)
+    {
+        for (i = 0; i < IC_MED_N; i++) {
+            uint32_t v = s->med[i];
+            for (j = i; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+            sorted[j] = v;
+        }
+        med = sorted[IC_MED_N / 2];
+
+        if (!ic_near(period, med))
+        {
+            if (++s->med_run == IC_MED_N) {
+                s->med_n = 0;
+                s->med_run = 0;
+            }
+            s->med_dropped = (period < med);
+            return (period < med) ? IC_EDGE_EARLY : IC_EDGE_LATE;
+        }
+    }
+    else
+    {
+        if (s->med_n != 0) {
+            med = s->med[(s->med_i + IC_MED_N - 1) % IC_MED_N];
+            if (!ic_near(period, med)) s->med_n = 0;
+        }
+        if (s->med_n == 0) verdict = IC_EDGE_SKIP;
+        s->med_n++;
+    }
+
+    if (!s->med_dropped) s->med_run = 0;
+    s->med_dropped = 0;
+    s->med[s->med_i] = period;
+    s->med_i = (uint8_t)((s->med_i + 1) % IC_MED_N);
+    return verdict;
+}
+
+
+// Consumes every timestamp captured since the last call and closes the
+// reading once it spans RANGE_GATE_MS (or one period, for slower inputs).
+// Must run at least once per IC_BUF_LEN timestamps; the range switch points
+// keep that true, and a poll that finds the ring may have been lapped drops
+// the reading, publishes the latest period alone and moves up a range.
+// `isr` holds the DMA flags raised since the last poll, and `wr` the write
+// index, read before `now`.
+static void ic_stream_poll(ic_stream_t *s, uint64_t now, uint32_t isr, uint16_t wr)
+{
+    uint8_t shift = (s->range == RANGE_RECIP8) ? 3 : 0;
+    uint16_t n_new = (uint16_t)((wr + IC_BUF_LEN - s->rd) % IC_BUF_LEN);
+    uint64_t gap = 0;
+    tm_edges_t e;
+
+    if (s->range == RANGE_GATED) {
+        ic_gate_poll(s, now);
+        return;
+    }
+
+    e.in = s->in;
+    e.range = s->range;
+    e.n = 0;
+    e.lapped = (isr & s->dma_flags) == s->dma_flags;
+
+    while (s->rd != wr)
+    {
+        uint32_t raw = s->buf[s->rd << s->pwm];
+        uint32_t fall = s->pwm ? s->buf[(s->rd << 1) + 1] : 0;
+        uint64_t ts = tim2_extend(now, raw);
+        s->rd = (s->rd + 1) % IC_BUF_LEN;
+        e.ts[e.n++] = raw;
+
+        if (s->primed)
+        {
+            gap = ts - s->last;
+
+            switch (ic_qualify(s, (gap >> 32) ? 0xFFFFFFFFu : (uint32_t)gap))
+            {
+            case IC_EDGE_EARLY:
+                // Glitch: the next edge is measured from the last good one.
+                s->rejected++;
+                s->duty_skip = 1;
+
+                // The last period may have ended on the glitch instead.
+                if (s->duty_last_gap != 0) {
+                    s->duty_n--;
+                    s->duty_ticks -= s->duty_last_gap;
+                    s->duty_low -= s->duty_last_low;
+                    s->duty_last_gap = 0;
+                }
+                continue;
+            case IC_EDGE_LATE:
+                // Lost edge: leave its span out of the reading.
+                s->rejected++;
+                // fall through
+            case IC_EDGE_SKIP:
+                s->gate_runs++;
+                s->duty_skip = 1;
+                s->duty_last_gap = 0;
+                break;
+            default:
+                s->gate_n++;
+                s->gate_ticks += gap;
+
+                // One period per sample, rounded, whatever the prescaler.
+                stats_add(s->stats, (gap >> 32) ? 0xFFFFFFFFu : (uint32_t)((gap + ((1u << shift) >> 1)) >> shift));
+
+                // Low time: from the falling edge before this rising one.
+                s->duty_last_gap = 0;
+                if (s->pwm && !s->duty_skip && (uint32_t)(raw - fall) < (gap >> shift)) {
+                    s->duty_last_gap = (uint32_t)gap;
+                    s->duty_last_low = (uint32_t)(raw - fall);
+                    s->duty_n++;
+                    s->duty_ticks += gap;
+                    s->duty_low += s->duty_last_low;
+                }
+                s->duty_skip = 0;
+                break;
+            }
+        } else {
+            ic_gate_open(s, ts);
+            s->primed = 1;
+        }
+        s->last = ts;
+    }
+
+    // Every timestamp goes out on the telemetry stream as captured.
+    if (e.n != 0) tm_send(TM_EDGES, &e, 4u + 4u * e.n);
+
+    if (e.lapped)
+    {
+        stats_restart(s->stats);
+        ic_gate_open(s, s->last);
+        if (n_new >= 2) ic_publish(s, 1u << shift, gap, gap);
+        if (s->range == RANGE_RECIP) ic_set_range(s, RANGE_RECIP8, s->res->mHz);
+        else if (s->can_gate) ic_set_range(s, RANGE_GATED, s->res->mHz);
+        return;
+    }
+
+    if (s->gate_n != 0 && s->last - s->gate_t0 >= (uint64_t)SystemCoreClock / 1000u * RANGE_GATE_MS)
+    {
+        ic_publish(s, s->gate_n << shift, s->gate_ticks, udiv64_32(s->gate_ticks, s->gate_runs));
+        ic_gate_open(s, s->last);
+        ic_autorange(s);
+    }
+}
+
+
+// TIM2 and the DMA stood still in Stop, so no span may cross it: both
+// inputs start over from the first edge after the wake-up, and what was
+// captured before it is dropped. The median of the periods is kept.
+void freq_capture_resume(void)
+{
+    ic_555.rd = ic_write_index(&ic_555);
+    ic_fg.rd = ic_write_index(&ic_fg);
+    ic_555.primed = 0;
+    ic_fg.primed = 0;
+    DMA1->IFCR = ic_555.dma_flags | ic_fg.dma_flags;
+}
+
+
+// Returns the stream of the input selected for display.
+static inline ic_stream_t *freq_selected(void)
+{
+    return (freq_sel == FREQ_SEL_555) ? &ic_555 : &ic_fg;
+}
+
+
+// freq_capture_poll updates both inputs every time, so neither has a gap when
+// the display switches, then publishes the selected one as Freq.
+
+void freq_capture_poll(void)
+{
+    uint64_t now;
+    uint32_t isr;
+    uint16_t wr_555, wr_fg;
+
+    // Flags before the write indices: a transfer after the clear is then
+    // consumed now, and at worst raises a flag one poll early.
+    isr = DMA1->ISR & (ic_555.dma_flags | ic_fg.dma_flags);
+    DMA1->IFCR = isr;
+
+    // Write indices before `now`: every timestamp consumed is then older
+    // than it, where tim2_extend() needs it. A capture between the two
+    // would otherwise be extended to one wrap (89 s) in the past.
+    wr_555 = ic_write_index(&ic_555);
+    wr_fg = ic_write_index(&ic_fg);
+    now = tim2_now64();
+
+    ic_stream_poll(&ic_555, now, isr, wr_555);
+    ic_stream_poll(&ic_fg, now, isr, wr_fg);
+
+    Freq_mHz = freq_in[freq_sel].mHz;
+    Freq = Freq_mHz / FREQ_SCALE;
+}
+
+
+// n / d for display values: a divisor wider than 32 bits is shifted down
+// (with n) first, which is plenty for a 16-character line. Saturates.
+static uint32_t stats_div(uint64_t n, uint64_t d)
+{
+    uint64_t q;
+
+    while (d >> 32) {
+        d >>= 1;
+        n >>= 1;
+    }
+    if (d == 0) return 0xFFFFFFFFu;
+    q = udiv64_32(n, (uint32_t)d);
+    return (q > 0xFFFFFFFFu) ? 0xFFFFFFFFu : (uint32_t)q;
+}
+
+
+// oled_draw_stats shows the rolling statistics of the last window on the
+// pages below the readings (frequency lines for the selected input):
+//
+//   page 4  Fav   400.012Hz   mean frequency
+//   page 5  Fsd     0.012Hz   standard deviation of the frequency
+//   page 6  Fpp        80ns   peak-to-peak period jitter
+//   page 7  R 2440-2442 s  3  resistance range and standard deviation (Ohms)
+//
+// The divisions run here, once per frame, not per sample.
+
+void oled_draw_stats(void)
+{
+    stats_snap_t st;
+    uint8_t col;
+
+    stats_read(freq_selected()->stats, &st);
+    if (st.count != 0)
+    {
+        uint64_t mean_q4 = (st.sum << 4) >> st.log2;   // Mean period, 1/16 ticks
+        uint32_t mean_mHz = stats_div(((uint64_t)SystemCoreClock * FREQ_SCALE) << st.log2, st.sum);
+
+        col = oled_fb_puts(4, 0, "Fav");
+        col = oled_fb_putfixed(4, col, mean_mHz, 3, 10);
+        oled_fb_puts(4, col, "Hz");
+
+        // sd(f) / f = sd(T) / T for the small spreads this is meant for.
+        col = oled_fb_puts(5, 0, "Fsd");
+        col = oled_fb_putfixed(5, col, stats_div((uint64_t)mean_mHz * stats_std_q4(&st), mean_q4), 3, 10);
+        oled_fb_puts(5, col, "Hz");
+
+        col = oled_fb_puts(6, 0, "Fpp");
+        col = oled_fb_putu(6, col, stats_div((uint64_t)(st.max - st.min) * 1000000000u, SystemCoreClock), 10);
+        oled_fb_puts(6, col, "ns");
+    }
+
+    stats_read(&stats_res, &st);
+    if (st.count != 0)
+    {
+        col = oled_fb_puts(7, 0, "R");
+        col = oled_fb_putu(7, col, stats_div((uint64_t)st.min * cfg[CFG_RES_OHMS], ADC_FILTERED_MAX), 5);
+        col = oled_fb_puts(7, col, "-");
+        col = oled_fb_putu(7, col, stats_div((uint64_t)st.max * cfg[CFG_RES_OHMS], ADC_FILTERED_MAX), 4);
+        col = oled_fb_puts(7, col, " s");
+        oled_fb_putu(7, col, stats_div((uint64_t)stats_std_q4(&st) * cfg[CFG_RES_OHMS], ADC_FILTERED_MAX * 16u), 3);
+    }
+}
+
+
+//---------- Flash Programming --------------------
+//
+// Erases and programs the FLASH_DATA_PAGES pages at the top of the flash,
+// which hold data rather than code (the linker script must end the program
+// image below FLASH_DATA_ADDR). The core stalls on instruction fetches while
+// the flash is busy, so a page erase holds everything, interrupts included,
+// for up to 40 ms: callers write rarely, and from a task.
+
+#define FLASH_BYTES       (64u * 1024u)     // STM32F051R8
+#define FLASH_PAGE_BYTES  1024u
+#define FLASH_DATA_PAGES  3u        // Key/value store, calibration
+#define FLASH_DATA_ADDR   (FLASH_BASE + FLASH_BYTES - FLASH_DATA_PAGES * FLASH_PAGE_BYTES)
+
+
+static void flash_unlock(void)
+{
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+}
+
+
+// Waits for the operation in progress. Returns 1 if it completed without an
+// error; clears the status either way.
+static int flash_wait(void)
+{
+    uint32_t sr;
+
+    while ((sr = FLASH->SR) & FLASH_SR_BSY) {}
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;
+    return (sr & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) == 0;
+}
+
+
+// Erases the page at addr. Returns 0 if the flash reported an error.
+int flash_erase_page(uintptr_t addr)
+{
+    int ok;
+
+    flash_unlock();
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR = (uint32_t)addr;
+    FLASH->CR |= FLASH_CR_STRT;
+    ok = flash_wait();
+    FLASH->CR &= ~FLASH_CR_PER;
+    FLASH->CR |= FLASH_CR_LOCK;
+    return ok;
+}
+
+
+// Programs len bytes (even, addr halfword aligned) into erased flash.
+// Returns 0 at the first halfword the flash refused.
+int flash_program(uintptr_t addr, const void *src, uint32_t len)
+{
+    const uint8_t *p = src;
+    int ok = 1;
+
+    flash_unlock();
+    FLASH->CR |= FLASH_CR_PG;
+    for (uint32_t i = 0; ok && i < len; i += 2) {
+        *(volatile uint16_t *)(addr + i) = (uint16_t)(p[i] | p[i + 1] << 8);
+        ok = flash_wait();
+    }
+    FLASH->CR &= ~FLASH_CR_PG;
+    FLASH->CR |= FLASH_CR_LOCK;
+    return ok;
+}
+
+
+//---------- Key/Value Store --------------------
+//
+// Small values (settings, measured constants) kept across resets in two
+// flash pages used as one log. Each kv_set() appends a record to the active
+// page; the latest record of a key is its value. When the page is full,
+// kv_compact() copies the latest record of every key to the other page,
+// which then becomes active. The two pages take turns, so they wear
+// equally, and a value that does not change is never written again.
+//
+//   page    gen (u32), crc16 of gen, KV_MAGIC. The valid page with the
+//           newest gen is active. The magic goes in last, so a page whose
+//           compaction was cut short is never valid.
+//   record  commit, key | len << 8, crc16 of key, len and data, data (len
+//           bytes, padded to a halfword). The commit halfword is programmed
+//           to 0 last, so a record appears whole or not at all. A record
+//           that is complete but not committed is skipped; one that fails
+//           its CRC ends the log and the page is compacted before the next
+//           append.
+//
+// Power can fail at any point: the old value of the key being set, or the
+// new one, survives, and every other key keeps its value. kv_init() reads
+// the two page headers and scans the active page once (the records, then
+// the erased rest to make sure it is still erased), so a boot reads at most
+// one page whatever the store's history. Reads then go through an index of
+// the latest record of each key.
+
+#define KV_PAGE_ADDR(n)   (FLASH_DATA_ADDR + (n) * FLASH_PAGE_BYTES)
+#define KV_PAGES          2u
+#define KV_KEYS           16u
+#define KV_VAL_MAX        64u       // Longest value
+#define KV_MAGIC          0x4B56u
+#define KV_HDR_BYTES      8u        // Page header
+#define KV_REC_BYTES(len) (6u + (((len) + 1u) & ~1u))
+
+static struct {
+    uint8_t  page;                  // Active page, KV_PAGES = none yet
+    uint8_t  dirty;                 // The log ends in a damaged record
+    uint32_t gen;                   // Of the active page
+    uint16_t end;                   // Where the next record goes
+    uint16_t off[KV_KEYS];          // Latest record of each key, 0 = none
+} kv;
+
+
+// CRC-16/CCITT (polynomial 0x1021), continued from crc.
+static uint16_t crc16(uint16_t crc, const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+
+    while (len--) {
+        crc ^= (uint16_t)(*p++ << 8);
+        for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x8000) ? (uint16_t)(crc << 1 ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+
+static inline const uint8_t *kv_ptr(uint8_t page, uint32_t off)
+{
+    return (const uint8_t *)KV_PAGE_ADDR(page) + off;
+}
+
+
+static inline uint16_t kv_rd16(uint8_t page, uint32_t off)
+{
+    return *(const volatile uint16_t *)kv_ptr(page, off);
+}
+
+
+// CRC of a record: its key/length halfword, then its data.
+static uint16_t kv_rec_crc(uint16_t kl, const uint8_t *data, uint8_t len)
+{
+    uint8_t h[2] = { (uint8_t)kl, (uint8_t)(kl >> 8) };
+
+    return crc16(crc16(0xFFFF, h, 2), data, len);
+}
+
+
+// Returns 1 and the generation if the page has a valid header.
+static int kv_page_valid(uint8_t page, uint32_t *gen)
+{
+    uint32_t g = (uint32_t)kv_rd16(page, 0) | (uint32_t)kv_rd16(page, 2) << 16;
+
+    if (kv_rd16(page, 6) != KV_MAGIC || kv_rd16(page, 4) != crc16(0xFFFF, &g, 4)) return 0;
+    *gen = g;
+    return 1;
+}
+
+
+// Indexes the records of the active page.
+static void kv_scan(void)
+{
+    uint32_t o = KV_HDR_BYTES;
+
+    memset(kv.off, 0, sizeof(kv.off));
+    kv.dirty = 0;
+
+    while (o + KV_REC_BYTES(0) <= FLASH_PAGE_BYTES)
+    {
+        uint16_t commit = kv_rd16(kv.page, o), kl = kv_rd16(kv.page, o + 2);
+        uint8_t key = (uint8_t)kl, len = (uint8_t)(kl >> 8);
+
+        if (commit == 0xFFFF && kl == 0xFFFF) break;
+        if (key >= KV_KEYS || len > KV_VAL_MAX || o + KV_REC_BYTES(len) > FLASH_PAGE_BYTES ||
+            kv_rd16(kv.page, o + 4) != kv_rec_crc(kl, kv_ptr(kv.page, o + 6), len)) {
+            kv.dirty = 1;
+            break;
+        }
+        if (commit == 0) kv.off[key] = (uint16_t)o;
+        o += KV_REC_BYTES(len);
+    }
+    kv.end = (uint16_t)o;
+
+    // Power may have failed after the first halfwords of a record.
+    for (; !kv.dirty && o < FLASH_PAGE_BYTES; o += 2) {
+        if (kv_rd16(kv.page, o) != 0xFFFF) kv.dirty = 1;
+    }
+}
+
+
+// Finds the active page and indexes it.
+void kv_init(void)
+{
+    uint32_t g;
+
+    kv.page = KV_PAGES;
+    kv.gen = 0;
+    for (uint8_t p = 0; p < KV_PAGES; p++) {
+        if (kv_page_valid(p, &g) && (kv.page == KV_PAGES || (int32_t)(g - kv.gen) > 0)) {
+            kv.page = p;
+            kv.gen = g;
+        }
+    }
+    if (kv.page != KV_PAGES) kv_scan();
+}
+
+
+// Programs a committed record at offset o of a page.
+static int kv_write(uint8_t page, uint32_t o, uint8_t key, const uint8_t *data, uint8_t len)
+{
+    uintptr_t a = KV_PAGE_ADDR(page) + o;
+    uint16_t kl = (uint16_t)(key | len << 8);
+    uint16_t crc = kv_rec_crc(kl, data, len);
+    uint16_t commit = 0;
+    uint8_t buf[KV_VAL_MAX + 1];
+
+    memcpy(buf, data, len);
+    buf[len] = 0xFF;
+    return flash_program(a + 2, &kl, 2) && flash_program(a + 4, &crc, 2) &&
+           flash_program(a + 6, buf, (len + 1u) & ~1u) && flash_program(a, &commit, 2);
+}
+
+
+// Moves the latest record of every key to the other page and makes it the
+// active one. Returns 0 if the flash failed.
+static int kv_compact(void)
+{
+    uint8_t np = (kv.page == KV_PAGES) ? 0 : kv.page ^ 1;
+    uint32_t g = kv.gen + 1, o = KV_HDR_BYTES;
+    uint16_t off[KV_KEYS];
+    uint16_t crc = crc16(0xFFFF, &g, 4), magic = KV_MAGIC;
+
+    if (!flash_erase_page(KV_PAGE_ADDR(np))) return 0;
+
+    for (uint8_t k = 0; k < KV_KEYS; k++)
+    {
+        uint8_t len;
+
+        off[k] = 0;
+        if (kv.off[k] == 0) continue;
+        len = (uint8_t)(kv_rd16(kv.page, kv.off[k] + 2) >> 8);
+        if (!kv_write(np, o, k, kv_ptr(kv.page, kv.off[k] + 6), len)) return 0;
+        off[k] = (uint16_t)o;
+        o += KV_REC_BYTES(len);
+    }
+
+    if (!flash_program(KV_PAGE_ADDR(np), &g, 4) || !flash_program(KV_PAGE_ADDR(np) + 4, &crc, 2) ||
+        !flash_program(KV_PAGE_ADDR(np) + 6, &magic, 2)) return 0;
+
+    kv.page = np;
+    kv.gen = g;
+    kv.end = (uint16_t)o;
+    kv.dirty = 0;
+    memcpy(kv.off, off, sizeof(off));
+    return 1;
+}
+
+
+// Copies the value of key into buf (at most max bytes). Returns its length,
+// or -1 if the key has none.
+int kv_get(uint8_t key, void *buf, uint8_t max)
+{
+    uint8_t len;
+
+    if (key >= KV_KEYS || kv.page == KV_PAGES || kv.off[key] == 0) return -1;
+    len = (uint8_t)(kv_rd16(kv.page, kv.off[key] + 2) >> 8);
+    memcpy(buf, kv_ptr(kv.page, kv.off[key] + 6), len < max ? len : max);
+    return len;
+}
+
+
+// Sets the value of key. Returns 0 if it could not be stored (bad key or
+// length, no room even after compaction, flash error).
+int kv_set(uint8_t key, const void *data, uint8_t len)
+{
+    if (key >= KV_KEYS || len > KV_VAL_MAX) return 0;
+
+    // Unchanged: spare the flash.
+    if (kv.page != KV_PAGES && kv.off[key] != 0 &&
+        kv_rd16(kv.page, kv.off[key] + 2) >> 8 == len && memcmp(kv_ptr(kv.page, kv.off[key] + 6), data, len) == 0)
+        return 1;
+
+    if (kv.page == KV_PAGES || kv.dirty || kv.end + KV_REC_BYTES(len) > FLASH_PAGE_BYTES) {
+        if (!kv_compact()) {
+            kv_init();
+            return 0;
+        }
+    }
+    if (kv.end + KV_REC_BYTES(len) > FLASH_PAGE_BYTES) return 0;
+
+    if (!kv_write(kv.page, kv.end, key, data, len)) {
+        kv.dirty = 1;
+        return 0;
+    }
+    kv.off[key] = kv.end;
+    kv.end += KV_REC_BYTES(len);
+    return 1;
+}
+
+
+//---------- Settings --------------------
+//
+// What used to be compiled in, as key/value store entries (keys CFG_*, one
+// 32-bit value each). cfg_load() replaces the defaults in cfg[] with the
+// stored values at start-up, keeping a default where the stored value is
+// missing or out of range. cfg_set() stores a value and applies it: the
+// contrast, the resistance scale and the DAC control loop at once, the SPI
+// clock and the ADC sample time at the next reset (they are set while
+// bringing the peripherals up).
+
+static const struct { uint32_t min, max; } cfg_range[CFG_KEYS] = {
+    [CFG_CONTRAST] = { 0, 0xFF },
+    [CFG_SPI_BR]   = { 0, 7 },
+    [CFG_ADC_SMPR] = { 0, 7 },
+    [CFG_RES_OHMS] = { 1, 100000 },
+    [CFG_VIEW]       = { OLED_VIEW_TEXT, OLED_VIEW_LARGE },
+    [CFG_BAR_HZ_LO]  = { 0, 1000000 },
+    [CFG_BAR_HZ_HI]  = { 1, 1000000 },
+    [CFG_BAR_OHM_LO] = { 0, 100000 },
+    [CFG_BAR_OHM_HI] = { 1, 100000 },
+    [CFG_PI_HZ]      = { 0, 1000000 },
+};
+
+
+void cfg_load(void)
+{
+    uint32_t v;
+
+    for (uint8_t k = 0; k < CFG_KEYS; k++) {
+        if (kv_get(k, &v, sizeof(v)) == sizeof(v) && v >= cfg_range[k].min && v <= cfg_range[k].max) cfg[k] = v;
+    }
+    pi_configure(cfg[CFG_PI_HZ]);
+}
+
+
+// Returns 0 if v is out of range or could not be stored.
+int cfg_set(uint8_t key, uint32_t v)
+{
+    if (key >= CFG_KEYS || v < cfg_range[key].min || v > cfg_range[key].max) return 0;
+    if (!kv_set(key, &v, sizeof(v))) return 0;
+
+    cfg[key] = v;
+    if (key == CFG_CONTRAST) {
+        oled_Write_Cmd(0x81);
+        oled_Write_Cmd((unsigned char)v);
+    }
+    if (key == CFG_PI_HZ) pi_configure(v);
+    return 1;
+}
+
+
+//---------- DAC Calibration --------------------
+//
+// Maps DAC code to 555 frequency from a sweep of the real circuit. cal_start()
+// steps the DAC from 0 to full scale in CAL_POINTS steps of CAL_DAC_STEP
+// codes. At each step it waits CAL_SETTLE_MS and averages CAL_AVG readings
+// of the 555. The sweep is then fitted into a table that goes to the flash
+// page at CAL_PAGE_ADDR, where it survives resets:
+//
+//   fwd_mHz[i]   frequency at DAC code i * CAL_DAC_STEP. The last code
+//                measured is 4095; its point is extended to 4096, so the
+//                index is a shift. The points are made strictly monotonic
+//                in the curve's direction, so the inverse exists.
+//   inv_dac[k]   DAC code for the frequency k / (CAL_INV_N - 1) of the way
+//                from inv_lo_mHz to inv_hi_mHz. inv_scale turns a
+//                frequency into that position with one multiplication.
+//
+// cal_dac_to_mHz() and cal_mHz_to_dac() interpolate linearly between two
+// entries, so both directions cost the same few instructions at any point.
+// All the searching and division happens once, in cal_fit().
+//
+// Holding the USER button through reset starts a sweep. While it runs it
+// owns the DAC: task_adc_dac and the PI controller leave it alone.
+
+#define CAL_DAC_SHIFT     8u
+#define CAL_DAC_STEP      (1u << CAL_DAC_SHIFT)
+#define CAL_INV_N         65u
+#define CAL_SETTLE_MS     300u
+#define CAL_AVG_SHIFT     2u
+#define CAL_AVG           (1u << CAL_AVG_SHIFT)
+#define CAL_TIMEOUT_MS    3000u     // No 555 reading this long after settling
+#define CAL_MIN_SPAN_mHz  10000u    // Full-scale response the fit needs
+#define CAL_INV_SHIFT     38u       // inv_scale fits 32 bits for spans from 4096 mHz
+#define CAL_MAGIC         0x324C4143u   // "CAL2"
+#define CAL_PAGE_ADDR     (FLASH_DATA_ADDR + KV_PAGES * FLASH_PAGE_BYTES)
+
+// Outcome of a sweep (EVT_CAL_DONE a).
+#define CAL_OK            0
+#define CAL_NO_SIGNAL     1         // The 555 stopped giving readings
+#define CAL_FLAT          2         // The DAC barely moves the 555
+#define CAL_FLASH_ERROR   3
+
+typedef struct {
+    uint32_t magic;
+    uint32_t fwd_mHz[CAL_POINTS];
+    uint32_t inv_lo_mHz, inv_hi_mHz;
+    uint32_t inv_scale;             // (CAL_INV_N - 1) * 2^CAL_INV_SHIFT / (hi - lo)
+    uint16_t inv_dac[CAL_INV_N];
+    uint16_t pad;
+    uint32_t check;                 // FNV-1a of everything above
+} cal_table_t;
+
+// The table in flash, or NULL while there is no valid one.
+const cal_table_t *cal_tab;
+
+static struct {
+    uint32_t t0;                    // sys_ms the DAC was set
+    uint32_t seen;                  // freq_snap sequence number last taken
+    uint32_t sum;
+    uint8_t  n;                     // Readings summed at this point
+    uint8_t  skip;                  // Readings still to drop
+    uint32_t pts[CAL_POINTS];
+} cal;
+
+
+static uint32_t cal_check(const cal_table_t *t)
+{
+    const uint8_t *p = (const uint8_t *)t;
+    uint32_t h = 2166136261u;
+
+    for (uint32_t i = 0; i < offsetof(cal_table_t, check); i++) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+
+// Picks the table up from flash if the page holds a valid one.
+void cal_init(void)
+{
+    const cal_table_t *t = (const cal_table_t *)CAL_PAGE_ADDR;
+
+    cal_tab = (t->magic == CAL_MAGIC && t->check == cal_check(t)) ? t : NULL;
+}
+
+
+// Predicted 555 frequency (mHz) at a DAC code. Needs a table.
+uint32_t cal_dac_to_mHz(uint32_t code)
+{
+    const cal_table_t *t = cal_tab;
+    uint32_t i = (code & 0xFFFu) >> CAL_DAC_SHIFT;
+    uint32_t a = t->fwd_mHz[i], b = t->fwd_mHz[i + 1];
+    uint32_t frac = code & (CAL_DAC_STEP - 1);
+
+    // In 64 bits: a segment of more than 8.4 kHz times 255 overflows 31.
+    if (b >= a) return a + (uint32_t)(((uint64_t)(b - a) * frac) >> CAL_DAC_SHIFT);
+    return a - (uint32_t)(((uint64_t)(a - b) * frac) >> CAL_DAC_SHIFT);
+}
+
+
+// DAC code for a 555 frequency (mHz), clamped to the calibrated span. Needs
+// a table.
+uint32_t cal_mHz_to_dac(uint32_t mHz)
+{
+    const cal_table_t *t = cal_tab;
+    uint32_t pos, i;
+    int32_t d;
+
+    if (mHz <= t->inv_lo_mHz) return t->inv_dac[0];
+    if (mHz >= t->inv_hi_mHz) return t->inv_dac[CAL_INV_N - 1];
+
+    // Position in the table in 1/256ths of an entry.
+    pos = (uint32_t)(((uint64_t)(mHz - t->inv_lo_mHz) * t->inv_scale) >> (CAL_INV_SHIFT - 8));
+    i = pos >> 8;
+    if (i >= CAL_INV_N - 1) return t->inv_dac[CAL_INV_N - 1];
+    d = (int32_t)t->inv_dac[i + 1] - (int32_t)t->inv_dac[i];
+    return (uint32_t)((int32_t)t->inv_dac[i] + d * (int32_t)(pos & 0xFF) / 256);
+}
+
+
+// Fits the sweep in cal.pts into *t. Returns CAL_OK or CAL_FLAT.
+static int cal_fit(cal_table_t *t)
+{
+    uint32_t *f = t->fwd_mHz;
+    uint32_t lo, hi, span, seg = 0;
+    uint8_t up;
+
+    memset(t, 0xFF, sizeof(*t));
+    t->magic = CAL_MAGIC;
+    memcpy(f, cal.pts, sizeof(cal.pts));
+
+    // The last point was measured at 4095 rather than 4096.
+    f[CAL_POINTS - 1] += (int32_t)(f[CAL_POINTS - 1] - f[CAL_POINTS - 2]) / (int32_t)(CAL_DAC_STEP - 1);
+
+    up = f[CAL_POINTS - 1] > f[0];
+    for (uint32_t i = 1; i < CAL_POINTS; i++) {
+        if (up && f[i] <= f[i - 1]) f[i] = f[i - 1] + 1;
+        if (!up && f[i] >= f[i - 1]) f[i] = f[i - 1] - 1;
+    }
+    lo = up ? f[0] : f[CAL_POINTS - 1];
+    hi = up ? f[CAL_POINTS - 1] : f[0];
+    span = hi - lo;
+    if (span < CAL_MIN_SPAN_mHz) return CAL_FLAT;
+
+    t->inv_lo_mHz = lo;
+    t->inv_hi_mHz = hi;
+    t->inv_scale = (uint32_t)udiv64_32((uint64_t)(CAL_INV_N - 1) << CAL_INV_SHIFT, span);
+
+    // The frequencies of the inverse entries only go one way, and so does
+    // the segment they fall in.
+    for (uint32_t k = 0; k < CAL_INV_N; k++)
+    {
+        uint32_t target = lo + (uint32_t)udiv64_32((uint64_t)span * k, CAL_INV_N - 1);
+        uint32_t s, a, b, code;
+
+        // Segments in increasing frequency: seg counts from the low end.
+        for (;;) {
+            s = up ? seg : CAL_POINTS - 2 - seg;
+            a = up ? f[s] : f[s + 1];
+            b = up ? f[s + 1] : f[s];
+            if (target <= b || seg == CAL_POINTS - 2) break;
+            seg++;
+        }
+        code = (uint32_t)udiv64_32((uint64_t)(target - a) * CAL_DAC_STEP, b - a);
+        code = up ? (s << CAL_DAC_SHIFT) + code : ((s + 1) << CAL_DAC_SHIFT) - code;
+        t->inv_dac[k] = (uint16_t)(code > 0xFFFu ? 0xFFFu : code);
+    }
+    t->check = cal_check(t);
+    return CAL_OK;
+}
+
+
+// Drives the DAC to the code of the point being measured.
+static void cal_set_point(void)
+{
+    uint32_t code = (uint32_t)(cal_point - 1) << CAL_DAC_SHIFT;
+
+    DAC->DHR12R1 = code > 0xFFFu ? 0xFFFu : code;
+    cal.t0 = sys_ms;
+    cal.sum = 0;
+    cal.n = 0;
+    cal.skip = 1;       // Its span may reach back into the settling time
+}
+
+
+// Ends the sweep, logging how it went.
+static void cal_finish(int status, uint32_t b)
+{
+    cal_point = 0;
+    evt_log(EVT_CAL_DONE, (uint16_t)status, b);
+}
+
+
+// Starts a sweep. The previous table stays in use until a new one is written.
+void cal_start(void)
+{
+    if (cal_point != 0) return;
+    cal_point = 1;
+    cal_set_point();
+}
+
+
+// Calibration: advances a running sweep with the latest 555 reading.
+static void task_cal(void)
+{
+    static cal_table_t t;
+    meas_t m;
+    uint32_t seq;
+
+    if (cal_point == 0) return;
+
+    seq = snap_read(&freq_snap[FREQ_SEL_555], &m);
+    if (sys_ms - cal.t0 < CAL_SETTLE_MS) {
+        cal.seen = seq;
+        return;
+    }
+    if (seq == cal.seen || m.value == 0) {
+        if (sys_ms - cal.t0 > CAL_SETTLE_MS + CAL_TIMEOUT_MS) cal_finish(CAL_NO_SIGNAL, cal_point - 1u);
+        return;
+    }
+    cal.seen = seq;
+    cal.t0 = sys_ms - CAL_SETTLE_MS;        // Restart the timeout
+    if (cal.skip) {
+        cal.skip--;
+        return;
+    }
+
+    cal.sum += m.value;
+    if (++cal.n < CAL_AVG) return;
+
+    cal.pts[cal_point - 1] = cal.sum >> CAL_AVG_SHIFT;
+    evt_log(EVT_CAL_POINT, cal_point - 1u, cal.pts[cal_point - 1]);
+    if (cal_point < CAL_POINTS) {
+        cal_point++;
+        cal_set_point();
+        return;
+    }
+
+    if (cal_fit(&t) != CAL_OK) {
+        cal_finish(CAL_FLAT, 0);
+        return;
+    }
+    if (!flash_erase_page(CAL_PAGE_ADDR) || !flash_program(CAL_PAGE_ADDR, &t, sizeof(t)) ||
+        memcmp((const void *)CAL_PAGE_ADDR, &t, sizeof(t)) != 0) {
+        cal_init();
+        cal_finish(CAL_FLASH_ERROR, 0);
+        return;
+    }
+    cal_init();
+    cal_finish(CAL_OK, t.inv_hi_mHz - t.inv_lo_mHz);
+}
+
+
+//---------- Closed-Loop DAC Control --------------------
+//
+// In open loop (the default) task_adc_dac copies the potentiometer to the
+// DAC, and the 555 frequency drifts with the optocoupler's temperature and
+// supply. With pi_enable set, TIM16 runs a PI controller at PI_HZ instead.
+// It drives the DAC so that the 555's measured frequency holds a setpoint:
+// pi_fixed_mHz, or the potentiometer mapped onto PI_SP_MIN_HZ..PI_SP_MAX_HZ
+// when that is 0. Both come from the CFG_PI_HZ setting (pi_configure). The measurement comes from the measure task through
+// freq_snap[], so the handler never waits for it, and the controller acts
+// only on readings it has not seen yet.
+//
+// Fixed point: the error is in mHz; the gains are DAC counts per mHz in
+// Q(PI_Q); the integrator holds DAC counts in Q(PI_Q). Anti-windup is
+// conditional integration. The integrator stops while the output is
+// saturated and the error would push it further, and it is clamped to the
+// DAC range.
+//
+// With a calibration table (see DAC Calibration) the controller has two
+// degrees of freedom. The DAC code the table gives for the setpoint is fed
+// forward, so a step needs no integration. The error is then taken from a
+// reference that moves from the frequency at the step towards the
+// setpoint at the pace the 555 and the measurement can follow, which keeps
+// the proportional term from kicking. Without a table the reference is the
+// setpoint and the integrator carries the whole output.
+//
+// Every setpoint change larger than PI_STEP_MIN_PM of the new setpoint
+// starts a step. A step records its overshoot in permille of the step size
+// and its settling time: the time from the step to the first of
+// PI_SETTLE_N readings in a row that are all within PI_SETTLE_PM of the
+// setpoint. Both go into pi_metrics and out as EVT_PI_SETTLED.
+
+#define PI_HZ            20u        // Controller rate (TIM16 update)
+#define PI_Q             24u
+#define PI_DAC_MAX       0xFFFu
+#define PI_SP_MIN_HZ     200u       // Potentiometer setpoint range
+#define PI_SP_MAX_HZ     2000u
+#define PI_STEP_MIN_PM   20u
+#define PI_SETTLE_PM     10u
+#define PI_SETTLE_N      5u
+
+// 1 = closed loop (CFG_PI_HZ != 0). Read by the handler on every tick.
+volatile uint8_t pi_enable = 0;
+
+// Fixed setpoint in mHz, 0 = follow the potentiometer.
+volatile uint32_t pi_fixed_mHz = 0;
+
+// Gains (DAC counts per mHz of error, Q(PI_Q)), tuned on the hostsim plant:
+// 0.5 count/Hz proportional, and 0.5 count/Hz integral per reading.
+volatile int32_t pi_kp = (int32_t)((1u << PI_Q) / 2000u);
+volatile int32_t pi_ki = (int32_t)((1u << PI_Q) / 2000u);
+
+typedef struct {
+    uint32_t steps;             // Steps started
+    uint32_t sp_mHz;            // Setpoint of the last step
+    uint32_t settle_ms;         // Settling time of the last settled step
+    uint32_t overshoot_pm;      // Its overshoot, permille of the step size
+    uint8_t  settled;           // 1 once the last step has settled
+} pi_metrics_t;
+
+pi_metrics_t pi_metrics;
+
+static struct {
+    int64_t  integ;             // Integrator, DAC counts in Q(PI_Q)
+    int64_t  ff;                // Feedforward, DAC counts in Q(PI_Q)
+    uint32_t seen;              // freq_snap sequence number last acted on
+    uint32_t sp_mHz;            // Setpoint in use
+    uint32_t ref_mHz;           // Where the 555 should be by now
+    uint8_t  running;           // 0 until the first closed-loop tick
+    // Step being measured
+    uint32_t t0;                // sys_ms at the step
+    uint32_t from_mHz;          // Frequency at the step
+    uint32_t peak_pm;           // Overshoot so far
+    uint32_t in_band_t;         // sys_ms of the first reading of the current run in band
+    uint8_t  in_band_n;         // Readings in a row in band
+    uint8_t  tracking;          // 1 while the step has not settled
+} pi;
+
+
+// Copies pi_metrics with the handler held off.
+void pi_metrics_read(pi_metrics_t *out)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *out = pi_metrics;
+    __set_PRIMASK(primask);
+}
+
+
+// pi_init starts TIM16 at PI_HZ. The loop stays open until pi_enable is set.
+void pi_init(void)
+{
+    RCC->APB2ENR |= RCC_APB2ENR_TIM16EN;
+
+    // 1 kHz count, PI_HZ update.
+    TIM16->PSC = (uint16_t)(SystemCoreClock / 1000u - 1);
+    TIM16->ARR = 1000u / PI_HZ - 1;
+    TIM16->EGR = TIM_EGR_UG;
+    TIM16->SR = 0;
+    TIM16->DIER = TIM_DIER_UIE;
+
+    NVIC_SetPriority(TIM16_IRQn, 3);
+    NVIC_EnableIRQ(TIM16_IRQn);
+    TIM16->CR1 = TIM_CR1_CEN;
+}
+
+
+// pi_configure: 0 opens the loop, 1 follows the potentiometer, anything else
+// is a fixed setpoint in Hz. The setpoint is written first, so the handler
+// never closes the loop on the old one.
+void pi_configure(uint32_t hz)
+{
+    pi_fixed_mHz = (hz > 1u) ? hz * FREQ_SCALE : 0;
+    pi_enable = (hz != 0);
+}
+
+
+// Setpoint for this tick: the fixed one, or the potentiometer's position.
+static uint32_t pi_setpoint(void)
+{
+    meas_t pot;
+
+    if (pi_fixed_mHz != 0) return pi_fixed_mHz;
+    snap_read(&adc_snap, &pot);
+    return (PI_SP_MIN_HZ + (uint32_t)udiv64_32((uint64_t)pot.value * (PI_SP_MAX_HZ - PI_SP_MIN_HZ),
+                                                ADC_FILTERED_MAX)) * FREQ_SCALE;
+}
+
+
+// |a - b| in permille of d (d != 0).
+static uint32_t pi_pm(uint32_t a, uint32_t b, uint32_t d)
+{
+    return (uint32_t)udiv64_32((uint64_t)(a > b ? a - b : b - a) * 1000u, d);
+}
+
+
+// Follows the step in progress with a new reading.
+static void pi_track(uint32_t f_mHz)
+{
+    uint32_t sp = pi.sp_mHz;
+    uint32_t step = (sp > pi.from_mHz) ? sp - pi.from_mHz : pi.from_mHz - sp;
+
+    // Beyond the setpoint, on the far side from where the step started.
+    if (step != 0 && ((sp > pi.from_mHz && f_mHz > sp) || (sp < pi.from_mHz && f_mHz < sp))) {
+        uint32_t pm = pi_pm(f_mHz, sp, step);
+        if (pm > pi.peak_pm) pi.peak_pm = pm;
+    }
+
+    if (pi_pm(f_mHz, sp, sp) > PI_SETTLE_PM) {
+        pi.in_band_n = 0;
+        return;
+    }
+    if (pi.in_band_n++ == 0) pi.in_band_t = sys_ms;
+    if (pi.in_band_n < PI_SETTLE_N) return;
+
+    pi.tracking = 0;
+    pi_metrics.settle_ms = pi.in_band_t - pi.t0;
+    pi_metrics.overshoot_pm = pi.peak_pm;
+    pi_metrics.settled = 1;
+    evt_log(EVT_PI_SETTLED, (uint16_t)(pi.peak_pm > 0xFFFF ? 0xFFFF : pi.peak_pm), pi_metrics.settle_ms);
+}
+
+
+// One controller update from a new reading. Returns the DAC code.
+static uint32_t pi_update(uint32_t f_mHz)
+{
+    int32_t e = (int32_t)(pi.ref_mHz - f_mHz);
+    int64_t p = (int64_t)pi_kp * e;
+    int64_t i = pi.integ + (int64_t)pi_ki * e;
+    int64_t u = pi.ff + p + i;
+    const int64_t max = (int64_t)PI_DAC_MAX << PI_Q;
+
+    // Integrate only when that does not push a saturated output further.
+    if (!((u > max && e > 0) || (u < 0 && e < 0))) {
+        pi.integ = (i < -pi.ff) ? -pi.ff : (i > max - pi.ff) ? max - pi.ff : i;
+    }
+
+    // The reference closes half its distance to the setpoint per reading.
+    pi.ref_mHz += (int32_t)(pi.sp_mHz - pi.ref_mHz) / 2;
+    if (pi.ref_mHz + 1 == pi.sp_mHz || pi.ref_mHz == pi.sp_mHz + 1) pi.ref_mHz = pi.sp_mHz;
+
+    u = pi.ff + p + pi.integ;
+    if (u < 0) return 0;
+    if (u > max) return PI_DAC_MAX;
+    return (uint32_t)(u >> PI_Q);
+}
+
+
+// Moves to setpoint sp with the 555 at f_mHz (0 = no reading yet). With a
+// calibration table the output jumps to the predicted code and the
+// reference follows from f_mHz; the integrator keeps only what the table
+// is off by.
+static void pi_retarget(uint32_t sp, uint32_t f_mHz)
+{
+    pi.sp_mHz = sp;
+    pi.ref_mHz = (cal_tab && f_mHz != 0) ? f_mHz : sp;
+    pi.ff = cal_tab ? (int64_t)cal_mHz_to_dac(sp) << PI_Q : 0;
+}
+
+
+// TIM16_IRQHandler runs the controller at PI_HZ while the loop is closed.
+
+void TIM16_IRQHandler()
+{
+    evt_log(EVT_ISR_ENTER, TIM16_IRQn, 0);
+
+    TIM16->SR = 0;
+    if (!pi_enable || cal_point != 0) {
+        pi.running = 0;
+    }
+    else
+    {
+        meas_t f;
+        uint32_t seq = snap_read(&freq_snap[FREQ_SEL_555], &f);
+        uint32_t sp = pi_setpoint();
+
+        // Without a calibration table the integrator takes over the
+        // open-loop output (bumpless).
+        if (!pi.running) {
+            pi_retarget(sp, f.value);
+            pi.integ = cal_tab ? 0 : (int64_t)(DAC->DHR12R1 & PI_DAC_MAX) << PI_Q;
+            pi.seen = seq;
+            pi.running = 1;
+        }
+
+        if (sp != pi.sp_mHz)
+        {
+            uint8_t step = f.value != 0 && pi_pm(sp, pi.sp_mHz, sp) > PI_STEP_MIN_PM;
+
+            if (step) {
+                pi.t0 = sys_ms;
+                pi.from_mHz = f.value;
+                pi.peak_pm = 0;
+                pi.in_band_n = 0;
+                pi.tracking = 1;
+                pi_metrics.steps++;
+                pi_metrics.sp_mHz = sp;
+                pi_metrics.settled = 0;
+            }
+            pi_retarget(sp, step ? f.value : 0);
+        }
+
+        if (seq != pi.seen && f.value != 0)
+        {
+            pi.seen = seq;
+            DAC->DHR12R1 = pi_update(f.value);
+            if (pi.tracking) pi_track(f.value);
+        }
+    }
+
+    evt_log(EVT_ISR_EXIT, TIM16_IRQn, 0);
+}
+
+
+// myGPIOA_Init configures PA0 as an input for the USER button and hands PA1/PA2
+// to TIM2 (alternate function 2) as capture inputs, all without pull resistors.
+
+void myGPIOA_Init()
+{
+    /* Enable the clock*/
+    RCC->AHBENR |= RCC_AHBENR_GPIOAEN;
+
+    /* Configure PA0 as input pin by clearing its mode bits (00 = input). */
+    GPIOA->MODER &= ~(GPIO_MODER_MODER0);  // Set PA0 as input (clear MODER bits for PA0)
+
+    /* Configure PA1 and PA2 as alternate function (10) and select AF2 (TIM2_CH2/CH3). */
+    GPIOA->MODER &= ~(GPIO_MODER_MODER1 | GPIO_MODER_MODER2);
+    GPIOA->MODER |= (GPIO_MODER_MODER1_1 | GPIO_MODER_MODER2_1);
+    GPIOA->AFR[0] &= ~(GPIO_AFRL_AFRL1 | GPIO_AFRL_AFRL2);
+    GPIOA->AFR[0] |= (2u << 4) | (2u << 8);
+
+    /* Ensure that no pull-up or pull-down resistors are enabled for PA0-PA2.
+       - 00 = No pull-up, pull-down */
+    GPIOA->PUPDR &= ~(GPIO_PUPDR_PUPDR2);  // No pull-up/pull-down for PA2
+    GPIOA->PUPDR &= ~(GPIO_PUPDR_PUPDR1);  // No pull-up/pull-down for PA1
+    GPIOA->PUPDR &= ~(GPIO_PUPDR_PUPDR0);  // No pull-up/pull-down for PA0
+}
+
+
+//---------- Button --------------------
+//
+// The USER button bounces for a few milliseconds on every press and release.
+// The first edge masks EXTI line 0 and starts a BTN_DEBOUNCE_MS countdown
+// in SysTick, so a bounce storm costs one interrupt. When it runs out PA0 is
+// sampled once: a level different from the last settled one is a press or a
+// release, the same level means the edges were noise. Only then is the line
+// unmasked again.
+//
+// The button acts on release: a short press switches the displayed input,
+// one held BTN_VIEW_MS or more the OLED layout (CFG_VIEW), one held
+// BTN_LONG_MS or more the low-power mode. A press held through reset (which
+// starts a calibration sweep) does nothing when released.
+
+#define BTN_DEBOUNCE_MS 20u
+#define BTN_VIEW_MS     400u
+#define BTN_LONG_MS     1000u
+
+static volatile uint8_t btn_wait = 0;   // Milliseconds left to settle (0 = idle)
+static uint8_t btn_level = 0;           // Last settled level of PA0 (1 = pressed)
+static uint8_t btn_down = 0;            // 1 if the press was seen settling
+static uint32_t btn_down_ms;            // sys_ms when it settled
+volatile uint32_t btn_irqs = 0;         // EXTI interrupts taken
+volatile uint32_t btn_rejected = 0;     // Debounce windows that ended at the old level
+
+
+// myEXTI_Init configures the external interrupt for the USER button on PA0.
+// The signal inputs no longer use EXTI; their edges are captured by TIM2.
+// Both edges interrupt, so the debounce sees the release as well.
+
+void myEXTI_Init()
+{
+    /* Map EXTI line 0 to PA0. */
+    SYSCFG->EXTICR[0] = 0x00000000;
+
+    /* Start from the level the button has now (it may be held from reset). */
+    btn_level = (GPIOA->IDR & GPIO_IDR_0) != 0;
+
+    /* Configure EXTI line 0 to trigger on both edges (USER button). */
+    EXTI->RTSR |= EXTI_RTSR_TR0;
+    EXTI->FTSR |= EXTI_FTSR_TR0;
+
+    /* Enable interrupts on EXTI line 0.*/
+    EXTI->IMR |= EXTI_IMR_MR0;
+
+    /* Set the priority of EXTI0_1 interrupt line to the highest (0),*/
+    NVIC_SetPriority(EXTI0_1_IRQn, 0);
+
+    /* Enable interrupts in the NVIC */
+    NVIC_EnableIRQ(EXTI0_1_IRQn);
+}
+
+
+// EXTI0_1_IRQHandler handles the external interrupt on EXTI line 0 (PA0).
+
+void EXTI0_1_IRQHandler()
+{
+    evt_log(EVT_ISR_ENTER, EXTI0_1_IRQn, 0);
+
+    /* Check if EXTI0 interrupt pending flag is set.
+       This flag indicates that PA0 (connected to EXTI0) changed level.*/
+    if ((EXTI->PR & EXTI_PR_PR0) != 0)
+    {
+        // Ignore the bounces until the level has settled.
+        EXTI->IMR &= ~EXTI_IMR_MR0;
+        EXTI->PR = EXTI_PR_PR0;
+        btn_irqs++;
+        btn_wait = BTN_DEBOUNCE_MS;
+    }
+
+    evt_log(EVT_ISR_EXIT, EXTI0_1_IRQn, 0);
+}
+
+
+// Called from SysTick_Handler: counts the debounce window down and acts on
+// the settled level. EXTI0 preempts SysTick, so btn_wait is only written
+// here while the line is masked.
+
+void btn_tick(void)
+{
+    uint8_t level;
+
+    if (btn_wait == 0 || --btn_wait != 0) return;
+
+    level = (GPIOA->IDR & GPIO_IDR_0) != 0;
+    if (level == btn_level) {
+        btn_rejected++;
+    } else {
+        btn_level = level;
+        if (level) {
+            btn_down = 1;
+            btn_down_ms = sys_ms;
+        }
+        else if (btn_down) {
+            btn_down = 0;
+            if (sys_ms - btn_down_ms >= BTN_LONG_MS) {
+                pwr_low_want ^= 1;
+            } else if (sys_ms - btn_down_ms >= BTN_VIEW_MS) {
+                oled_view_next = 1;
+            } else {
+                //Switch the displayed input between the 555 timer and the
+                //function generator; both keep being measured.
+                freq_sel ^= FREQ_SEL_555;
+                evt_log(EVT_BUTTON, freq_sel, 0);
+            }
+        }
+    }
+
+    EXTI->PR = EXTI_PR_PR0;
+    EXTI->IMR |= EXTI_IMR_MR0;
+
+    // An edge between the sample and the unmask left no pending flag.
+    if (((GPIOA->IDR & GPIO_IDR_0) != 0) != btn_level) {
+        EXTI->IMR &= ~EXTI_IMR_MR0;
+        btn_wait = BTN_DEBOUNCE_MS;
+    }
+}
+
+void SystemClock48MHz(void)
+{
+    // Disable the PLL to allow configuration
+    RCC->CR &= ~(RCC_CR_PLLON);
+
+    // Wait until the PLL is completely turned off and unlocked
+    while ((RCC->CR & RCC_CR_PLLRDY) != 0);
+
+    // Configure the PLL for a 48 MHz system clock
+    RCC->CFGR = 0x00280000;
+
+    // Enable the PLL after configuring it
+    RCC->CR |= RCC_CR_PLLON;
+
+    // Wait until the PLL is locked and ready for use
+    // This ensures the PLL has stabilized at the configured frequency.
+    while ((RCC->CR & RCC_CR_PLLRDY) != RCC_CR_PLLRDY);
+
+    // Switch the system clock source to the PLL
+    // The processor will start using the 48 MHz PLL output as the main clock source.
+    RCC->CFGR = (RCC->CFGR & (~RCC_CFGR_SW_Msk)) | RCC_CFGR_SW_PLL;
+
+    // Update the SystemCoreClock global variable to reflect the new clock frequency
+    // This function adjusts the system clock value in software to match the 48 MHz setting.
+    SystemCoreClockUpdate();
+}
+
+//---------- Power Management --------------------
+//
+// The main loop calls pwr_idle() whenever no task is due. Normally that is
+// Sleep: WFI with every clock running, so TIM2 and the DMA keep capturing
+// and the next interrupt (the 1 ms SysTick at the latest) resumes the loop.
+//
+// In low-power mode (a long press of USER) the display is off, and the core
+// goes into Stop once every input with a signal (a reading before, or an
+// edge since it woke up) has published a reading since it last woke up, or
+// PWR_AWAKE_MAX_MS after that without one, at the next tick of the RTC. Stop
+// halts the PLL, HSI, TIM2, SysTick and the DMA. The RTC runs on, on the
+// LSI, and its alarm A (EXTI line 17) wakes the core once a second, as does
+// the USER button (EXTI line 0). A reading is always taken within one awake
+// stretch: freq_capture_resume() starts both inputs over after every Stop,
+// so none spans one. Stop also waits for the telemetry DMA and USART, the
+// OLED transport and a debounce to finish, and is not used while the PI
+// controller or a calibration sweep owns the DAC.
+//
+// The core wakes on HSI (8 MHz), and SystemClock48MHz() brings the PLL back;
+// that restart is timed by TIM2 and counted as its own state. Sleep is
+// timed by TIM2 across the WFI, with interrupts masked so that their
+// handlers count as running. Stop is timed by the RTC's sub-second counter,
+// converted to TIM2 ticks at a rate measured against TIM2 while awake (the
+// LSI is only good to some tens of percent). Run is the rest of TIM2's time.
+// sys_ms is moved on by the Stop time, and the tasks are released afresh on
+// wake-up instead of being counted as skipped. task_stats sends the totals
+// as TM_POWER once a second; the energy of one reading is then the sum of
+// each state's time times its current, over `readings`.
+
+#define PWR_AWAKE_MAX_MS  1000u     // Longest wait for readings before Stop anyway
+#define PWR_HSI_HZ        8000000u  // Clock the core wakes up on
+#define PWR_RTC_PREDIV_A  99u       // LSI (40 kHz nominal) / 100 = sub-second units
+#define PWR_RTC_PREDIV_S  399u      // 400 units per RTC second
+#define PWR_RTC_UNITS     (PWR_RTC_PREDIV_S + 1u)
+#define PWR_RTC_DAY       (86400u * PWR_RTC_UNITS)
+#define PWR_CAL_MIN       40u       // Awake RTC units for a first measure of its rate
+#define PWR_CAL_UNITS     400u      // and for each one after that
+
+// pwr_ticks[] slots; running time is what TIM2 counted besides these.
+enum { PWR_SLEEP, PWR_STOP, PWR_WAKE };
+
+static uint64_t pwr_ticks[3];       // TIM2 ticks: Sleep and Stop at 48 MHz, wake-ups at 8 MHz
+static uint32_t pwr_wake_max;       // Longest wake-up, TIM2 ticks at 8 MHz
+static uint32_t pwr_stops = 0;
+static uint32_t pwr_rtc_ticks = 0;  // TIM2 ticks per RTC unit (0 = not measured yet)
+static uint64_t pwr_ms_rem = 0;     // Stop ticks not yet added to sys_ms
+static uint32_t pwr_wake_ms;        // sys_ms at the last wake-up
+static uint32_t pwr_wake_seq[2];    // freq_in[].seq then
+static uint64_t pwr_cal_t;          // tim2_now64() at the last wake-up
+static uint32_t pwr_cal_rtc;        // pwr_rtc_now() then
+static uint64_t pwr_cal_ticks;      // TIM2 ticks and RTC units awake, not measured yet
+static uint32_t pwr_cal_units;
+static uint32_t pwr_edge_rtc = PWR_RTC_DAY; // pwr_rtc_now() when Stop was first due, PWR_RTC_DAY = not due
+
+static void scheduler_init(void);
+
+
+// RTC time of day in sub-second units. The shadow registers are bypassed
+// (they would need a resync after every Stop), so SSR and TR are read until
+// two reads agree.
+static uint32_t pwr_rtc_now(void)
+{
+    uint32_t tr, ssr, sec;
+
+    do {
+        ssr = RTC->SSR;
+        tr = RTC->TR;
+    } while (ssr != RTC->SSR || tr != RTC->TR);
+
+    sec = ((tr >> 20) & 3u) * 36000u + ((tr >> 16) & 0xFu) * 3600u
+        + ((tr >> 12) & 7u) * 600u + ((tr >> 8) & 0xFu) * 60u
+        + ((tr >> 4) & 7u) * 10u + (tr & 0xFu);
+    return sec * PWR_RTC_UNITS + (PWR_RTC_PREDIV_S - ssr);
+}
+
+
+// RTC units from `then` to `now`, across midnight.
+static inline uint32_t pwr_rtc_since(uint32_t now, uint32_t then)
+{
+    return (now >= then) ? now - then : now + PWR_RTC_DAY - then;
+}
+
+
+// Starts a new awake stretch: what Stop waits for is counted from here.
+static void pwr_mark_wake(void)
+{
+    pwr_wake_ms = sys_ms;
+    pwr_wake_seq[0] = freq_in[0].seq;
+    pwr_wake_seq[1] = freq_in[1].seq;
+}
+
+
+// pwr_init starts the RTC on the LSI with alarm A every second, routed to
+// EXTI line 17 so that it can end a Stop.
+
+void pwr_init(void)
+{
+    RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+    PWR->CR |= PWR_CR_DBP;              // Backup domain (RTC) writable
+
+    RCC->CSR |= RCC_CSR_LSION;
+    while ((RCC->CSR & RCC_CSR_LSIRDY) == 0);
+    RCC->BDCR = (RCC->BDCR & ~RCC_BDCR_RTCSEL) | RCC_BDCR_RTCSEL_1 | RCC_BDCR_RTCEN;
+
+    RTC->WPR = 0xCA;                    // Unlock the RTC registers
+    RTC->WPR = 0x53;
+    RTC->ISR |= RTC_ISR_INIT;
+    while ((RTC->ISR & RTC_ISR_INITF) == 0);
+    RTC->PRER = PWR_RTC_PREDIV_S;       // Two writes, synchronous divider first
+    RTC->PRER |= PWR_RTC_PREDIV_A << 16;
+    RTC->TR = 0;
+    RTC->CR = RTC_CR_BYPSHAD;
+    RTC->ISR &= ~RTC_ISR_INIT;
+
+    // Alarm A on every second: all time fields masked, no sub-seconds compared.
+    while ((RTC->ISR & RTC_ISR_ALRAWF) == 0);
+    RTC->ALRMAR = RTC_ALRMAR_MSK4 | RTC_ALRMAR_MSK3 | RTC_ALRMAR_MSK2 | RTC_ALRMAR_MSK1;
+    RTC->ALRMASSR = 0;
+    RTC->CR |= RTC_CR_ALRAIE | RTC_CR_ALRAE;
+    RTC->WPR = 0xFF;                    // Lock again
+
+    EXTI->IMR |= EXTI_IMR_MR17;
+    EXTI->RTSR |= EXTI_RTSR_TR17;
+    NVIC_SetPriority(RTC_IRQn, 3);
+    NVIC_EnableIRQ(RTC_IRQn);
+
+    pwr_cal_t = tim2_now64();
+    pwr_cal_rtc = pwr_rtc_now();
+    pwr_mark_wake();
+}
+
+
+// The alarm only has to end a Stop. The alarm flags can be cleared while
+// the RTC is locked; INIT is written as 0.
+
+void RTC_IRQHandler(void)
+{
+    evt_log(EVT_ISR_ENTER, RTC_IRQn, 0);
+    RTC->ISR = ~(RTC_ISR_ALRAF | RTC_ISR_INIT);
+    EXTI->PR = EXTI_PR_PR17;
+    evt_log(EVT_ISR_EXIT, RTC_IRQn, 0);
+}
+
+
+// 1 once the awake stretch has done its work and nothing needs a clock.
+static int pwr_stop_ready(void)
+{
+    if (pi_enable || cal_point != 0 || btn_wait != 0) return 0;
+    if (tm_busy != 0 || tm_head != tm_tail || !(USART1->ISR & USART_ISR_TC)) return 0;
+    if (oled_q_active) return 0;
+    if (sys_ms - pwr_wake_ms >= PWR_AWAKE_MAX_MS) return 1;
+
+    // An input with edges captured since the wake-up gets its first gate
+    // too, or one connected while the core was in Stop never has a reading.
+    for (uint8_t i = 0; i < 2; i++) {
+        const ic_stream_t *s = (i == FREQ_SEL_555) ? &ic_555 : &ic_fg;
+        if ((freq_in[i].mHz != 0 || s->primed) && freq_in[i].seq == pwr_wake_seq[i]) return 0;
+    }
+    return 1;
+}
+
+
+// 1 once the RTC's sub-second count has moved on since Stop was first due.
+// The main loop idles at least every SysTick, so Stop begins within 1 ms of
+// a unit edge, as the stretch began on one (the alarm): the units counted
+// awake are whole, where a Stop anywhere in a unit left the rate up to a
+// unit of some 40 high.
+static int pwr_rtc_edge(void)
+{
+    uint32_t rtc = pwr_rtc_now();
+
+    if (pwr_edge_rtc == PWR_RTC_DAY) pwr_edge_rtc = rtc;
+    if (rtc == pwr_edge_rtc) return 0;
+    pwr_edge_rtc = PWR_RTC_DAY;
+    return 1;
+}
+
+
+// Sleep until the next interrupt, timed by TIM2.
+static void pwr_sleep(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t t0;
+
+    // WFI still wakes on an interrupt that PRIMASK holds off; it runs once
+    // the time is taken.
+    __disable_irq();
+    t0 = TIM2->CNT;
+    __WFI();
+    pwr_ticks[PWR_SLEEP] += (uint32_t)(TIM2->CNT - t0);
+    __set_PRIMASK(primask);
+}
+
+
+// Stop until the RTC alarm or the USER button, then the 48 MHz clock back
+// and a fresh start for the readings and the tasks.
+static void pwr_stop(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t ms = SystemCoreClock / 1000u;
+    uint32_t rtc = pwr_rtc_now();
+    uint32_t rate, c0, lock, n;
+    uint64_t stop;
+
+    // Rate of the RTC against TIM2, over the time spent awake since the last
+    // measurement. Until there is one, the LSI is taken at its nominal 40 kHz.
+    pwr_cal_ticks += tim2_now64() - pwr_cal_t;
+    pwr_cal_units += pwr_rtc_since(rtc, pwr_cal_rtc);
+    if (pwr_cal_units >= PWR_CAL_UNITS || (pwr_rtc_ticks == 0 && pwr_cal_units >= PWR_CAL_MIN)) {
+        rate = (uint32_t)udiv64_32(pwr_cal_ticks, pwr_cal_units);
+        pwr_rtc_ticks = pwr_rtc_ticks ? pwr_rtc_ticks - (pwr_rtc_ticks >> 2) + (rate >> 2) : rate;
+        pwr_cal_ticks = 0;
+        pwr_cal_units = 0;
+    }
+    rate = pwr_rtc_ticks ? pwr_rtc_ticks : SystemCoreClock / (40000u / (PWR_RTC_PREDIV_A + 1u));
+
+    __disable_irq();
+    PWR->CR = (PWR->CR & ~PWR_CR_PDDS) | PWR_CR_LPDS | PWR_CR_CWUF;
+    SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+    __WFI();
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+    // Back on HSI: TIM2 counts at 8 MHz until the PLL is in again.
+    c0 = TIM2->CNT;
+    SystemClock48MHz();
+    lock = TIM2->CNT - c0;
+    pwr_ticks[PWR_WAKE] += lock;
+    if (lock > pwr_wake_max) pwr_wake_max = lock;
+
+    stop = (uint64_t)pwr_rtc_since(pwr_rtc_now(), rtc) * rate;
+    pwr_ticks[PWR_STOP] += stop;
+    pwr_ms_rem += stop;
+    n = (uint32_t)udiv64_32(pwr_ms_rem, ms);
+    pwr_ms_rem -= (uint64_t)n * ms;
+    sys_ms += n;
+    pwr_stops++;
+    __set_PRIMASK(primask);
+
+    freq_capture_resume();
+    scheduler_init();
+    pwr_cal_t = tim2_now64();
+    pwr_cal_rtc = pwr_rtc_now();
+    pwr_mark_wake();
+}
+
+
+// pwr_idle also makes the mode change a long press asked for, once the
+// display command is queued.
+
+void pwr_idle(void)
+{
+    if (pwr_low != pwr_low_want && oled_Write_Cmd(pwr_low_want ? 0xAE : 0xAF)) {
+        pwr_low = pwr_low_want;
+        evt_log(EVT_POWER_MODE, pwr_low, 0);
+        pwr_mark_wake();
+    }
+
+    if (!pwr_low || !pwr_stop_ready()) pwr_edge_rtc = PWR_RTC_DAY;
+    else if (pwr_rtc_edge()) {
+        pwr_stop();
+        return;
+    }
+    pwr_sleep();
+}
+
+
+// Sends the time spent in each state so far (task_stats).
+static void pwr_report(void)
+{
+    uint32_t ms = SystemCoreClock / 1000u;
+    uint64_t run = tim2_now64() - pwr_ticks[PWR_SLEEP] - pwr_ticks[PWR_WAKE];
+    tm_power_t p = { 0 };
+
+    p.low = pwr_low;
+    p.run_ms = (uint32_t)udiv64_32(run, ms);
+    p.sleep_ms = (uint32_t)udiv64_32(pwr_ticks[PWR_SLEEP], ms);
+    p.stop_ms = (uint32_t)udiv64_32(pwr_ticks[PWR_STOP], ms);
+    p.wake_us = (uint32_t)udiv64_32(pwr_ticks[PWR_WAKE], PWR_HSI_HZ / 1000000u);
+    p.wake_max_us = pwr_wake_max / (PWR_HSI_HZ / 1000000u);
+    p.stops = pwr_stops;
+    p.readings = freq_in[0].seq + freq_in[1].seq;
+    tm_send(TM_POWER, &p, sizeof(p));
+}
+
+//---------- Rate-Monotonic Task Scheduler --------------------
+//
+// Each subsystem runs as a periodic task from a static table. The table is
+// kept in rate-monotonic order (shortest period first) and the scheduler
+// always runs the first task that is due, so faster tasks win when several
+// are released together. Tasks run to completion; when nothing is due
+// pwr_idle() sleeps until the next interrupt (see Power Management).
+//
+// A job that finishes after its relative deadline counts as an overrun. If a
+// task is still not started a whole period after its release, the missed
+// releases are dropped (counted in `skipped`) instead of running back to back.
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+    uint32_t period_ms;     // Release interval
+    uint32_t deadline_ms;   // Relative deadline (<= period)
+    uint32_t next_release;  // sys_ms of the next release
+    uint32_t runs;          // Jobs completed
+    uint32_t overruns;      // Jobs that finished after their deadline
+    uint32_t skipped;       // Releases dropped because the task fell a period behind
+    uint32_t max_exec_us;   // Longest observed execution time
+} task_t;
+
+
+// ADC -> DAC update: take the latest oversampled reading and drive the DAC.
+static void task_adc_dac(void)
+{
+    // Take the latest oversampled reading; the ADC samples on its own
+    // at ADC_SAMPLE_HZ, independent of how often this task runs.
+    meas_t m;
+    uint32_t ADC1FilteredVal;
+
+    snap_read(&adc_snap, &m);
+    ADC1FilteredVal = m.value;
+
+    // Convert the 14-bit ADC value to a resistance value (in ohms)
+    Res = (ADC1FilteredVal * cfg[CFG_RES_OHMS]) / ADC_FILTERED_MAX;
+
+    // What the 555 runs at with the DAC following the potentiometer
+    Freq_pred_mHz = cal_tab ? cal_dac_to_mHz(ADC1FilteredVal >> ADC_OVERSAMPLE_SHIFT) : 0;
+
+    // Set the DAC output to the reading scaled back to 12 bits
+    // This outputs an analog voltage proportional to the potentiometer reading
+    // (open loop only; the PI controller or a calibration sweep own the DAC otherwise)
+    if (!pi_enable && cal_point == 0) {
+        DAC->DHR12R1 = ADC1FilteredVal >> ADC_OVERSAMPLE_SHIFT;
+    }
+}
+
+
+static void task_stats(void);
+
+static task_t tasks[] = {
+    { .name = "adc_dac", .run = task_adc_dac,       .period_ms = 2,    .deadline_ms = 2 },
+    { .name = "trace",   .run = evt_drain,          .period_ms = 5,    .deadline_ms = 5 },
+    { .name = "measure", .run = freq_capture_poll,  .period_ms = 10,   .deadline_ms = 10 },
+    { .name = "cal",     .run = task_cal,           .period_ms = 10,   .deadline_ms = 10 },
+    { .name = "telem",   .run = adc_send_batch,     .period_ms = 10,   .deadline_ms = 10 },
+    { .name = "display", .run = refresh_OLED,       .period_ms = 100,  .deadline_ms = 100 },
+    { .name = "stats",   .run = task_stats,         .period_ms = 1000, .deadline_ms = 1000 },
+};
+
+#define NUM_TASKS (sizeof(tasks) / sizeof(tasks[0]))
+
+
+// Statistics: reports the scheduler and display counters once per period
+// as trace events, and the statistics windows, link counters and power
+// states on the telemetry stream.
+static void task_stats(void)
+{
+    stats_t *const windows[3] = { &stats_555, &stats_fg, &stats_res };
+
+    for (uint8_t i = 0; i < 3; i++) {
+        stats_snap_t snap;
+        tm_stats_t t = { 0 };
+
+        stats_read(windows[i], &snap);
+        t.which = i;
+        t.log2 = snap.log2;
+        t.count = snap.count;
+        t.min = snap.min;
+        t.max = snap.max;
+        t.sum = snap.sum;
+        t.nm2 = snap.nm2;
+        tm_send(TM_STATS, &t, sizeof(t));
+    }
+    tm_send(TM_LINK, &tm_link, sizeof(tm_link));
+    pwr_report();
+
+    for (uint8_t i = 0; i < NUM_TASKS; i++) {
+        evt_log(EVT_TASK_STAT, i, tasks[i].max_exec_us);
+        evt_log(EVT_TASK_OVERRUN, i, tasks[i].overruns);
+        evt_log(EVT_TASK_SKIP, i, tasks[i].skipped);
+    }
+    evt_log(EVT_OLED_SENT, 0, oled_bytes_sent);
+    evt_log(EVT_OLED_SKIPPED, 0, oled_bytes_skipped);
+    evt_log(EVT_OLED_QUEUE, (uint16_t)oled_q_peak, oled_q_rejected);
+    evt_log(EVT_EDGE_REJECT, FREQ_SEL_555, ic_555.rejected);
+    evt_log(EVT_EDGE_REJECT, FREQ_SEL_FG, ic_fg.rejected);
+    evt_log(EVT_EDGE_REJECT, 2, btn_rejected);
+
+    // How far the 555 has drifted from the calibration (open loop only)
+    if (Freq_pred_mHz != 0 && !pi_enable && cal_point == 0 && freq_in[FREQ_SEL_555].mHz != 0) {
+        uint32_t f = freq_in[FREQ_SEL_555].mHz, p = Freq_pred_mHz;
+        int32_t pm = (int32_t)udiv64_32((uint64_t)(f > p ? f - p : p - f) * 1000u, p);
+
+        if (pm > 0x7FFF) pm = 0x7FFF;
+        evt_log(EVT_CAL_DEV, (uint16_t)(f > p ? pm : -pm), p);
+    }
+}
+
+
+// Runs the highest priority task that is due. Returns 0 if none was.
+static int scheduler_run_once(void)
+{
+    uint32_t now = sys_ms;
+
+    for (uint8_t i = 0; i < NUM_TASKS; i++)
+    {
+        task_t *t = &tasks[i];
+        uint32_t late = now - t->next_release;
+
+        // Not released yet (signed distance keeps this correct across wrap).
+        if ((int32_t)late < 0) continue;
+
+        // Drop whole periods we have already missed.
+        if (late >= t->period_ms) {
+            uint32_t missed = late / t->period_ms;
+            t->skipped += missed;
+            t->next_release += missed * t->period_ms;
+        }
+
+        uint32_t start = micros();
+        t->run();
+        uint32_t exec = micros() - start;
+
+        if (exec > t->max_exec_us) t->max_exec_us = exec;
+        if ((int32_t)(sys_ms - (t->next_release + t->deadline_ms)) > 0) t->overruns++;
+
+        t->runs++;
+        t->next_release += t->period_ms;
+        return 1;
+    }
+    return 0;
+}
+
+
+// Releases every task for the first time at the current tick.
+static void scheduler_init(void)
+{
+    for (uint8_t i = 0; i < NUM_TASKS; i++) {
+        tasks[i].next_release = sys_ms;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Configure the system clock to 48 MHz
+    SystemClock48MHz();
+
+    // Load the settings kept in flash before bringing up what uses them
+    kv_init();
+    cfg_load();
+
+    // Start the 1 ms SysTick time base used by delay_ms() and the scheduler
+    SysTick_Init();
+
+    // Initialize GPIOA for input
+    myGPIOA_Init();
+
+    // Configure the ADC for potentiometer readings
+    ADC_Config();
+
+    // Configure the DAC to output values based on ADC input
+    DAC_Config();
+
+    // Initialize TIM2 input capture with DMA (frequency measurement)
+    myTIM2_Init();
+
+    // Use the DAC calibration in flash; holding USER through reset redoes it
+    cal_init();
+    if (GPIOA->IDR & GPIO_IDR_0) {
+        cal_start();
+    }
+
+    // Start the DAC controller tick (the loop stays open until pi_enable)
+    pi_init();
+
+    // Record the clock speed; TIM2 now provides the event timestamps
+    evt_log(EVT_BOOT, 0, SystemCoreClock);
+
+    // Start the telemetry stream on USART1
+    tm_init();
+
+    // Initialize the external interrupt for EXTI0 (User Button)
+    myEXTI_Init();
+
+    // Start the RTC that ends a Stop in low-power mode
+    pwr_init();
+
+    // Configure the OLED display
+    oled_config();
+
+    // Start the periodic tasks
+    scheduler_init();
+
+    // Enter an infinite loop
+    while (1)
+    {
+        // Run whatever task is due; sleep until the next interrupt otherwise.
+        if (!scheduler_run_once()) {
+            pwr_idle();
+        }
+    }
+}
+
+#pragma GCC diagnostic pop
+
+// ----------------------------------------------------------------------------
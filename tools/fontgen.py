@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+"""Generate the OLED font tables of main.c from a BDF or PSF font.
+
+The output is a C header in the byte order refresh_OLED() sends to the
+SSD1306: one byte per glyph column, bit 0 = top pixel row, so a glyph of
+up to 8 rows is one page. It holds
+
+    FONT_FIRST, FONT_LAST   character range of the map (printable ASCII)
+    FONT_COLS, FONT_ROWS    glyph cell, from the font's bounding box (at
+                            most 8x8, main.c's FONT_CELL)
+    FONT_GLYPHS             glyphs kept
+    NAME_map[c - FONT_FIRST]   glyph of each character; characters left out
+                               map to SPACE, which is always kept
+    NAME[glyph][FONT_COLS]     the glyphs
+    NAME_span[glyph]           first inked column (high nibble) and inked
+                               columns from there (low nibble, 0 = blank),
+                               for proportional spacing
+    font_xS[10][S][FONT_COLS * S]   the digits with every pixel made S x S,
+                                    one row of column bytes per page, for
+                                    each --big scale S
+
+The glyphs kept are --chars plus every character in the string and
+character literals of the --used files (comments are skipped), or the
+whole range if neither is given. The size report lists each table and what
+the full range would take.
+
+BDF: glyphs are placed by their BBX in a cell of FONTBOUNDINGBOX width and
+FONT_ASCENT + FONT_DESCENT height. PSF 1 and 2: the cell is the font's;
+the Unicode table maps characters to glyphs if there is one, otherwise the
+glyph index is the character code. --cols N keeps the first N columns of
+the cell (a PSF 1 font is always 8 wide).
+
+font5x7.h is generated with
+
+    python3 tools/fontgen.py tools/fonts/font5x7.bdf --chars 0123456789 \
+        --used main.c --big 2,3 -o font5x7.h
+
+Usage: fontgen.py FONT [-o HEADER] [--name NAME] [--cols N] [--chars STR]
+                  [--used FILE ...] [--big S,...]
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+FIRST, LAST = 0x20, 0x7F
+BIG_DIGITS = "0123456789"
+
+
+def load_bdf(path):
+    """Returns (cols, rows, {code: [row bitmask, bit 0 = leftmost column]})."""
+    glyphs = {}
+    width = height = ascent = descent = None
+    code = bbx = rows = None
+    with open(path, encoding="latin-1") as f:
+        for line in f:
+            words = line.split()
+            if not words:
+                continue
+            key = words[0]
+            if key == "FONTBOUNDINGBOX":
+                width, height = int(words[1]), int(words[2])
+            elif key == "FONT_ASCENT":
+                ascent = int(words[1])
+            elif key == "FONT_DESCENT":
+                descent = int(words[1])
+            elif key == "ENCODING":
+                code = int(words[1])
+            elif key == "BBX":
+                bbx = [int(w) for w in words[1:5]]
+            elif key == "BITMAP":
+                rows = []
+            elif key == "ENDCHAR":
+                if code is not None and code >= 0 and bbx is not None:
+                    glyphs[code] = (bbx, rows)
+                code = bbx = rows = None
+            elif rows is not None:
+                v = int(key, 16)
+                nbits = 4 * len(key)
+                rows.append(sum(1 << i for i in range(nbits) if v >> (nbits - 1 - i) & 1))
+    if width is None:
+        sys.exit(f"{path}: no FONTBOUNDINGBOX")
+    if ascent is None or descent is None:
+        ascent, descent = height, 0
+    rows_total = ascent + descent
+
+    cells = {}
+    for code, ((w, h, xoff, yoff), bitmap) in glyphs.items():
+        cell = [0] * rows_total
+        top = ascent - (yoff + h)
+        for r, bits in enumerate(bitmap[:h]):
+            y = top + r
+            if 0 <= y < rows_total:
+                cell[y] = (bits << xoff if xoff >= 0 else bits >> -xoff) & ((1 << width) - 1)
+        cells[code] = cell
+    return width, rows_total, cells
+
+
+def load_psf(path):
+    """PSF 1 or 2, as load_bdf."""
+    data = open(path, "rb").read()
+    if data[:2] == b"\x36\x04":
+        mode, size = data[2], data[3]
+        count = 512 if mode & 1 else 256
+        width, height, stride, off = 8, size, size, 4
+        has_table = bool(mode & 6)
+    elif data[:4] == b"\x72\xb5\x4a\x86":
+        _, off, flags, count, stride, height, width = struct.unpack_from("<7I", data, 4)
+        has_table = bool(flags & 1)
+    else:
+        sys.exit(f"{path}: not a PSF font")
+    row_bytes = (width + 7) // 8
+
+    bitmaps = []
+    for g in range(count):
+        base = off + g * stride
+        cell = []
+        for r in range(height):
+            v = int.from_bytes(data[base + r * row_bytes:base + (r + 1) * row_bytes], "big")
+            nbits = 8 * row_bytes
+            cell.append(sum(1 << i for i in range(width) if v >> (nbits - 1 - i) & 1))
+        bitmaps.append(cell)
+
+    cells = {}
+    if not has_table:
+        for g, cell in enumerate(bitmaps):
+            cells[g] = cell
+    elif data[:2] == b"\x36\x04":
+        pos = off + count * stride
+        for g in range(count):
+            while pos + 2 <= len(data):
+                u = struct.unpack_from("<H", data, pos)[0]
+                pos += 2
+                if u == 0xFFFF:
+                    break
+                if u != 0xFFFE:
+                    cells.setdefault(u, bitmaps[g])
+    else:
+        pos = off + count * stride
+        for g in range(count):
+            end = data.index(b"\xff", pos)
+            # Single code points first; a 0xFE starts sequences, ignored here.
+            for ch in data[pos:end].split(b"\xfe")[0].decode("utf-8", "replace"):
+                cells.setdefault(ord(ch), bitmaps[g])
+            pos = end + 1
+    return width, height, cells
+
+
+def used_chars(paths):
+    """Characters in the string and character literals of C sources."""
+    found = set()
+    for path in paths:
+        src = open(path, encoding="latin-1").read()
+        src = re.sub(r"/\*.*?\*/", " ", src, flags=re.S)
+        src = re.sub(r"//[^\n]*", " ", src)
+        for lit in re.findall(r'"((?:[^"\\\n]|\\.)*)"|\'((?:[^\'\\\n]|\\.)+)\'', src):
+            text = lit[0] or lit[1]
+            text = re.sub(r"\\(x[0-9A-Fa-f]+|[0-7]{1,3}|.)", lambda m: unescape(m.group(1)), text)
+            found.update(text)
+    return found
+
+
+def unescape(esc):
+    simple = {"n": "\n", "t": "\t", "r": "\r", "0": "\0", "\\": "\\", "'": "'", '"': '"'}
+    if esc in simple:
+        return simple[esc]
+    if esc[0] == "x":
+        return chr(int(esc[1:], 16))
+    if esc[0].isdigit():
+        return chr(int(esc, 8))
+    return esc
+
+
+def columns(cell, cols, rows):
+    """A cell's column bytes (one int per column, bit 0 = top row)."""
+    return [sum(1 << y for y in range(rows) if cell[y] >> x & 1) for x in range(cols)]
+
+
+def span(col_bytes):
+    inked = [i for i, c in enumerate(col_bytes) if c]
+    return (inked[0] << 4 | (inked[-1] - inked[0] + 1)) if inked else 0
+
+
+def scaled(col_bytes, rows, s):
+    """col_bytes with every pixel made s x s, split into pages."""
+    out = []
+    for c in col_bytes:
+        v = sum(((1 << s) - 1) << (y * s) for y in range(rows) if c >> y & 1)
+        out += [v] * s
+    return [[v >> (8 * p) & 0xFF for v in out] for p in range(s * rows // 8 + (s * rows % 8 != 0))]
+
+
+def char_name(c):
+    return {0x20: "SPACE", 0x5C: "back slash", 0x7F: "<-"}.get(c, chr(c))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Generate the OLED font tables of main.c.")
+    ap.add_argument("font", help="BDF or PSF font")
+    ap.add_argument("-o", "--output", help="header to write (default stdout)")
+    ap.add_argument("--name", default="font5x7", help="table name prefix (default font5x7)")
+    ap.add_argument("--cols", type=int, help="keep the first N columns of the cell")
+    ap.add_argument("--chars", default="", help="characters to keep")
+    ap.add_argument("--used", nargs="+", default=[], metavar="FILE",
+                    help="also keep the characters of these C sources' literals")
+    ap.add_argument("--big", default="", metavar="S,...", help="scales of the large digit tables")
+    args = ap.parse_args()
+
+    with open(args.font, "rb") as f:
+        magic = f.read(4)
+    if magic[:2] == b"\x36\x04" or magic == b"\x72\xb5\x4a\x86":
+        cols, rows, cells = load_psf(args.font)
+    else:
+        cols, rows, cells = load_bdf(args.font)
+    if args.cols:
+        cols = min(cols, args.cols)
+    # main.c draws a glyph in a FONT_CELL (8) column cell, and its span
+    # holds the width in a nibble: a 16 wide one would wrap both.
+    if cols > 8 or rows > 8:
+        sys.exit(f"{args.font}: {cols}x{rows} cell; the text renderer takes at most 8x8 (try --cols 8)")
+
+    keep = set(args.chars) | used_chars(args.used)
+    if not keep:
+        keep = {chr(c) for c in range(FIRST, LAST + 1)}
+    keep = sorted({ord(c) for c in keep if FIRST <= ord(c) <= LAST} | {0x20})
+    missing = [c for c in keep if c not in cells]
+    if missing:
+        sys.exit(f"{args.font}: no glyph for " + " ".join(f"0x{c:02X}" for c in missing))
+    scales = [int(s) for s in args.big.split(",") if s]
+    if scales and any(ord(d) not in cells for d in BIG_DIGITS):
+        sys.exit(f"{args.font}: the large digit tables need all of {BIG_DIGITS}")
+
+    glyph_of = {c: i for i, c in enumerate(keep)}
+    glyphs = [columns(cells[c], cols, rows) for c in keep]
+    n = LAST - FIRST + 1
+
+    out = [f"// Generated by tools/fontgen.py from {args.font.split('/')[-1]}; do not edit.",
+           "//",
+           "//   python3 tools/fontgen.py " + " ".join(a if a and " " not in a and '"' not in a
+                                                       else "'" + a + "'" for a in sys.argv[1:]),
+           "",
+           f"#define FONT_FIRST      0x{FIRST:02X}    // First character of {args.name}_map (SPACE)",
+           f"#define FONT_LAST       0x{LAST:02X}    // Last character of {args.name}_map",
+           f"#define FONT_COLS       {cols}       // Columns stored per glyph",
+           f"#define FONT_ROWS       {rows}       // Pixel rows of a glyph (bit 0 = top)",
+           f"#define FONT_GLYPHS     {len(keep)}      // Glyphs in {args.name}",
+           "",
+           f"// Glyph of each character; the ones left out draw as SPACE (glyph 0).",
+           f"static const uint8_t {args.name}_map[FONT_LAST - FONT_FIRST + 1] = {{"]
+    for base in range(FIRST, LAST + 1, 8):
+        vals = ", ".join(f"{glyph_of.get(c, 0):2d}" for c in range(base, base + 8))
+        out.append(f"    {vals},  // 0x{base:02X}-0x{base + 7:02X}")
+    out += ["};", "",
+            f"static const uint8_t {args.name}[FONT_GLYPHS][FONT_COLS] = {{"]
+    for i, (c, g) in enumerate(zip(keep, glyphs)):
+        sep = "," if i + 1 < len(keep) else " "
+        out.append("    {" + ", ".join(f"0b{b:08b}" for b in g) + "}" + sep + f"  // {char_name(c)}")
+    out += ["};", "",
+            "// Inked columns of each glyph for proportional spacing: first inked column",
+            "// (high nibble) and number of columns from there (low nibble, 0 = blank).",
+            f"static const uint8_t {args.name}_span[FONT_GLYPHS] = {{"]
+    for base in range(0, len(glyphs), 8):
+        vals = ", ".join(f"0x{span(g):02X}" for g in glyphs[base:base + 8])
+        out.append(f"    {vals},")
+    out.append("};")
+
+    big_bytes = 0
+    for s in scales:
+        pages = len(scaled(glyphs[0], rows, s))
+        out += ["", f"// The digits {s}x, one row of column bytes per page (bit 0 = top).",
+                f"static const uint8_t font_x{s}[10][{pages}][FONT_COLS * {s}] = {{"]
+        for d in BIG_DIGITS:
+            out.append(f"    {{   // {d}")
+            for pg in scaled(columns(cells[ord(d)], cols, rows), rows, s):
+                out.append("        {" + ", ".join(f"0x{b:02X}" for b in pg) + "},")
+            out.append("    },")
+        out.append("};")
+        big_bytes += 10 * pages * cols * s
+
+    text = "\n".join(out) + "\n"
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+    glyph_bytes = len(keep) * cols
+    total = n + glyph_bytes + len(keep) + big_bytes
+    full = n * cols + n + big_bytes
+    report = sys.stderr if not args.output else sys.stdout
+    print(f"# {len(keep)} of {n} glyphs, {cols}x{rows}: map {n} B, glyphs {glyph_bytes} B, "
+          f"spans {len(keep)} B, large digits {big_bytes} B; {total} B in flash "
+          f"({full} B with the whole range and no map)", file=report)
+
+
+if __name__ == "__main__":
+    main()
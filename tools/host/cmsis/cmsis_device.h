@@ -0,0 +1,291 @@
+#pragma once
+
+// Host stand-in for the STM32F0 device header, for building main.c on a PC
+// (tools/hostsim.c). Registers are plain RAM: nothing happens when they are
+// written, and the driver sets whatever a peripheral would have set. Only
+// what main.c uses is here. Include it from a single translation unit; the
+// peripherals and SystemCoreClock are defined, not declared.
+
+#include <stdint.h>
+#include <sys/types.h>
+#define __IO volatile
+typedef struct { __IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2], BRR; } GPIO_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SR, DR, CRCPR, RXCRCR, TXCRCR; } SPI_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR, OR; } TIM_TypeDef;
+typedef struct { __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR; } EXTI_TypeDef;
+typedef struct { __IO uint32_t ISR, IER, CR, CFGR1, CFGR2, SMPR, r1, r2, TR, r3, CHSELR, r4[5], DR; } ADC_TypeDef;
+typedef struct { __IO uint32_t CR, SWTRIGR, DHR12R1, DHR12L1, DHR8R1, DHR12R2, DHR12L2, DHR8R2, DHR12RD, DHR12LD, DHR8RD, DOR1, DOR2, SR; } DAC_TypeDef;
+typedef struct { __IO uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR, BDCR, CSR, AHBRSTR, CFGR2, CFGR3, CR2; } RCC_TypeDef;
+typedef struct { __IO uint32_t CFGR1, RESERVED, EXTICR[4], CFGR2; } SYSCFG_TypeDef;
+typedef struct { __IO uint32_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { __IO uint32_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t CTRL, LOAD, VAL, CALIB; } SysTick_Type;
+typedef struct { __IO uint32_t CR1, CR2, CR3, BRR, GTPR, RTOR, RQR, ISR, ICR, RDR, TDR; } USART_TypeDef;
+typedef struct { __IO uint32_t ACR, KEYR, OPTKEYR, SR, CR, AR, RESERVED, OBR, WRPR; } FLASH_TypeDef;
+typedef struct { __IO uint32_t CR, CSR; } PWR_TypeDef;
+typedef struct { __IO uint32_t TR, DR, CR, ISR, PRER, r1, r2, ALRMAR, r3, WPR, SSR, SHIFTR, TSTR, TSDR, TSSSR, CALR, TAFCR, ALRMASSR; } RTC_TypeDef;
+typedef struct { __IO uint32_t CPUID, ICSR, r1, AIRCR, SCR, CCR, r2, SHP[2], SHCSR; } SCB_Type;
+uint32_t SystemCoreClock = 48000000u;
+static inline void SystemCoreClockUpdate(void) {}
+typedef enum { RTC_IRQn=2, EXTI0_1_IRQn=5, DMA1_Channel1_IRQn=9, DMA1_Channel2_3_IRQn=10, TIM16_IRQn=21, TIM17_IRQn=22, SPI1_IRQn=25, SysTick_IRQn=-1 } IRQn_Type;
+static inline void NVIC_SetPriority(IRQn_Type n, uint32_t p) { (void)n; (void)p; }
+static inline void NVIC_EnableIRQ(IRQn_Type n) { (void)n; }
+static inline uint32_t SysTick_Config(uint32_t ticks) { (void)ticks; return 0; }
+// One thread, no interrupts of its own: the driver calls the handlers.
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t x) { (void)x; }
+static inline void __disable_irq(void) {}
+// __WFI calls host_wfi_hook, if set, to let time pass (delay_ms sleeps on it).
+static void (*host_wfi_hook)(void);
+static inline void __WFI(void) { if (host_wfi_hook) host_wfi_hook(); }
+// Interrupts run on the one host thread (signal handlers at most), so a
+// compiler barrier is what the DMB orders.
+static inline void __DMB(void) { __atomic_signal_fence(__ATOMIC_SEQ_CST); }
+#define GPIO_IDR_0 1u
+#define GPIO_PIN_3 8u
+#define GPIO_PIN_4 16u
+#define GPIO_PIN_5 32u
+#define GPIO_PIN_6 64u
+#define GPIO_PIN_7 128u
+#define GPIO_MODER_MODER0 3u
+#define GPIO_MODER_MODER1 (3u<<2)
+#define GPIO_MODER_MODER2 (3u<<4)
+#define GPIO_MODER_MODER1_1 (2u<<2)
+#define GPIO_MODER_MODER2_1 (2u<<4)
+#define GPIO_PUPDR_PUPDR0 3u
+#define GPIO_PUPDR_PUPDR1 (3u<<2)
+#define GPIO_PUPDR_PUPDR2 (3u<<4)
+#define GPIO_AFRL_AFRL1 (0xFu<<4)
+#define GPIO_AFRL_AFRL2 (0xFu<<8)
+#define GPIO_MODER_MODER9 (3u<<18)
+#define GPIO_MODER_MODER9_1 (2u<<18)
+#define GPIO_AFRH_AFRH1 (0xFu<<4)
+#define RCC_AHBENR_GPIOAEN (1u<<17)
+#define RCC_AHBENR_GPIOBEN (1u<<18)
+#define RCC_AHBENR_GPIOCEN (1u<<19)
+#define RCC_AHBENR_DMA1EN 1u
+#define RCC_APB2ENR_SPI1EN (1u<<12)
+#define RCC_APB2ENR_ADCEN (1u<<9)
+#define RCC_APB2ENR_TIM17EN (1u<<18)
+#define RCC_APB2ENR_TIM15EN (1u<<16)
+#define RCC_APB2ENR_TIM16EN (1u<<17)
+#define RCC_APB2ENR_USART1EN (1u<<14)
+#define USART_CR1_UE 1u
+#define USART_CR1_TE 8u
+#define USART_CR3_DMAT 0x80u
+#define RCC_APB1ENR_TIM2EN 1u
+#define RCC_APB1ENR_TIM3EN 2u
+#define RCC_CR_PLLON (1u<<24)
+// PLLRDY follows PLLON; host_pll_hook, if set, runs as the PLL locks (lets
+// the wake-up from Stop take its time).
+static void (*host_pll_hook)(void);
+static RCC_TypeDef host_RCC;
+static inline uint32_t host_pllrdy(void)
+{
+    if (!(host_RCC.CR & (1u<<24))) host_RCC.CR &= ~(1u<<25);
+    else if (!(host_RCC.CR & (1u<<25))) {
+        if (host_pll_hook) host_pll_hook();
+        host_RCC.CR |= 1u<<25;
+    }
+    return 1u<<25;
+}
+#define RCC_CR_PLLRDY (host_pllrdy())
+#define RCC_APB1ENR_PWREN (1u<<28)
+#define RCC_CSR_LSION 1u
+#define RCC_CSR_LSIRDY 2u
+#define RCC_BDCR_RTCSEL (3u<<8)
+#define RCC_BDCR_RTCSEL_1 (2u<<8)
+#define RCC_BDCR_RTCEN (1u<<15)
+#define PWR_CR_LPDS 1u
+#define PWR_CR_PDDS 2u
+#define PWR_CR_CWUF 4u
+#define PWR_CR_DBP (1u<<8)
+#define RTC_ISR_ALRAWF 1u
+#define RTC_ISR_INITF (1u<<6)
+#define RTC_ISR_INIT (1u<<7)
+#define RTC_ISR_ALRAF (1u<<8)
+#define RTC_CR_BYPSHAD (1u<<5)
+#define RTC_CR_ALRAE (1u<<8)
+#define RTC_CR_ALRAIE (1u<<12)
+#define RTC_ALRMAR_MSK1 (1u<<7)
+#define RTC_ALRMAR_MSK2 (1u<<15)
+#define RTC_ALRMAR_MSK3 (1u<<23)
+#define RTC_ALRMAR_MSK4 (1u<<31)
+#define EXTI_IMR_MR17 (1u<<17)
+#define EXTI_RTSR_TR17 (1u<<17)
+#define EXTI_PR_PR17 (1u<<17)
+#define SCB_SCR_SLEEPDEEP_Msk 4u
+#define USART_ISR_TC (1u<<6)
+#define RCC_CFGR_SW_Msk 3u
+#define RCC_CFGR_SW_PLL 2u
+#define EXTI_IMR_MR0 1u
+#define EXTI_RTSR_TR0 1u
+#define EXTI_PR_PR0 1u
+#define TIM_CR1_CEN 1u
+#define TIM_CR1_ARPE 0x80u
+#define TIM_CR2_MMS_1 0x20u
+#define TIM_DIER_UIE 1u
+#define TIM_DIER_CC1DE (1u<<9)
+#define TIM_DIER_CC4DE (1u<<12)
+#define TIM_EGR_UG 1u
+#define TIM_SR_UIF 1u
+#define TIM_CCMR1_CC1S_0 1u
+#define TIM_CCMR1_CC1S_1 2u
+#define TIM_CCMR1_IC1PSC (3u<<2)
+#define TIM_CCMR1_CC2S_0 (1u<<8)
+#define TIM_CCMR2_IC4PSC (3u<<10)
+#define TIM_CCMR1_IC2F_0 (1u<<12)
+#define TIM_CCMR1_IC2F_1 (1u<<13)
+#define TIM_CCMR2_IC3F_0 (1u<<4)
+#define TIM_CCMR2_IC3F_1 (1u<<5)
+#define EXTI_FTSR_TR0 1u
+#define TIM_SMCR_SMS 7u
+#define TIM_SMCR_TS_0 0x10u
+#define TIM_SMCR_TS_2 0x40u
+#define TIM_CCMR2_CC4S_1 (2u<<8)
+#define TIM_CCER_CC1E 1u
+#define TIM_CCER_CC2E (1u<<4)
+#define TIM_CCER_CC2P (1u<<5)
+#define TIM_CCER_CC4E 0x1000u
+#define TIM_DCR_DBA 0x1Fu
+#define TIM_DCR_DBL (0x1Fu<<8)
+#define TIM_DCR_DBL_0 (1u<<8)
+#define ADC_CFGR1_OVRMOD (1u<<12)
+#define ADC_CFGR1_DMAEN 1u
+#define ADC_CFGR1_DMACFG 2u
+#define ADC_CFGR1_EXTEN_0 (1u<<10)
+#define ADC_CFGR1_EXTSEL_0 (1u<<6)
+#define ADC_CFGR1_EXTSEL_1 (1u<<7)
+#define ADC_CHSELR_CHSEL5 (1u<<5)
+#define ADC_CR_ADEN 1u
+#define ADC_CR_ADSTART 4u
+#define ADC_ISR_ADRDY 1u
+#define DMA_CCR_EN 1u
+#define DMA_CCR_TCIE 2u
+#define DMA_CCR_HTIE 4u
+#define DMA_CCR_TEIE 8u
+#define DMA_CCR_DIR 16u
+#define DMA_CCR_CIRC 32u
+#define DMA_CCR_MINC 128u
+#define DMA_CCR_PSIZE_0 0x100u
+#define DMA_CCR_PSIZE_1 0x200u
+#define DMA_CCR_MSIZE_0 0x400u
+#define DMA_CCR_MSIZE_1 0x800u
+#define DMA_CCR_PL_1 0x2000u
+#define DMA_ISR_TCIF1 2u
+#define DMA_ISR_HTIF1 4u
+#define DMA_ISR_TCIF2 0x20u
+#define DMA_ISR_TEIF2 0x80u
+#define DMA_IFCR_CGIF2 0x10u
+#define DMA_ISR_TCIF3 0x200u
+#define DMA_ISR_TCIF4 (1u<<13)
+#define DMA_ISR_HTIF4 (1u<<14)
+#define DMA_ISR_TCIF5 (1u<<17)
+#define DMA_ISR_HTIF5 (1u<<18)
+#define DMA_ISR_TEIF3 0x800u
+#define DMA_IFCR_CGIF3 0x100u
+#define DMA_IFCR_CTCIF1 0x2u
+#define DMA_IFCR_CHTIF1 0x4u
+#define SPI_CR1_SPE 0x40u
+#define SPI_CR2_TXDMAEN 2u
+#define SPI_CR2_TXEIE 0x80u
+#define SPI_SR_TXE 2u
+#define SPI_SR_BSY 0x80u
+#define SPI_SR_FTLVL (3u<<11)
+#define FLASH_KEY1 0x45670123u
+#define FLASH_KEY2 0xCDEF89ABu
+#define FLASH_SR_BSY 1u
+#define FLASH_SR_PGERR 4u
+#define FLASH_SR_WRPRTERR 0x10u
+#define FLASH_SR_EOP 0x20u
+#define FLASH_CR_PG 1u
+#define FLASH_CR_PER 2u
+#define FLASH_CR_STRT 0x40u
+#define FLASH_CR_LOCK 0x80u
+// HAL (SPI1 setup of the OLED)
+typedef struct { uint32_t Pin, Mode, Pull, Speed, Alternate; } GPIO_InitTypeDef;
+typedef struct { uint32_t Mode, Direction, DataSize, CLKPolarity, CLKPhase, NSS, BaudRatePrescaler, FirstBit, TIMode, CRCCalculation, CRCPolynomial; } SPI_InitTypeDef;
+typedef struct { SPI_TypeDef *Instance; SPI_InitTypeDef Init; } SPI_HandleTypeDef;
+typedef enum { HAL_OK } HAL_StatusTypeDef;
+#define GPIO_MODE_AF_PP 2u
+#define GPIO_MODE_OUTPUT_PP 1u
+#define GPIO_SPEED_FREQ_MEDIUM 1u
+#define GPIO_NOPULL 0u
+#define GPIO_AF0_SPI1 0u
+#define SPI_DIRECTION_1LINE 1u
+#define SPI_MODE_MASTER 1u
+#define SPI_DATASIZE_8BIT 7u
+#define SPI_POLARITY_LOW 0u
+#define SPI_PHASE_1EDGE 0u
+#define SPI_NSS_SOFT 1u
+#define SPI_CR1_BR_Pos 3u
+#define SPI_FIRSTBIT_MSB 0u
+#define __HAL_SPI_ENABLE(h) ((h)->Instance->CR1 |= SPI_CR1_SPE)
+static inline void HAL_GPIO_Init(GPIO_TypeDef *g, GPIO_InitTypeDef *i) { (void)g; (void)i; }
+static inline HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *h) { (void)h; return HAL_OK; }
+#define SPI_CR1_BIDIOE 0x4000u
+
+// Peripherals
+static GPIO_TypeDef host_GPIOA;
+#define GPIOA         (&host_GPIOA)
+static GPIO_TypeDef host_GPIOB;
+// Every GPIOB access first calls host_gpiob_hook, if set, so that a check can
+// pick up a BSRR/BRR write before the next one replaces it.
+static void (*host_gpiob_hook)(void);
+static inline GPIO_TypeDef *host_gpiob(void) { if (host_gpiob_hook) host_gpiob_hook(); return &host_GPIOB; }
+#define GPIOB         (host_gpiob())
+static GPIO_TypeDef host_GPIOC;
+#define GPIOC         (&host_GPIOC)
+static SPI_TypeDef host_SPI1;
+#define SPI1          (&host_SPI1)
+static TIM_TypeDef host_TIM2;
+#define TIM2          (&host_TIM2)
+static TIM_TypeDef host_TIM3;
+#define TIM3          (&host_TIM3)
+static TIM_TypeDef host_TIM15;
+#define TIM15         (&host_TIM15)
+static TIM_TypeDef host_TIM16;
+#define TIM16         (&host_TIM16)
+static TIM_TypeDef host_TIM17;
+#define TIM17         (&host_TIM17)
+static EXTI_TypeDef host_EXTI;
+#define EXTI          (&host_EXTI)
+static ADC_TypeDef host_ADC1;
+#define ADC1          (&host_ADC1)
+static DAC_TypeDef host_DAC;
+#define DAC           (&host_DAC)
+#define RCC           (&host_RCC)
+static PWR_TypeDef host_PWR;
+#define PWR           (&host_PWR)
+static RTC_TypeDef host_RTC;
+#define RTC           (&host_RTC)
+static SCB_Type host_SCB;
+#define SCB           (&host_SCB)
+static USART_TypeDef host_USART1;
+#define USART1        (&host_USART1)
+static SYSCFG_TypeDef host_SYSCFG;
+#define SYSCFG        (&host_SYSCFG)
+static DMA_TypeDef host_DMA1;
+#define DMA1          (&host_DMA1)
+static DMA_Channel_TypeDef host_DMA1_Channel1;
+#define DMA1_Channel1 (&host_DMA1_Channel1)
+static DMA_Channel_TypeDef host_DMA1_Channel2;
+#define DMA1_Channel2 (&host_DMA1_Channel2)
+static DMA_Channel_TypeDef host_DMA1_Channel3;
+#define DMA1_Channel3 (&host_DMA1_Channel3)
+static DMA_Channel_TypeDef host_DMA1_Channel4;
+#define DMA1_Channel4 (&host_DMA1_Channel4)
+static DMA_Channel_TypeDef host_DMA1_Channel5;
+#define DMA1_Channel5 (&host_DMA1_Channel5)
+static SysTick_Type host_SysTick;
+#define SysTick       (&host_SysTick)
+// The flash array. Addresses are host pointers, so a 32-bit address the
+// firmware writes to FLASH->AR is the low half of one into host_flash.
+static uint8_t host_flash[64 * 1024] __attribute__((aligned(1024)));
+#define FLASH_BASE    ((uintptr_t)host_flash)
+// Every FLASH register access first calls host_flash_hook, if set, which
+// carries out what the previous accesses started (see tools/hostsim.c).
+static FLASH_TypeDef host_FLASH;
+static void (*host_flash_hook)(void);
+static inline FLASH_TypeDef *host_flash_regs(void) { if (host_flash_hook) host_flash_hook(); return &host_FLASH; }
+#define FLASH         (host_flash_regs())
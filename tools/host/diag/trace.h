@@ -0,0 +1,16 @@
+#pragma once
+
+// Host stand-in for the semihosting trace channel. The binary event records
+// drained by evt_drain() are passed to host_trace_write(), if the driver set
+// it; everything else is discarded.
+
+#include <stddef.h>
+#include <sys/types.h>
+
+static ssize_t (*host_trace_write)(const char *buf, size_t nbyte);
+
+static inline int trace_printf(const char *fmt, ...) { (void)fmt; return 0; }
+static inline ssize_t trace_write(const char *buf, size_t nbyte)
+{
+    return host_trace_write ? host_trace_write(buf, nbyte) : (ssize_t)nbyte;
+}
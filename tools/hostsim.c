@@ -0,0 +1,2898 @@
+// hostsim.c - runs main.c on a PC against virtual hardware.
+//
+// main.c is compiled unchanged against the register stand-ins in tools/host
+// and driven the way the hardware drives it on the board:
+//
+//   - TIM2 is a virtual clock. A rising edge on an input whose capture is
+//     enabled (CCER) is one DMA transfer of its timestamp into ic_buf_555
+//     (CC1) or ic_buf_fg (CC4), or a burst of them through TIM2->DMAR as
+//     TIM2->DCR sets it up. A falling edge of the 555 latches CCR2 if IC2
+//     captures TI2's falling edges. The firmware enables all of it.
+//   - ADC samples fill adc_buf; the half/full flags call
+//     DMA1_Channel1_IRQHandler.
+//   - freq_capture_poll() runs every 10 ms of virtual time like the
+//     "measure" task, and evt_drain() empties the event ring after it.
+//
+// The measurement is therefore the firmware's own code, not a model of it.
+//
+// Build and run from the repository root:
+//
+//   cc -O2 -Wall -Wextra -Itools/host -o hostsim tools/hostsim.c -lm
+//   ./hostsim --selftest
+//   ./hostsim --fg 5000 --jitter 100 --seconds 20 --csv readings.csv
+//
+// Generated inputs (--555 / --fg HZ turn an input on; the rest apply to both):
+//
+//   --duty PM       duty cycle (permil, default 600 for the 555, 500 for the FG)
+//   --jitter NS     RMS jitter of every edge
+//   --glitch PM     extra pulses per 1000 periods, --glitch-ns wide (default
+//                   GLITCH_NS); the input filter the firmware set removes
+//                   the shorter ones
+//   --miss PM       rising edges lost per 1000 periods
+//   --drift PPM/S   frequency ramp (with --pi or --cal, the plant's instead)
+//   --step X        frequency times X from the middle of the run
+//   --startup MS    555 only: off until MS, then a first high phase as long
+//                   as after power-up
+//   --adc CODE      12-bit ADC input (with --adc-noise LSB, uniform)
+//   --adc-late N    hold every Nth ADC DMA interrupt off past the next half
+//
+// The firmware measures both inputs at once and displays the function
+// generator after reset; with only --555 given the USER button is pressed
+// once at start-up so Freq follows the 555. --presses N presses it N more
+// times over the run, bouncing --bounce times each way (see Button). Every
+// reading is compared with
+// the nominal frequency at the middle of its span and with the median of its
+// two neighbours on each side (a spike is more than --spike PPM off). With
+// clean edges (no jitter, glitches or misses) a reading off by more than the
+// resolution the firmware claims for it is a failure. --max-err and
+// --max-spikes make the exit status 1 when exceeded, and --max-duty-err
+// when the 555's duty cycle is off by more or not measured at all; --selftest runs the
+// scenarios in selftests[] in child processes, each on a fresh copy of the
+// firmware.
+//
+// --record FILE saves the input edges and ADC samples in a compact binary
+// file, and --replay FILE runs them instead of the generators; the options
+// above then only describe the file to the checks (see Edge Files). Both
+// print the events processed per second of real time, and --min-rate
+// MEV/S fails a run below that many millions.
+//
+// --trace FILE saves the event trace as the trace channel would carry it
+// (decode it with tools/trace_decode.py).
+//
+// --tm FILE saves the USART telemetry stream and checks it (see Telemetry
+// Link); --tm-pty serves it on a pseudo-terminal to
+// tools/telemetry_decode.py.
+//
+// --oled FILE also runs the display path against a virtual panel and saves
+// what it shows (see Virtual Panel). --contrast N stores that setting in
+// flash first, and the panel must end up with it; --view N stores the
+// layout (1 = large digits and bar graphs) the same way, and --spi-br N
+// the SPI prescaler, which the transport's drain poll must follow.
+//
+// --lowpower runs in low-power mode: display off, Stop between readings,
+// woken by the RTC (see Low Power). --hold MS holds the presses that long:
+// from 400 ms on they switch the OLED layout, from 1000 ms on that mode.
+//
+// --pi HZ closes the DAC control loop against a model of the 555's
+// frequency response and checks the controller holds HZ (see Plant); --cal
+// runs a DAC calibration sweep against it and checks the table it leaves
+// in flash (see Virtual Hardware for the flash).
+//
+// --freq-math checks the integer frequency conversion of freq_from_ticks
+// against the floating-point formula it replaced, --fmt the formatter
+// against snprintf, --font the packed font, --stats the rolling statistics
+// --snap the snapshot channel under preemption and --kv the key/value store
+// under power failures (see Unit Checks).
+
+#define _GNU_SOURCE     // REG_EFL, for single-stepping in check_snap
+
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+#define main firmware_main
+#include "../main.c"
+#undef main
+
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#undef CR1        // <termios.h> output delays, not the register fields
+#undef CR2
+#undef CR3
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define POLL_MS            10u      // Period of the "measure" task
+#define GLITCH_NS          2000u    // Default width of a generated glitch pulse
+
+#define IN_555             0        // Index of an input in readings[], gens[]
+#define IN_FG              1
+
+#define EV_555_RISE        0
+#define EV_555_FALL        1
+#define EV_FG_RISE         2
+#define EV_ADC             3
+#define EV_BTN             4
+#define EV_NONE            0xFF
+
+
+//---------- Virtual Hardware --------------------
+
+static uint64_t hw_now;             // TIM2 extended to 64 bits
+static uint64_t hw_next_poll;       // Next release of the measure task
+static uint64_t hw_poll_ticks;
+static uint64_t hw_next_pi;         // Next TIM16 update, UINT64_MAX = stopped
+static uint64_t hw_last_rise[2];    // Last rising edge captured, per input
+static uint32_t hw_adc_flags;       // DMA1 Channel 1 flags not yet handled
+static uint32_t hw_adc_irqs;        // Channel 1 interrupts raised
+static uint32_t hw_adc_late;        // Hold every hw_adc_late-th one off (0 = never)
+static uint32_t hw_adc_both;        // Interrupts that found HT and TC set
+static uint32_t hw_adc_halves;      // Halves of adc_buf the DMA completed
+static FILE *hw_trace_out;          // Event trace, as sent on the trace channel
+static uint64_t hw_lost;            // Ticks TIM2 did not count (Stop, and at 8 MHz)
+static uint32_t hw_ms_add;          // What the firmware added to sys_ms for them
+
+static void tl_capture(uint8_t sel, uint32_t ts);
+static void hw_rtc_set(uint64_t t);
+
+
+// DMA addresses only hold the low half of a host pointer. Every buffer main.c
+// hands to a DMA channel is static, so the high half is that of any static.
+static const uint8_t *hw_ptr(uint32_t addr)
+{
+    return (const uint8_t *)(((uintptr_t)&host_DMA1 & ~(uintptr_t)0xFFFFFFFFu) | addr);
+}
+
+
+// TIM2 and SysTick count the time the core was not in Stop; the RTC counts
+// all of it.
+static void hw_set_time(uint64_t t)
+{
+    hw_now = t;
+    TIM2->CNT = (uint32_t)(t - hw_lost);
+    sys_ms = (uint32_t)((t - hw_lost) / (SystemCoreClock / 1000u)) + hw_ms_add;
+    if (RCC->BDCR & RCC_BDCR_RTCEN) hw_rtc_set(t);
+}
+
+
+// Counts `words` transfers of a circular DMA channel of `len` words and
+// returns the HT/TC flags it raises, if their interrupts are enabled.
+static uint32_t hw_dma_step(DMA_Channel_TypeDef *ch, uint32_t len, uint32_t words, uint32_t ht, uint32_t tc)
+{
+    uint32_t before = ch->CNDTR;
+    uint32_t flags = 0;
+
+    ch->CNDTR = before - words;
+    if (before > len / 2 && ch->CNDTR <= len / 2 && (ch->CCR & DMA_CCR_HTIE)) flags |= ht;
+    if (ch->CNDTR == 0) {
+        if (ch->CCR & DMA_CCR_TCIE) flags |= tc;
+        ch->CNDTR = len;
+    }
+    return flags;
+}
+
+
+static void hw_dma_irq(uint32_t flags, void (*handler)(void))
+{
+    if (flags == 0) return;
+    DMA1->ISR |= flags;
+    handler();
+    DMA1->ISR &= ~flags;
+}
+
+
+// One rising edge on an input. PA2 goes to TIM2 on AF2 and to TIM15 (edge
+// count) on AF0. A TIM2 capture happens only while CCxE is set, on every
+// 1st/2nd/4th/8th edge as ICxPSC selects; the prescaler restarts while the
+// capture is disabled. Its DMA request copies the CCR, or DBL + 1 registers
+// from DBA on when the channel reads TIM2->DMAR.
+static void hw_rise(uint64_t t, uint8_t in)
+{
+    static uint8_t psc_n[2];
+    ic_stream_t *s = (in == IN_555) ? &ic_555 : &ic_fg;
+    uint32_t en = (in == IN_555) ? TIM_CCER_CC1E : TIM_CCER_CC4E;
+    uint32_t psc = (in == IN_555) ? (TIM2->CCMR1 >> 2) & 3 : (TIM2->CCMR2 >> 10) & 3;
+    volatile uint32_t *ccr = (in == IN_555) ? &TIM2->CCR1 : &TIM2->CCR4;
+    uint32_t burst, words, len;
+
+    hw_set_time(t);
+    if (in == IN_FG && ((GPIOA->AFR[0] >> 8) & 0xF) != 2) {
+        if (((GPIOA->AFR[0] >> 8) & 0xF) == 0 && (TIM15->CR1 & TIM_CR1_CEN) &&
+            (TIM15->SMCR & TIM_SMCR_SMS) == TIM_SMCR_SMS)
+            TIM15->CNT = (TIM15->CNT + 1) & 0xFFFF;
+        return;
+    }
+    if (!(TIM2->CCER & en)) {
+        psc_n[in] = 0;
+        return;
+    }
+    if (++psc_n[in] < (1u << psc)) return;
+    psc_n[in] = 0;
+    *ccr = TIM2->CNT;
+    if (!(s->dma->CCR & DMA_CCR_EN)) return;
+    hw_last_rise[in] = t;
+    tl_capture(s->in, TIM2->CNT);
+
+    burst = s->dma->CPAR == (uint32_t)&TIM2->DMAR;
+    words = burst ? ((TIM2->DCR & TIM_DCR_DBL) >> 8) + 1 : 1;
+    len = IC_BUF_LEN * words;
+    for (uint32_t i = 0; i < words; i++)
+    {
+        s->buf[len - s->dma->CNDTR] = burst ? (&TIM2->CR1)[(TIM2->DCR & TIM_DCR_DBA) + i] : *ccr;
+
+        // The half/complete flags are set whether or not they interrupt.
+        if (s->dma->CNDTR == len / 2 + 1) DMA1->ISR |= s->dma_flags & (DMA_ISR_HTIF4 | DMA_ISR_HTIF5);
+        if (s->dma->CNDTR == 1) DMA1->ISR |= s->dma_flags & (DMA_ISR_TCIF4 | DMA_ISR_TCIF5);
+        hw_dma_step(s->dma, len, 1, 0, 0);
+    }
+}
+
+
+// One falling edge of the 555: IC2 latches it if it captures TI2 (CC2S =
+// 01) on falling edges. It has no DMA request; hw_rise's burst reads it.
+static void hw_fall(uint64_t t)
+{
+    hw_set_time(t);
+    if ((TIM2->CCER & (TIM_CCER_CC2E | TIM_CCER_CC2P)) == (TIM_CCER_CC2E | TIM_CCER_CC2P) &&
+        ((TIM2->CCMR1 >> 8) & 3) == 1)
+        TIM2->CCR2 = TIM2->CNT;
+}
+
+
+// Shortest pulse the digital filter of an input passes, in TIM2 ticks:
+// ICxF picks N samples in a row at fCK_INT or a division of fDTS (CKD = 0,
+// so fDTS = fCK_INT). The 555 is on TI2 (IC2F), the FG on TI3 (IC3F).
+static double hw_filter_ticks(uint8_t in)
+{
+    static const uint8_t div[16] = { 1, 1, 1, 1, 2, 2, 4, 4, 8, 8, 16, 16, 16, 32, 32, 32 };
+    static const uint8_t n[16]   = { 1, 2, 4, 8, 6, 8, 6, 8, 6, 8, 5, 6, 8, 5, 6, 8 };
+    uint32_t f = (in == IN_555) ? (TIM2->CCMR1 >> 12) & 0xF : (TIM2->CCMR2 >> 4) & 0xF;
+
+    return (double)div[f] * n[f];
+}
+
+
+static void hw_adc_irq(void)
+{
+    if ((hw_adc_flags & (DMA_ISR_HTIF1 | DMA_ISR_TCIF1)) == (DMA_ISR_HTIF1 | DMA_ISR_TCIF1))
+        hw_adc_both++;
+    hw_dma_irq(hw_adc_flags, DMA1_Channel1_IRQHandler);
+    hw_adc_flags = 0;
+}
+
+
+static void hw_adc_sample(uint64_t t, uint16_t v)
+{
+    uint32_t i = 2 * ADC_OVERSAMPLE - DMA1_Channel1->CNDTR;
+    uint32_t flags;
+
+    hw_set_time(t);
+    if (!(DMA1_Channel1->CCR & DMA_CCR_EN)) return;
+    adc_buf[i] = v;
+    flags = hw_dma_step(DMA1_Channel1, 2 * ADC_OVERSAMPLE, 1, DMA_ISR_HTIF1, DMA_ISR_TCIF1);
+    if (flags == 0) return;
+
+    // A held-off interrupt runs once the next half is complete too.
+    hw_adc_halves++;
+    hw_adc_flags |= flags;
+    if (hw_adc_late && ++hw_adc_irqs % hw_adc_late == 0) return;
+    hw_adc_irq();
+}
+
+
+static ssize_t hw_trace_write(const char *buf, size_t n)
+{
+    return (ssize_t)fwrite(buf, 1, n, hw_trace_out);
+}
+
+
+// Flash: host_flash behaves like NOR flash behind the FLASH registers. The
+// firmware stores to it directly, so fl_hook, which runs before every FLASH
+// register access, compares it with fl_shadow (what the cells really hold)
+// to see what was programmed since. A halfword stored while PG is set
+// programs the cell if it was erased (or the value is 0); otherwise PGERR is
+// raised and the cell keeps its value. A change with PG clear, or while
+// locked, is counted in fl_stray and undone. STRT with PER erases the page
+// in AR. KEY1 then KEY2 in KEYR clears LOCK. SR bits are write-1-to-clear:
+// an SR that differs from fl_sr was written. Only the data pages at the top
+// (FLASH_DATA_PAGES) are watched.
+//
+// With fl_cut_in >= 0 the power fails during that many erases and
+// halfword programs from now: the cells it was changing are left anywhere
+// between their old and new state, and fl_hook longjmps to fl_cut_env.
+static uint8_t  fl_shadow[sizeof(host_flash)];
+static uint8_t  fl_key;             // KEY1 seen
+static uint32_t fl_sr;              // Status as the flash has it
+static uint32_t fl_erases, fl_programs, fl_pgerr, fl_stray;
+static uint32_t fl_page_erases[sizeof(host_flash) / FLASH_PAGE_BYTES];
+static int32_t  fl_cut_in = -1;
+static jmp_buf  fl_cut_env;
+
+#define FL_WATCH    ((uint32_t)(FLASH_DATA_ADDR - FLASH_BASE))
+
+static uint64_t rng_next(void);
+
+
+// Counts down to the power failure; 1 if it happens now.
+static int fl_cut_now(void)
+{
+    return fl_cut_in >= 0 && fl_cut_in-- == 0;
+}
+
+
+static void fl_hook(void)
+{
+    FLASH_TypeDef *f = &host_FLASH;
+
+    if (f->SR != fl_sr) fl_sr &= ~f->SR;
+    if (f->KEYR != 0) {
+        if (f->KEYR == FLASH_KEY2 && fl_key) f->CR &= ~FLASH_CR_LOCK;
+        fl_key = (f->KEYR == FLASH_KEY1);
+        f->KEYR = 0;
+    }
+    if (f->CR & FLASH_CR_LOCK) f->CR = FLASH_CR_LOCK;
+
+    if ((f->CR & (FLASH_CR_STRT | FLASH_CR_PER)) == (FLASH_CR_STRT | FLASH_CR_PER))
+    {
+        uint32_t off = (f->AR - (uint32_t)FLASH_BASE) & ~(FLASH_PAGE_BYTES - 1);
+
+        if (off < sizeof(host_flash)) {
+            if (fl_cut_now()) {
+                // Erasing sets bits; some of them made it.
+                for (uint32_t i = off; i < off + FLASH_PAGE_BYTES; i++) fl_shadow[i] |= (uint8_t)rng_next();
+                memcpy(host_flash + off, fl_shadow + off, FLASH_PAGE_BYTES);
+                longjmp(fl_cut_env, 1);
+            }
+            memset(host_flash + off, 0xFF, FLASH_PAGE_BYTES);
+            memset(fl_shadow + off, 0xFF, FLASH_PAGE_BYTES);
+            fl_erases++;
+            fl_page_erases[off / FLASH_PAGE_BYTES]++;
+        }
+        f->CR &= ~FLASH_CR_STRT;
+        fl_sr |= FLASH_SR_EOP;
+    }
+
+    if (memcmp(host_flash + FL_WATCH, fl_shadow + FL_WATCH, sizeof(host_flash) - FL_WATCH) == 0) {
+        f->SR = fl_sr;
+        return;
+    }
+    for (uint32_t i = FL_WATCH; i < sizeof(host_flash); i += 2)
+    {
+        uint16_t was = (uint16_t)(fl_shadow[i] | fl_shadow[i + 1] << 8);
+        uint16_t now = (uint16_t)(host_flash[i] | host_flash[i + 1] << 8);
+
+        if (now == was) continue;
+        if (!(f->CR & FLASH_CR_PG)) {
+            fl_stray++;
+        } else if (was == 0xFFFF || now == 0) {
+            if (fl_cut_now()) {
+                // Programming clears bits; some of them made it.
+                uint16_t torn = was & (now | (uint16_t)rng_next());
+                fl_shadow[i] = host_flash[i] = (uint8_t)torn;
+                fl_shadow[i + 1] = host_flash[i + 1] = (uint8_t)(torn >> 8);
+                longjmp(fl_cut_env, 1);
+            }
+            fl_shadow[i] = host_flash[i];
+            fl_shadow[i + 1] = host_flash[i + 1];
+            fl_programs++;
+            fl_sr |= FLASH_SR_EOP;
+            continue;
+        } else {
+            fl_pgerr++;
+            fl_sr |= FLASH_SR_PGERR;
+        }
+        host_flash[i] = fl_shadow[i];
+        host_flash[i + 1] = fl_shadow[i + 1];
+    }
+    f->SR = fl_sr;
+}
+
+
+// The FLASH registers after a reset.
+static void fl_reset(void)
+{
+    host_FLASH.CR = FLASH_CR_LOCK;
+    host_FLASH.SR = fl_sr = 0;
+    host_FLASH.KEYR = 0;
+    fl_key = 0;
+    host_flash_hook = fl_hook;
+}
+
+
+// Erased flash, locked.
+static void fl_init(void)
+{
+    memset(host_flash, 0xFF, sizeof(host_flash));
+    memset(fl_shadow, 0xFF, sizeof(fl_shadow));
+    fl_reset();
+}
+
+
+// Brings up the parts of main() that the measurement path needs.
+static void hw_init(uint64_t t0)
+{
+    hw_set_time(t0);
+    hw_poll_ticks = (uint64_t)SystemCoreClock / 1000u * POLL_MS;
+    hw_next_poll = t0 + hw_poll_ticks;
+
+    myGPIOA_Init();
+    myTIM2_Init();
+    myEXTI_Init();
+    fl_init();
+    kv_init();
+    cfg_load();
+    cal_init();
+    ADC1->ISR = ADC_ISR_ADRDY;      // What ADC_Config() waits for
+    ADC_Config();
+    pi_init();
+    hw_next_pi = t0 + (uint64_t)(TIM16->PSC + 1) * (TIM16->ARR + 1);
+    tm_init();
+    USART1->ISR = USART_ISR_TC;     // Idle line, as pwr_stop_ready() wants it
+    RCC->CSR = RCC_CSR_LSIRDY;      // What pwr_init() waits for
+    RTC->ISR = RTC_ISR_INITF | RTC_ISR_ALRAWF;
+    RTC->SSR = PWR_RTC_PREDIV_S;    // As initialisation leaves it
+    pwr_init();
+    if (hw_trace_out) host_trace_write = hw_trace_write;
+}
+
+
+//---------- Virtual Panel --------------------
+//
+// --oled FILE runs the display path as well: oled_config() at start-up, then
+// task_adc_dac() and refresh_OLED() every PN_FRAME_MS like the "display"
+// task. The transport interrupts are raised the way the SPI would raise
+// them (see pn_drain), and what they send is decoded the way the panel
+// would decode it: every byte SPI1_IRQHandler puts in DR and every DMA1
+// Channel 3 burst is latched with the D/C# level of PB7 at that moment
+// (PB6 = CS#, PB4 = RES#, picked up from ODR, BSRR and BRR through
+// host_gpiob_hook).
+//
+// The controller RAM is PN_RAM_COLS wide, of which OLED_COLS columns from
+// OLED_COL_OFFSET on are visible, the geometry OLED_COL_OFFSET assumes. It
+// starts out as noise, as after power-up. Page (0xB0) and column (0x0X,
+// 0x1X) commands move the RAM pointer in every addressing mode; 0x20 selects
+// how it advances past the end of a page. After every frame the visible RAM
+// must equal oled_front; at the end the glass image (on/off, inverse, remap,
+// COM scan, start line) goes to FILE as a 128x64 PBM.
+
+#define PN_FRAME_MS  100u       // Period of the "display" task
+#define PN_RAM_COLS  132u
+
+static uint8_t pn_ram[OLED_PAGES][PN_RAM_COLS];
+static uint8_t pn_enabled;
+static uint8_t pn_dc, pn_cs = 1;    // Pin levels: D/C# (1 = data), CS#
+static uint8_t pn_page, pn_col;     // RAM pointer
+static uint8_t pn_mode;             // 0x20 argument: 0 horizontal, 1 vertical, 2 page
+static uint8_t pn_col_lo, pn_col_hi, pn_page_lo, pn_page_hi;   // 0x21 / 0x22 window
+static uint8_t pn_on, pn_contrast, pn_invert, pn_allon, pn_remap, pn_scan, pn_start, pn_offset;
+static uint8_t pn_cmd[3], pn_cmd_n, pn_cmd_len;     // Command being assembled
+static uint32_t pn_polls, pn_frames, pn_data, pn_cmds;
+static uint32_t pn_bad;             // Bytes the panel would not take, bad DMA setups
+static uint32_t pn_diff;            // Visible bytes that differed from oled_front
+static uint32_t pn_views;           // CFG_VIEW changes seen
+
+
+// Register defaults after RES#.
+static void pn_reset(void)
+{
+    pn_page = pn_col = 0;
+    pn_mode = 2;
+    pn_col_lo = 0;
+    pn_col_hi = PN_RAM_COLS - 1;
+    pn_page_lo = 0;
+    pn_page_hi = OLED_PAGES - 1;
+    pn_on = pn_invert = pn_allon = pn_remap = pn_scan = pn_start = pn_offset = 0;
+    pn_contrast = 0x7F;
+    pn_cmd_n = 0;
+}
+
+
+// Applies the BSRR/BRR writes since the last GPIOB access to ODR, as the
+// port does, and takes the pin levels from there.
+static void pn_pins(void)
+{
+    uint32_t set = host_GPIOB.BSRR & 0xFFFFu;
+    uint32_t clr = host_GPIOB.BRR | (host_GPIOB.BSRR >> 16);
+    uint32_t odr = (host_GPIOB.ODR & ~clr) | set;
+
+    host_GPIOB.BSRR = host_GPIOB.BRR = 0;
+    host_GPIOB.ODR = odr;
+    if (!(odr & GPIO_PIN_4)) pn_reset();    // RES# low holds the controller in reset
+    pn_cs = (odr & GPIO_PIN_6) != 0;
+    pn_dc = (odr & GPIO_PIN_7) != 0;
+}
+
+
+// Argument bytes that follow a command byte.
+static uint8_t pn_args(uint8_t op)
+{
+    switch (op)
+    {
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xAD:
+    case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+        return 1;
+    case 0x21: case 0x22:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+
+static void pn_command(const uint8_t *c)
+{
+    uint8_t op = c[0];
+
+    pn_cmds++;
+    if      (op <= 0x0F)                pn_col = (uint8_t)((pn_col & 0xF0) | op);
+    else if (op <= 0x1F)                pn_col = (uint8_t)((pn_col & 0x0F) | (op & 0x0F) << 4);
+    else if (op == 0x20)                pn_mode = c[1] & 3;
+    else if (op == 0x21)                { pn_col_lo = pn_col = c[1]; pn_col_hi = c[2]; }
+    else if (op == 0x22)                { pn_page_lo = pn_page = c[1] & 7; pn_page_hi = c[2] & 7; }
+    else if (op >= 0x40 && op <= 0x7F)  pn_start = op & 0x3F;
+    else if (op == 0x81)                pn_contrast = c[1];
+    else if (op == 0xA0 || op == 0xA1)  pn_remap = op & 1;
+    else if (op == 0xA4 || op == 0xA5)  pn_allon = op & 1;
+    else if (op == 0xA6 || op == 0xA7)  pn_invert = op & 1;
+    else if (op == 0xAE || op == 0xAF)  pn_on = op & 1;
+    else if (op >= 0xB0 && op <= 0xB7)  pn_page = op & 7;
+    else if (op >= 0xC0 && op <= 0xCF)  pn_scan = (op >> 3) & 1;
+    else if (op == 0xD3)                pn_offset = c[1] & 0x3F;
+    else if (op == 0xE3 || pn_args(op)) {}     // NOP, and settings the image does not show
+    else pn_bad++;
+}
+
+
+static void pn_byte(uint8_t b)
+{
+    pn_pins();
+    if (pn_cs) { pn_bad++; return; }
+
+    if (!pn_dc)
+    {
+        pn_cmd[pn_cmd_n++] = b;
+        if (pn_cmd_n == 1) pn_cmd_len = 1 + pn_args(b);
+        if (pn_cmd_n == pn_cmd_len) {
+            pn_command(pn_cmd);
+            pn_cmd_n = 0;
+        }
+        return;
+    }
+
+    pn_data++;
+    if (pn_col < PN_RAM_COLS) pn_ram[pn_page][pn_col] = b;
+    if (pn_mode == 1) {
+        if (pn_page++ == pn_page_hi) {
+            pn_page = pn_page_lo;
+            pn_col = (pn_col == pn_col_hi) ? pn_col_lo : pn_col + 1;
+        }
+    } else if (pn_col++ == ((pn_mode == 0) ? pn_col_hi : PN_RAM_COLS - 1)) {
+        pn_col = (pn_mode == 0) ? pn_col_lo : 0;
+        if (pn_mode == 0) pn_page = (pn_page == pn_page_hi) ? pn_page_lo : pn_page + 1;
+    }
+}
+
+
+// Runs the transport interrupts until the queue is empty. The bytes sent
+// since the last D/C# or CS# change keep BSY set, so the firmware has to
+// wait for the shifter through TIM17 before it may change either pin; the
+// wait is over at the next TIM17 update. A queue that still holds segments
+// with no interrupt pending has stalled.
+static void pn_drain(void)
+{
+    while (oled_q_active)
+    {
+        if (DMA1_Channel3->CCR & DMA_CCR_EN)
+        {
+            const uint8_t *src = hw_ptr(DMA1_Channel3->CMAR);
+
+            if (DMA1_Channel3->CPAR != (uint32_t)(uintptr_t)&host_SPI1.DR || !(SPI1->CR2 & SPI_CR2_TXDMAEN))
+                pn_bad++;
+            for (; DMA1_Channel3->CNDTR != 0; DMA1_Channel3->CNDTR--) pn_byte(*src++);
+            SPI1->SR |= SPI_SR_BSY;
+            hw_dma_irq(DMA_ISR_TCIF3, DMA1_Channel2_3_IRQHandler);
+        }
+        else if (SPI1->CR2 & SPI_CR2_TXEIE)
+        {
+            // The handler writes DR exactly when a byte of the segment is
+            // left; otherwise it retires the segment and may load the next.
+            uint16_t left = oled_q_left;
+
+            SPI1_IRQHandler();
+            if (left != 0) {
+                pn_byte((uint8_t)host_SPI1.DR);
+                SPI1->SR |= SPI_SR_BSY;
+            }
+        }
+        else if (TIM17->CR1 & TIM_CR1_CEN)
+        {
+            SPI1->SR &= ~SPI_SR_BSY;
+            TIM17->SR = TIM_DIER_UIE;
+            TIM17_IRQHandler();
+        }
+        else
+        {
+            printf("oled transport stalled with %u segments queued\n", oled_q_head - oled_q_tail);
+            pn_bad++;
+            break;
+        }
+    }
+    SPI1->SR &= ~SPI_SR_BSY;
+    pn_pins();
+}
+
+
+// One release of the "display" task, then the panel against oled_front.
+static void pn_frame(void)
+{
+    uint32_t diff = 0, view = cfg[CFG_VIEW];
+
+    task_adc_dac();
+    refresh_OLED();
+    if (cfg[CFG_VIEW] != view) pn_views++;
+    pn_drain();
+    pn_frames++;
+
+    for (uint8_t p = 0; p < OLED_PAGES; p++)
+        for (uint8_t c = 0; c < OLED_COLS; c++)
+            if (pn_ram[p][OLED_COL_OFFSET + c] != oled_front[p][c]) diff++;
+    if (diff != 0 && pn_diff == 0)
+        printf("oled frame %u: %u visible bytes differ from oled_front\n", pn_frames, diff);
+    pn_diff += diff;
+}
+
+
+// A sleep: a SysTick goes by and the transport interrupts run.
+static void pn_sleep(void)
+{
+    sys_ms++;
+    pn_drain();
+}
+
+
+// Powers the panel up with noise in its RAM and runs oled_config().
+static void pn_init(void)
+{
+    for (uint32_t p = 0; p < OLED_PAGES; p++)
+        for (uint32_t c = 0; c < PN_RAM_COLS; c++)
+            pn_ram[p][c] = (uint8_t)(((p * PN_RAM_COLS + c) * 0x9E3779B1u) >> 24);
+    pn_reset();
+    pn_enabled = 1;
+    SPI1->SR = SPI_SR_TXE;          // TX FIFO has room whenever SPI1_IRQHandler runs
+    host_gpiob_hook = pn_pins;
+    host_wfi_hook = pn_sleep;       // delay_ms()
+    oled_config();
+    host_wfi_hook = NULL;
+    pn_drain();
+}
+
+
+// Writes the glass image as a plain PBM (1 = lit pixel).
+static int pn_dump(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f) { perror(path); return 2; }
+    fprintf(f, "P1\n# hostsim --oled: panel %s, contrast %u\n%u %u\n",
+            pn_on ? "on" : "off", pn_contrast, OLED_COLS, 8 * OLED_PAGES);
+    for (uint32_t y = 0; y < 8u * OLED_PAGES; y++)
+    {
+        uint32_t com = pn_scan ? 8u * OLED_PAGES - 1 - y : y;
+        uint32_t row = (com + pn_start + pn_offset) % (8u * OLED_PAGES);
+
+        for (uint32_t x = 0; x < OLED_COLS; x++)
+        {
+            uint32_t col = pn_remap ? PN_RAM_COLS - 1 - (OLED_COL_OFFSET + x) : OLED_COL_OFFSET + x;
+            uint32_t bit = (pn_ram[row / 8][col] >> (row % 8)) & 1u;
+
+            if (!pn_on) bit = 0;
+            else if (pn_allon) bit = 1;
+            else bit ^= pn_invert;
+            fputc(bit ? '1' : '0', f);
+            fputc(x + 1 < OLED_COLS ? ' ' : '\n', f);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+
+//---------- Telemetry Link --------------------
+//
+// --tm FILE receives the USART telemetry stream: a DMA1 Channel 2 transfer
+// the firmware starts goes out at the baud rate USART1->BRR gives (10 bits
+// per byte), and its bytes are written to FILE in one piece when it ends,
+// which is when the transfer complete interrupt runs. --tm-pty writes them
+// to a new pseudo-terminal instead, for tools/telemetry_decode.py to read
+// as it would the board's serial port; the run waits until it is opened,
+// and runs no faster than the reader takes the bytes.
+//
+// The stream is also decoded here. Every frame must pass its CRC and follow
+// the one before it (no sequence gaps, i.e. nothing dropped), the edge
+// timestamps must be the ones captured, in order, and the ADC values must
+// follow each other with no count missing.
+
+#define TL_FRAME_MAX 512u
+
+static uint8_t  tl_on;
+static int      tl_fd = -1;
+static uint64_t tl_next_end = UINT64_MAX;   // End of the transfer on the wire
+static uint8_t  tl_buf[TL_FRAME_MAX];       // Encoded frame being received
+static uint32_t tl_len;
+static uint32_t tl_bytes, tl_frames, tl_crc_bad, tl_seq_gaps, tl_bad_setup, tl_types[8];
+static int32_t  tl_seq = -1;
+static uint32_t tl_edges, tl_edges_bad, tl_adc, tl_adc_gaps, tl_adc_bad, tl_dropped;
+static uint32_t tl_adc_next;
+static uint32_t tl_adc_expect;              // Every TM_ADC value, 0 = not known
+static uint64_t tl_t0;
+
+typedef struct {
+    uint32_t *ts;
+    uint32_t n, cap, rd;        // rd = next one the stream should carry
+} tl_caps_t;
+
+static tl_caps_t tl_caps[2];    // Captured timestamps, indexed by FREQ_SEL_*
+
+
+// One timestamp the DMA copied into a capture ring.
+static void tl_capture(uint8_t sel, uint32_t ts)
+{
+    tl_caps_t *c = &tl_caps[sel];
+
+    if (!tl_on) return;
+    if (c->n == c->cap) {
+        c->cap = c->cap ? 2 * c->cap : 4096;
+        c->ts = realloc(c->ts, c->cap * sizeof(uint32_t));
+        if (!c->ts) { perror("realloc"); exit(2); }
+    }
+    c->ts[c->n++] = ts;
+}
+
+
+// Checks one decoded frame (type, seq, body, crc).
+static void tl_frame(const uint8_t *f, uint32_t n)
+{
+    uint16_t seq;
+
+    if (n < 5 || crc16(0xFFFF, f, n - 2) != (uint16_t)(f[n - 2] | f[n - 1] << 8)) {
+        tl_crc_bad++;
+        return;
+    }
+    seq = (uint16_t)(f[1] | f[2] << 8);
+    if (tl_seq >= 0 && seq != (uint16_t)(tl_seq + 1)) tl_seq_gaps++;
+    tl_seq = seq;
+    tl_frames++;
+    tl_types[f[0] & 7]++;
+    f += 3;
+    n -= 5;
+
+    switch (f[-3])
+    {
+    case TM_EDGES: {
+        tm_edges_t e;
+        tl_caps_t *c;
+
+        memcpy(&e, f, n < sizeof(e) ? n : sizeof(e));
+        c = &tl_caps[e.in & 1];
+        if (e.lapped) {
+            // Whatever the ring lost is not expected any more.
+            while (c->rd < c->n && c->ts[c->rd] != e.ts[0]) c->rd++;
+        }
+        for (uint32_t i = 0; i < e.n; i++, tl_edges++)
+            if (c->rd >= c->n || c->ts[c->rd++] != e.ts[i]) tl_edges_bad++;
+        break;
+    }
+    case TM_ADC: {
+        tm_adc_t a;
+
+        memcpy(&a, f, n < sizeof(a) ? n : sizeof(a));
+        if (tl_adc_next != 0 && a.first != tl_adc_next) tl_adc_gaps++;
+        tl_adc_next = a.first + a.n;
+        tl_adc += a.n;
+        for (uint32_t i = 0; i < a.n; i++)
+            if (tl_adc_expect != 0 && a.v[i] != tl_adc_expect) tl_adc_bad++;
+        break;
+    }
+    case TM_LINK: {
+        tm_link_t l;
+
+        memcpy(&l, f, sizeof(l));
+        tl_dropped = l.dropped;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+
+// One byte off the wire: COBS frames end at a 0.
+static void tl_rx(uint8_t b)
+{
+    uint8_t out[TL_FRAME_MAX];
+    uint32_t i = 0, n = 0;
+
+    tl_bytes++;
+    if (b != 0) {
+        if (tl_len < TL_FRAME_MAX) tl_buf[tl_len++] = b;
+        return;
+    }
+    while (i < tl_len)
+    {
+        uint8_t code = tl_buf[i++];
+
+        for (uint8_t k = 1; k < code && i < tl_len; k++) out[n++] = tl_buf[i++];
+        if (code != 0xFF && i < tl_len) out[n++] = 0;
+    }
+    if (tl_len != 0) tl_frame(out, n);
+    tl_len = 0;
+}
+
+
+// Starts timing a transfer the firmware has enabled, if the wire is free.
+static void tl_start(void)
+{
+    uint32_t tdr = (uint32_t)(uintptr_t)&USART1->TDR;
+
+    if (!tl_on || tl_next_end != UINT64_MAX) return;
+    if (!(DMA1_Channel2->CCR & DMA_CCR_EN) || DMA1_Channel2->CNDTR == 0) return;
+    if (DMA1_Channel2->CPAR != tdr || !(DMA1_Channel2->CCR & DMA_CCR_DIR) ||
+        (USART1->CR1 & (USART_CR1_UE | USART_CR1_TE)) != (USART_CR1_UE | USART_CR1_TE) ||
+        !(USART1->CR3 & USART_CR3_DMAT) || USART1->BRR == 0 ||
+        ((GPIOA->MODER >> 18) & 3) != 2 || ((GPIOA->AFR[1] >> 4) & 0xF) != 1)
+        tl_bad_setup++;
+    tl_next_end = hw_now + (uint64_t)DMA1_Channel2->CNDTR * 10 * (USART1->BRR ? USART1->BRR : 1);
+}
+
+
+// The transfer in flight has left the USART: hand its bytes over.
+static void tl_end(void)
+{
+    const uint8_t *src = hw_ptr(DMA1_Channel2->CMAR);
+    uint32_t n = DMA1_Channel2->CNDTR;
+
+    for (uint32_t i = 0; i < n; i++) tl_rx(src[i]);
+    for (uint32_t done = 0; tl_fd >= 0 && done < n; ) {
+        ssize_t w = write(tl_fd, src + done, n - done);
+        if (w <= 0) { perror("telemetry"); tl_fd = -1; break; }
+        done += (uint32_t)w;
+    }
+    DMA1_Channel2->CNDTR = 0;
+    tl_next_end = UINT64_MAX;
+    if (DMA1_Channel2->CCR & DMA_CCR_TCIE) hw_dma_irq(DMA_ISR_TCIF2, DMA1_Channel2_3_IRQHandler);
+    tl_start();
+}
+
+
+// Opens a pseudo-terminal for --tm-pty and waits for a reader on it.
+static int tl_open_pty(void)
+{
+    struct pollfd p;
+    struct termios tio;
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave;
+
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) { perror("pty"); return -1; }
+
+    // Raw from the first byte on (no echo, no line editing): the settings
+    // stay with the terminal while the master is open.
+    if ((slave = open(ptsname(fd), O_RDWR | O_NOCTTY)) < 0) { perror("pty"); return -1; }
+    if (tcgetattr(slave, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    close(slave);
+    fprintf(stderr, "telemetry on %s, waiting for a reader\n", ptsname(fd));
+
+    // The master reports a hang-up until the other side is opened.
+    do {
+        usleep(10000);
+        p.fd = fd;
+        p.events = 0;
+        poll(&p, 1, 0);
+    } while (p.revents & POLLHUP);
+    return fd;
+}
+
+
+// Prints the link summary; returns 1 if the stream was not what it should be.
+static int tl_report(uint64_t t_end)
+{
+    double s = (double)(t_end - tl_t0) / SystemCoreClock;
+    double cap = USART1->BRR ? SystemCoreClock / (10.0 * USART1->BRR) : 0;
+    uint32_t sent = tl_caps[0].rd + tl_caps[1].rd;
+    int fail = 0;
+
+    printf("tm   %u frames (%u edges, %u readings, %u adc, %u stats), %.0f B/s = %.0f%% of the link; "
+           "%u of %u captured edges sent, %u wrong; %u adc values, %u gaps; "
+           "%u crc errors, %u seq gaps, %u dropped, ring peak %u of %u\n",
+           tl_frames, tl_types[TM_EDGES], tl_types[TM_READING], tl_types[TM_ADC], tl_types[TM_STATS],
+           tl_bytes / s, cap ? 100.0 * tl_bytes / s / cap : 0, sent, tl_caps[0].n + tl_caps[1].n,
+           tl_edges_bad, tl_adc, tl_adc_gaps, tl_crc_bad, tl_seq_gaps, tm_link.dropped, tm_link.peak, TM_RING_LEN);
+    if (tl_frames == 0 || tl_types[TM_BOOT] != 1 || tl_bad_setup) fail = 1;
+    if (tl_crc_bad || tl_seq_gaps || tm_link.dropped || tl_dropped) fail = 1;
+    if (tl_edges_bad || tl_adc_gaps || tl_adc_bad) fail = 1;
+    if (tl_bad_setup) printf("tm   %u transfers with USART1/DMA1 Channel 2/PA9 not set up\n", tl_bad_setup);
+    if (tl_adc_bad) printf("tm   %u adc values not the input\n", tl_adc_bad);
+    return fail;
+}
+
+
+//---------- Readings --------------------
+
+typedef struct {
+    uint64_t t;             // Poll that produced the reading
+    uint64_t t_end;         // Last edge of its span
+    uint32_t freq_mHz;
+    uint32_t periods;
+    uint32_t res_ppb;       // Resolution the firmware claims for it
+    uint32_t duty_ppm;      // 0 = not measured
+    uint8_t  range;
+    double   truth_hz;      // 0 = not known
+} reading_t;
+
+typedef struct {
+    reading_t *r;
+    uint32_t n, cap;
+    uint32_t seen;          // Result sequence number last collected
+} reading_log_t;
+
+static reading_log_t readings[2];
+static uint32_t hw_sel_bad;         // Polls where Freq_mHz was not the selected input
+
+
+// The input the firmware displays as Freq.
+static uint8_t selected_input(void)
+{
+    return (freq_sel == FREQ_SEL_555) ? IN_555 : IN_FG;
+}
+
+
+// Collects the reading a poll published for one input, if any.
+static void readings_collect_input(uint8_t in)
+{
+    const freq_result_t *res = &freq_in[in == IN_555 ? FREQ_SEL_555 : FREQ_SEL_FG];
+    reading_log_t *log = &readings[in];
+    reading_t *r;
+
+    if (res->seq == log->seen) return;
+    log->seen = res->seq;
+
+    if (log->n == log->cap) {
+        log->cap = log->cap ? 2 * log->cap : 1024;
+        log->r = realloc(log->r, log->cap * sizeof(reading_t));
+        if (!log->r) { perror("realloc"); exit(2); }
+    }
+    r = &log->r[log->n++];
+    r->t = hw_now;
+    r->t_end = hw_last_rise[in];
+    r->freq_mHz = res->mHz;
+    r->periods = res->periods;
+    r->res_ppb = res->res_ppb;
+    r->duty_ppm = res->duty_ppm;
+    r->range = res->range;
+    r->truth_hz = 0;
+}
+
+
+// Collects both inputs, and checks Freq is the selected one's reading.
+static void readings_collect(void)
+{
+    readings_collect_input(IN_555);
+    readings_collect_input(IN_FG);
+    if (Freq_mHz != freq_in[selected_input() == IN_555 ? FREQ_SEL_555 : FREQ_SEL_FG].mHz) hw_sel_bad++;
+}
+
+
+// One release of the measure, calibration, telemetry and trace tasks, and
+// of the display and statistics tasks when they are due.
+static uint32_t hw_polls;
+
+static void hw_poll(void)
+{
+    freq_capture_poll();
+    DMA1->ISR &= ~DMA1->IFCR;       // What the firmware's flag clears did
+    DMA1->IFCR = 0;
+    task_cal();
+    adc_send_batch();
+    if (++hw_polls % (1000 / POLL_MS) == 0) task_stats();
+    while (evt_tail != evt_head) evt_drain();
+    readings_collect();
+    tl_start();
+
+    if (pn_enabled && ++pn_polls == PN_FRAME_MS / POLL_MS) {
+        pn_polls = 0;
+        pn_frame();
+    }
+}
+
+
+//---------- Generators --------------------
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+// Uniform in [0, 1).
+static double rng_uniform(void)
+{
+    return (double)(rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_gauss(void)
+{
+    double u = rng_uniform(), v = rng_uniform();
+
+    return sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+}
+
+typedef struct {
+    double hz;              // Nominal frequency, 0 = input off
+    double duty;            // High fraction of a period
+    double jitter;          // RMS edge jitter (ticks)
+    double glitch;          // Glitch probability per period
+    double miss;            // Rising-edge loss probability per period
+    uint8_t kind_rise;      // EV_* of the rising edges
+    uint8_t kind_fall;      // EV_* of the falling edges, EV_NONE = not captured
+    uint8_t varying;        // hz follows the plant: no truth, no spike check
+    uint8_t startup;        // First period is a 555's first after power-up
+    double drift;           // Fractional change of hz per second, open loop
+    double step;            // hz is multiplied by this from step_t on, 0 = no step
+    double step_t;
+    double glitch_w;        // Glitch pulse width (ticks)
+    double filter;          // Shortest pulse the capture input passes (ticks)
+    double t;               // Ideal time of the next rising edge (ticks)
+    uint32_t n;             // Periods generated
+    uint64_t ev[6];         // Edges of the current period, in time order
+    uint8_t  ev_kind[6];
+    uint8_t  ev_n, ev_i;
+} gen_t;
+
+static gen_t gen_555 = { .duty = 0.6, .kind_rise = EV_555_RISE, .kind_fall = EV_555_FALL };
+static gen_t gen_fg  = { .duty = 0.5, .kind_rise = EV_FG_RISE,  .kind_fall = EV_NONE };
+
+// A 555 charges its capacitor from 0 V after power-up instead of from
+// Vcc/3: its first high phase is ln 3 / ln 2 times the usual one.
+#define GEN_FIRST_HIGH     1.5849625
+
+static uint32_t gen_adc_code;       // 0 = ADC input off
+static uint32_t gen_adc_noise;
+static uint64_t gen_adc_next;
+static uint64_t gen_adc_step;
+
+
+static void gen_add(gen_t *g, double t, uint8_t kind)
+{
+    uint8_t i;
+
+    if (kind == EV_NONE) return;
+    if (g->jitter != 0) t += g->jitter * rng_gauss();
+    if (t < 0) t = 0;
+
+    // Insertion in time order; the jitter may reorder two close edges.
+    for (i = g->ev_n; i > 0 && (double)g->ev[i - 1] > t; i--) {
+        g->ev[i] = g->ev[i - 1];
+        g->ev_kind[i] = g->ev_kind[i - 1];
+    }
+    g->ev[i] = (uint64_t)llround(t);
+    g->ev_kind[i] = kind;
+    g->ev_n++;
+}
+
+
+// Frequency at time t (ticks), with the step and the drift.
+static double gen_hz(const gen_t *g, double t)
+{
+    double hz = (g->step != 0 && t >= g->step_t) ? g->hz * g->step : g->hz;
+
+    return hz * (1.0 + g->drift * t / SystemCoreClock);
+}
+
+
+// Lays out the edges of the next period.
+static void gen_period(gen_t *g)
+{
+    double period = SystemCoreClock / gen_hz(g, g->t + SystemCoreClock / (2 * g->hz));
+    double high = g->duty * period;
+    double width = g->glitch_w;
+
+    if (g->n == 0 && g->startup) {
+        period += (GEN_FIRST_HIGH - 1) * high;
+        high *= GEN_FIRST_HIGH;
+    }
+    g->ev_n = g->ev_i = 0;
+    if (rng_uniform() >= g->miss) gen_add(g, g->t, g->kind_rise);
+    gen_add(g, g->t + high, g->kind_fall);
+
+    // A glitch inverts the level for `width` ticks somewhere in the period:
+    // fall + rise in the high phase, rise + fall in the low phase. The input
+    // removes pulses shorter than its filter.
+    if (g->glitch != 0 && rng_uniform() < g->glitch && width >= g->filter)
+    {
+        double at = g->t + (0.05 + 0.9 * rng_uniform()) * (period - width);
+
+        if (at + width < g->t + high || at > g->t + high) {
+            uint8_t high_phase = at < g->t + high;
+            gen_add(g, at, high_phase ? g->kind_fall : g->kind_rise);
+            gen_add(g, at + width, high_phase ? g->kind_rise : g->kind_fall);
+        }
+    }
+
+    g->t += period;
+    g->n++;
+}
+
+
+static uint64_t gen_peek(gen_t *g)
+{
+    if (g->hz == 0) return UINT64_MAX;
+    while (g->ev_i == g->ev_n) gen_period(g);
+    return g->ev[g->ev_i];
+}
+
+
+//---------- Button --------------------
+//
+// The USER button on PA0. A press closes the contact, which then opens and
+// closes again `bt_bounce` times at random within BT_BOUNCE_US; it is held
+// BT_HOLD_MS and released the same way. With bouncing on, one isolated
+// BT_SPIKE_US pulse (interference) also lands halfway between presses. Every
+// edge sets GPIOA->IDR and, while EXTI line 0 is unmasked and triggers on
+// it, runs EXTI0_1_IRQHandler; hw_advance runs the debounce's SysTick part,
+// btn_tick(), every millisecond while a window is open. Each press must
+// toggle freq_sel exactly once, at one interrupt per press and release, and
+// each spike must end as a rejected window. --hold MS holds every press
+// that long instead; from BTN_VIEW_MS on, each must switch the OLED layout
+// (and leave it in flash), from BTN_LONG_MS on the low-power mode, instead
+// of freq_sel.
+
+#define BT_HOLD_MS     150u
+#define BT_BOUNCE_US   3000u
+#define BT_SPIKE_US    50u
+#define BT_EDGES_MAX   8192u
+
+static uint64_t bt_t[BT_EDGES_MAX];     // Edges in time order
+static uint8_t  bt_level[BT_EDGES_MAX];
+static uint32_t bt_n, bt_i;
+static uint32_t bt_bounce;              // Bounces per press and per release
+static uint32_t bt_presses, bt_spikes;
+static uint32_t bt_toggles;             // freq_sel changes seen
+static uint32_t bt_hold_ms = BT_HOLD_MS;
+
+
+static void bt_add(double t, uint8_t level)
+{
+    if (bt_n == BT_EDGES_MAX) return;
+    bt_t[bt_n] = (uint64_t)llround(t);
+    bt_level[bt_n++] = level;
+}
+
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+// The edges of a contact going to `level` at t, bounces included.
+static void bt_settle(double t, uint8_t level)
+{
+    double at[2 * 64];
+    uint32_t n = 2 * (bt_bounce < 64 ? bt_bounce : 64);
+
+    bt_add(t, level);
+    for (uint32_t i = 0; i < n; i++) at[i] = rng_uniform() * BT_BOUNCE_US;
+    qsort(at, n, sizeof(at[0]), cmp_double);
+    for (uint32_t i = 0; i < n; i++) bt_add(t + at[i] * (SystemCoreClock / 1e6), (uint8_t)(level ^ !(i & 1)));
+}
+
+
+static void bt_press(double t)
+{
+    double ms = SystemCoreClock / 1000.0;
+
+    bt_settle(t, 1);
+    bt_settle(t + bt_hold_ms * ms, 0);
+    bt_presses++;
+}
+
+
+// Lays out a press at start-up (if `first`) and `n` more evenly over `seconds`.
+static void bt_plan(int first, uint32_t n, double seconds)
+{
+    double gap = seconds * SystemCoreClock / (n + 1);
+
+    if (first) bt_press(SystemCoreClock / 1000.0);
+    for (uint32_t k = 1; k <= n; k++) {
+        bt_press(k * gap);
+        if (bt_bounce && k < n) {
+            bt_add((k + 0.5) * gap, 1);
+            bt_add((k + 0.5) * gap + BT_SPIKE_US * (SystemCoreClock / 1e6), 0);
+            bt_spikes++;
+        }
+    }
+}
+
+
+// One edge on PA0.
+static void hw_button(uint64_t t, uint8_t level)
+{
+    uint32_t trig = level ? EXTI->RTSR : EXTI->FTSR;
+
+    hw_set_time(t);
+    if (level) GPIOA->IDR |= GPIO_IDR_0;
+    else GPIOA->IDR &= ~GPIO_IDR_0;
+    if ((EXTI->IMR & EXTI_IMR_MR0) && (trig & EXTI_RTSR_TR0)) {
+        EXTI->PR |= EXTI_PR_PR0;
+        EXTI0_1_IRQHandler();
+        EXTI->PR &= ~EXTI_PR_PR0;
+    }
+}
+
+
+typedef struct {
+    uint64_t t;
+    uint8_t  kind;
+    uint16_t sample;
+} event_t;
+
+
+//---------- Edge Files --------------------
+//
+// --record FILE saves the input events of a run, and --replay FILE feeds
+// them back in place of the generators, through the same virtual TIM2
+// capture and ADC, so a stream seen once can be measured again by any
+// later main.c. telemetry_decode.py --edges writes one from a board's
+// telemetry. The file is
+//
+//   "EDG1" | uint32 clock_hz (little-endian) | record...
+//
+// and a record one LEB128 varint of (delta << 2 | kind), followed by a
+// second varint with the 12-bit sample when kind is EV_ADC. delta is in
+// ticks of clock_hz since the record before it (since 0 for the first);
+// kind is EV_555_RISE, EV_555_FALL, EV_FG_RISE or EV_ADC. At 48 MHz an
+// edge takes two bytes up to 85 us after the one before, three up to
+// 10.9 ms. A replay scales the times to SystemCoreClock and
+// ends at the last complete record. The button is not part of the file:
+// --presses generates it on a replay too.
+
+#define EF_MAGIC           "EDG1"
+
+static FILE *ef_out;                // --record
+static uint64_t ef_out_t;           // Time of the last record written
+
+static uint8_t *ef_buf;             // --replay, the whole file
+static size_t ef_len, ef_pos;
+static double ef_scale;             // SystemCoreClock / its clock
+static uint64_t ef_t;               // Time of the last record read, its ticks
+static event_t ef_next;
+static uint8_t ef_pending;          // ef_next is read but not yet taken
+
+
+static void ef_put(uint64_t v)
+{
+    while (v >= 0x80) {
+        putc((int)(v & 0x7F) | 0x80, ef_out);
+        v >>= 7;
+    }
+    putc((int)v, ef_out);
+}
+
+
+static int ef_get(uint64_t *v)
+{
+    uint64_t x = 0;
+
+    for (unsigned sh = 0; ef_pos < ef_len && sh < 64; sh += 7)
+    {
+        uint8_t b = ef_buf[ef_pos++];
+
+        x |= (uint64_t)(b & 0x7F) << sh;
+        if (!(b & 0x80)) {
+            *v = x;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int ef_record_open(const char *path)
+{
+    uint32_t hz = SystemCoreClock;
+    uint8_t le[4] = { (uint8_t)hz, (uint8_t)(hz >> 8), (uint8_t)(hz >> 16), (uint8_t)(hz >> 24) };
+
+    if (!(ef_out = fopen(path, "wb"))) { perror(path); return -1; }
+    fwrite(EF_MAGIC, 1, 4, ef_out);
+    fwrite(le, 1, 4, ef_out);
+    return 0;
+}
+
+
+// Appends an input event; the button is left out.
+static void ef_record(const event_t *e)
+{
+    if (e->kind > EV_ADC) return;
+    ef_put((e->t - ef_out_t) << 2 | e->kind);
+    if (e->kind == EV_ADC) ef_put(e->sample);
+    ef_out_t = e->t;
+}
+
+
+static int ef_replay_open(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    uint32_t hz;
+    long n;
+
+    if (!f) { perror(path); return -1; }
+    if (fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) < 8 || fseek(f, 0, SEEK_SET) != 0 ||
+        !(ef_buf = malloc((size_t)n)) || fread(ef_buf, 1, (size_t)n, f) != (size_t)n ||
+        memcmp(ef_buf, EF_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s: not an edge file\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    hz = ef_buf[4] | ef_buf[5] << 8 | ef_buf[6] << 16 | (uint32_t)ef_buf[7] << 24;
+    if (hz == 0) {
+        fprintf(stderr, "%s: no clock\n", path);
+        return -1;
+    }
+    ef_len = (size_t)n;
+    ef_pos = 8;
+    ef_scale = (double)SystemCoreClock / hz;
+    return 0;
+}
+
+
+// Time of the next replayed event, UINT64_MAX at the end of the file.
+static uint64_t ef_peek(void)
+{
+    uint64_t v, sample = 0;
+
+    if (ef_pending) return ef_next.t;
+    if (!ef_get(&v) || ((v & 3) == EV_ADC && !ef_get(&sample))) return UINT64_MAX;
+    ef_t += v >> 2;
+    ef_next.t = (ef_scale == 1.0) ? ef_t : (uint64_t)llround((double)ef_t * ef_scale);
+    ef_next.kind = (uint8_t)(v & 3);
+    ef_next.sample = (uint16_t)(sample > 0xFFF ? 0xFFF : sample);
+    ef_pending = 1;
+    return ef_next.t;
+}
+
+
+
+//---------- Low Power --------------------
+//
+// --lowpower starts the firmware in low-power mode, as a long press would,
+// and the display path with it (the panel must end up off). pwr_idle() runs
+// after every poll, telemetry transfer, TIM16 update and SysTick hw_advance
+// runs, as the main loop would call it once the tasks are done. A Sleep
+// returns at once: the next of those is the next interrupt. A Stop
+// (SLEEPDEEP set at the WFI) is hw_stop, which moves to the next second of
+// the RTC, clocked by an LSI at HW_LSI_HZ, or to the next USER button edge
+// if EXTI line 0 is unmasked, whichever comes first. TIM2, SysTick and
+// TIM16 stand still meanwhile, and the input edges and ADC samples are
+// lost. The PLL then takes HW_LOCK_US to lock, and TIM2 counts at 8 MHz
+// during that time.
+//
+// The firmware's Stop time must be within HW_STOP_TOL of the true one, its
+// run time within HW_STOP_TOL of the time awake, and its readings as good
+// as without Stop.
+
+#define HW_LSI_HZ    37000.0        // Within the LSI's 30-50 kHz, off its nominal 40 kHz
+#define HW_LOCK_US   200u
+#define HW_STOP_TOL  0.02
+
+static uint64_t hw_stop_ticks;      // True time spent in Stop
+static uint64_t hw_lock_ticks;      // and in clock restarts
+static uint32_t hw_stops;
+static uint32_t hw_modes;           // pwr_low changes seen
+static uint8_t  hw_locking;         // A wake-up waits for the PLL
+static const event_t *hw_event;     // Event the run is advancing to
+
+
+static uint32_t hw_bcd(uint32_t v)
+{
+    return (v / 10) << 4 | (v % 10);
+}
+
+
+// RTC units (1/(PWR_RTC_PREDIV_S + 1) s) at time t, and back.
+static uint64_t hw_rtc_units(uint64_t t)
+{
+    return (uint64_t)((double)t * HW_LSI_HZ / (PWR_RTC_PREDIV_A + 1) / SystemCoreClock);
+}
+
+
+static uint64_t hw_rtc_time(uint64_t units)
+{
+    return (uint64_t)ceil((double)units * (PWR_RTC_PREDIV_A + 1) * SystemCoreClock / HW_LSI_HZ);
+}
+
+
+// The calendar counters at time t (from 00:00:00 at t = 0).
+static void hw_rtc_set(uint64_t t)
+{
+    uint64_t u = hw_rtc_units(t);
+    uint32_t sec = (uint32_t)(u / PWR_RTC_UNITS % 86400u);
+
+    RTC->SSR = PWR_RTC_PREDIV_S - (uint32_t)(u % PWR_RTC_UNITS);
+    RTC->TR = hw_bcd(sec / 3600) << 16 | hw_bcd(sec / 60 % 60) << 8 | hw_bcd(sec % 60);
+}
+
+
+// First edge of the USER button from now on, the one being advanced to
+// included.
+static uint64_t hw_next_button(void)
+{
+    if (hw_event && hw_event->kind == EV_BTN) return hw_event->t;
+    return (bt_i < bt_n) ? bt_t[bt_i] : UINT64_MAX;
+}
+
+
+// __WFI: a Stop if SLEEPDEEP is set, otherwise a Sleep that returns at once.
+static void hw_stop(void)
+{
+    uint64_t t0 = hw_now, wake, btn;
+    int by_rtc = 1;
+
+    if (!(SCB->SCR & SCB_SCR_SLEEPDEEP_Msk)) return;
+    wake = hw_rtc_time((hw_rtc_units(t0) / PWR_RTC_UNITS + 1) * PWR_RTC_UNITS);
+    btn = hw_next_button();
+    if (!(PWR->CR & PWR_CR_LPDS) || (PWR->CR & PWR_CR_PDDS)) printf("pwr  WFI with SLEEPDEEP but not Stop\n");
+
+    if ((EXTI->IMR & EXTI_IMR_MR0) && btn < wake) {
+        wake = btn;
+        by_rtc = 0;
+    }
+    // freq_capture_resume() drops what was captured since the last poll.
+    for (int k = 0; k < 2; k++) tl_caps[k].rd = tl_caps[k].n;
+
+    hw_stops++;
+    hw_stop_ticks += wake - t0;
+    hw_lost += wake - t0;
+    if (hw_next_pi != UINT64_MAX) hw_next_pi += wake - t0;
+    hw_set_time(wake);
+    RCC->CR &= ~RCC_CR_PLLON;       // Stop leaves the core on HSI
+    hw_locking = 1;
+
+    if (by_rtc && (RTC->CR & (RTC_CR_ALRAE | RTC_CR_ALRAIE)) == (RTC_CR_ALRAE | RTC_CR_ALRAIE) &&
+        (EXTI->IMR & EXTI_IMR_MR17)) {
+        RTC->ISR |= RTC_ISR_ALRAF;
+        EXTI->PR |= EXTI_PR_PR17;
+        RTC_IRQHandler();
+    }
+}
+
+
+// The PLL locks: HW_LOCK_US go by, which TIM2 counts at 8 MHz.
+static void hw_pll_lock(void)
+{
+    uint64_t lock = (uint64_t)HW_LOCK_US * (SystemCoreClock / 1000000u);
+
+    if (!hw_locking) return;
+    hw_locking = 0;
+    hw_lock_ticks += lock;
+    hw_lost += lock - lock / (SystemCoreClock / PWR_HSI_HZ);
+    hw_set_time(hw_now + lock);
+}
+
+
+// The main loop going idle. After a Stop, sys_ms goes on from where the
+// firmware put it, and every task is released afresh.
+static void hw_idle(void)
+{
+    uint32_t stops = hw_stops;
+    uint8_t low = pwr_low;
+
+    pwr_idle();
+    if (pwr_low != low) hw_modes++;
+    if (pn_enabled) pn_drain();
+    if (hw_stops != stops) {
+        uint32_t fw = sys_ms;
+
+        hw_set_time(hw_now);
+        hw_ms_add += fw - sys_ms;
+        sys_ms = fw;
+        DMA1->ISR &= ~DMA1->IFCR;   // freq_capture_resume()
+        DMA1->IFCR = 0;
+        hw_next_poll = hw_now;
+        hw_polls = 1000 / POLL_MS - 1;
+        pn_polls = PN_FRAME_MS / POLL_MS - 1;
+    }
+}
+
+
+// Checks the firmware's account of the power states against the truth.
+static int hw_power_report(void)
+{
+    uint64_t ms = SystemCoreClock / 1000u;
+    uint64_t run = tim2_now64() - pwr_ticks[PWR_SLEEP] - pwr_ticks[PWR_WAKE];
+    double awake = (double)(hw_now - hw_stop_ticks - hw_lock_ticks) / ms;
+    double stop = (double)pwr_ticks[PWR_STOP] / ms, stop_true = (double)hw_stop_ticks / ms;
+    uint32_t n = freq_in[0].seq + freq_in[1].seq;
+    int fail = 0;
+
+    printf("pwr  %s, %u stops (%u seen); stop %.0f ms (true %.0f), run %.0f ms (awake %.0f), "
+           "wake-up %u us max; %u readings, %.1f ms awake each\n",
+           pwr_low ? "low" : "normal", pwr_stops, hw_stops, stop, stop_true, (double)run / ms, awake,
+           pwr_wake_max / (PWR_HSI_HZ / 1000000u), n, n ? awake / n : 0);
+    if (pwr_stops != hw_stops) fail = 1;
+    if (fabs(stop - stop_true) > HW_STOP_TOL * stop_true + 1) fail = 1;
+    if (fabs((double)run / ms - awake) > HW_STOP_TOL * awake + 1) fail = 1;
+    if (hw_stops && pwr_wake_max / (PWR_HSI_HZ / 1000000u) != HW_LOCK_US) fail = 1;
+    return fail;
+}
+
+
+// Next event of the generated or replayed inputs, in time order.
+static int gen_read(event_t *e)
+{
+    uint64_t tb = (bt_i < bt_n) ? bt_t[bt_i] : UINT64_MAX;
+    uint64_t t5 = UINT64_MAX, tf = UINT64_MAX, ta = UINT64_MAX;
+    gen_t *g = &gen_555;
+
+    if (ef_buf)
+    {
+        // A replayed file stands in for the generated inputs.
+        uint64_t tr = ef_peek();
+
+        if (tr <= tb) {
+            if (tr == UINT64_MAX) return 0;
+            *e = ef_next;
+            ef_pending = 0;
+            return 1;
+        }
+    }
+    else
+    {
+        t5 = gen_peek(&gen_555);
+        tf = gen_peek(&gen_fg);
+        ta = gen_adc_code ? gen_adc_next : UINT64_MAX;
+        g = (t5 <= tf) ? &gen_555 : &gen_fg;
+    }
+
+    if (tb < t5 && tb < tf && tb <= ta)
+    {
+        e->t = tb;
+        e->kind = EV_BTN;
+        e->sample = bt_level[bt_i++];
+        return 1;
+    }
+
+    if (ta < t5 && ta < tf)
+    {
+        int32_t v = (int32_t)gen_adc_code;
+
+        if (gen_adc_noise) v += (int32_t)(rng_next() % (2 * gen_adc_noise + 1)) - (int32_t)gen_adc_noise;
+        e->t = ta;
+        e->kind = EV_ADC;
+        e->sample = (uint16_t)(v < 0 ? 0 : v > 0xFFF ? 0xFFF : v);
+        gen_adc_next += gen_adc_step;
+        return 1;
+    }
+    if (g->hz == 0) return 0;
+    e->t = g->ev[g->ev_i];
+    e->kind = g->ev_kind[g->ev_i++];
+    return 1;
+}
+
+
+//---------- Plant --------------------
+//
+// --pi HZ closes the DAC control loop (pi_enable) against a model of the
+// DAC -> optocoupler -> 555 path, with the controller's setpoint fixed at HZ
+// (0 = the potentiometer, given with --adc). The 555 then runs at
+//
+//   f = (PL_F_LO + (pl_f_hi - PL_F_LO) * (PL_LIN + (1 - PL_LIN) * u) * u) * (1 + drift * t)
+//
+// with u = x / 4095, where x follows the DAC code with a first-order lag of
+// PL_TAU_MS (the LED and the photoresistor). The gain therefore rises
+// from 0.3 to 1.7 times its mean across the range, and --drift
+// PPM/S walks it the way temperature does. --pi-step HZ moves the fixed
+// setpoint to HZ halfway through the run. --pi-cfg N stores N as CFG_PI_HZ
+// instead (1 = the potentiometer), and the firmware closes the loop from
+// its settings; --pi-step then goes through cfg_set(). Every TIM16 update runs
+// TIM16_IRQHandler, in time order with the measure task's polls.
+//
+// --cal runs a calibration sweep against the same plant from the start (the
+// controller, if closed, takes over once it is done). The table it leaves
+// in flash is then checked in both directions against the plant's static
+// curve: --max-cal-err PPM bounds the error of cal_dac_to_mHz() and of the
+// frequency the plant gives at cal_mHz_to_dac()'s code. --span HZ sets
+// the plant's range (PL_F_HI - PL_F_LO by default) to HZ.
+
+#define PL_F_LO     300.0
+#define PL_F_HI     3000.0
+#define PL_LIN      0.3         // Slope at code 0, relative to the mean
+#define PL_TAU_MS   40.0
+
+static uint8_t  pl_enabled;
+static double   pl_x;               // Lagged DAC code
+static double   pl_drift;           // Per second
+static uint64_t pl_t;               // Time of pl_x
+static double   pl_f_hi = PL_F_HI;  // Frequency at code 4095
+
+
+// Settled frequency at DAC code x, without drift.
+static double pl_static(double x)
+{
+    double u = x / 4095;
+
+    return PL_F_LO + (pl_f_hi - PL_F_LO) * (PL_LIN + (1 - PL_LIN) * u) * u;
+}
+
+
+// Brings the plant to time t and sets the 555's frequency from it.
+static void pl_step(uint64_t t)
+{
+    double dt = (double)(t - pl_t) / SystemCoreClock;
+    double u = (double)(DAC->DHR12R1 & 0xFFF);
+
+    pl_x += (u - pl_x) * (1.0 - exp(-dt * 1000.0 / PL_TAU_MS));
+    pl_t = t;
+    gen_555.hz = pl_static(pl_x) * (1.0 + pl_drift * (double)t / SystemCoreClock);
+}
+
+
+// Largest error of the calibration table against pl_static (ppm): DAC code
+// to frequency, and frequency to DAC code (as the frequency the plant gives
+// at that code).
+static void pl_cal_errors(double *fwd_ppm, double *inv_ppm)
+{
+    *fwd_ppm = *inv_ppm = 0;
+    for (uint32_t code = 0; code <= 0xFFF; code++) {
+        double f = pl_static(code);
+        double e = fabs(cal_dac_to_mHz(code) / (double)FREQ_SCALE - f) / f * 1e6;
+        if (e > *fwd_ppm) *fwd_ppm = e;
+    }
+    for (uint32_t k = 0; k <= 1000; k++) {
+        double f = PL_F_LO + (pl_f_hi - PL_F_LO) * k / 1000;
+        double e = fabs(pl_static(cal_mHz_to_dac((uint32_t)(f * FREQ_SCALE))) - f) / f * 1e6;
+        if (e > *inv_ppm) *inv_ppm = e;
+    }
+}
+
+
+// Period of TIM16 as the firmware set it up, in TIM2 ticks.
+static uint64_t pl_tim16_ticks(void)
+{
+    if (!(TIM16->CR1 & TIM_CR1_CEN) || !(TIM16->DIER & TIM_DIER_UIE)) return 0;
+    return (uint64_t)(TIM16->PSC + 1) * (TIM16->ARR + 1);
+}
+
+
+// Runs the polls, TIM16 updates and (while the button debounces, or Stop
+// waits for an RTC edge) SysTicks due up to time t, in time order; in low-power mode the main loop goes
+// idle after each.
+static void hw_advance(uint64_t t)
+{
+    uint64_t ms = SystemCoreClock / 1000u;
+
+    for (;;)
+    {
+        uint64_t next = (hw_next_pi < hw_next_poll) ? hw_next_pi : hw_next_poll;
+        uint64_t tick = (btn_wait || pwr_edge_rtc != PWR_RTC_DAY) ? (hw_now / ms + 1) * ms : UINT64_MAX;
+
+        if (tl_next_end < next) next = tl_next_end;
+        if (tick < next) next = tick;
+        if (next > t) break;
+        hw_set_time(next);
+        if (pl_enabled) pl_step(next);
+        if (next == tick) {
+            uint8_t sel = freq_sel;
+            btn_tick();
+            if (freq_sel != sel) bt_toggles++;
+        }
+        else if (next == tl_next_end) {
+            tl_end();
+        }
+        else if (next == hw_next_pi) {
+            uint64_t p = pl_tim16_ticks();
+            TIM16->SR |= TIM_SR_UIF;
+            TIM16_IRQHandler();
+            hw_next_pi = p ? hw_next_pi + p : UINT64_MAX;
+        }
+        else {
+            hw_poll();
+            hw_next_poll += hw_poll_ticks;
+        }
+        if (pwr_low || pwr_low_want) hw_idle();
+    }
+}
+
+
+//---------- Checks --------------------
+
+typedef struct {
+    uint32_t n, settled;
+    double err_max, err_sq;         // ppm, settled readings with a truth
+    uint32_t err_n;
+    uint32_t spikes;
+    uint32_t over_res;              // Off by more than their claimed resolution
+    uint32_t duty_n;                // Settled readings with a duty cycle
+    double duty_err_max;            // Their largest error, ppm of a period
+} check_t;
+
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static void check_input(reading_log_t *log, const gen_t *g, uint64_t settle, double spike_ppm, check_t *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->n = log->n;
+
+    for (uint32_t i = 0; i < log->n; i++)
+    {
+        reading_t *r = &log->r[i];
+
+        // With drift, the truth is the frequency at the middle of the span;
+        // a span across the step has none.
+        if (g->hz != 0 && !g->varying && r->freq_mHz != 0) {
+            double span = r->periods * (double)FREQ_SCALE / r->freq_mHz * SystemCoreClock;
+            if (g->step == 0 || r->t_end - span >= g->step_t || r->t_end < g->step_t)
+                r->truth_hz = gen_hz(g, r->t_end - span / 2);
+        }
+        if (r->t < settle) continue;
+        c->settled++;
+
+        if (r->truth_hz != 0) {
+            double err = fabs(r->freq_mHz / (double)FREQ_SCALE - r->truth_hz) / r->truth_hz * 1e6;
+            if (err > c->err_max) c->err_max = err;
+            c->err_sq += err * err;
+            c->err_n++;
+
+            // The claimed resolution is a bound only for clean edges.
+            if (g->jitter == 0 && g->glitch == 0 && g->miss == 0 && err * 1000 > r->res_ppb) c->over_res++;
+        }
+        if (!g->varying && i >= 2 && i + 2 < log->n) {
+            uint32_t nb[4] = { log->r[i - 2].freq_mHz, log->r[i - 1].freq_mHz,
+                               log->r[i + 1].freq_mHz, log->r[i + 2].freq_mHz };
+            double med;
+
+            qsort(nb, 4, sizeof(nb[0]), cmp_u32);
+            med = (nb[1] + (double)nb[2]) / 2;
+            if (med != 0 && fabs(r->freq_mHz - med) / med * 1e6 > spike_ppm) c->spikes++;
+        }
+        if (r->duty_ppm != 0) {
+            double err = fabs(r->duty_ppm - g->duty * 1e6);
+            if (err > c->duty_err_max) c->duty_err_max = err;
+            c->duty_n++;
+        }
+    }
+}
+
+
+static void readings_csv(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f) { perror(path); exit(2); }
+    fprintf(f, "t_s,input,freq_hz,periods,true_hz,err_ppm\n");
+    for (uint8_t in = 0; in < 2; in++)
+    {
+        for (uint32_t i = 0; i < readings[in].n; i++)
+        {
+            const reading_t *r = &readings[in].r[i];
+            double hz = r->freq_mHz / (double)FREQ_SCALE;
+
+            fprintf(f, "%.6f,%s,%.3f,%u", (double)r->t / SystemCoreClock,
+                    in == IN_555 ? "555" : "fg", hz, r->periods);
+            if (r->truth_hz != 0) fprintf(f, ",%.3f,%.1f\n", r->truth_hz, (hz - r->truth_hz) / r->truth_hz * 1e6);
+            else fprintf(f, ",,\n");
+        }
+    }
+    fclose(f);
+}
+
+
+//---------- Unit Checks --------------------
+//
+// Checks of single pieces of main.c that need no input stream; each is a
+// mode of its own (--freq-math, --fmt, --font, --stats, --snap) and part of
+// --selftest.
+
+// freq_from_ticks against 1e3 * SystemCoreClock / count, the formula it
+// replaced: the integer result must be that value truncated (less than
+// 1 mHz low, never high), or 0xFFFFFFFF once it does not fit. The whole-Hz
+// Freq must equal what the old double code gave, (int)(1.0 / period), except
+// at counts that divide the clock exactly, where the old code could come out
+// 1 Hz low.
+static uint32_t fm_fails;
+
+static void fm_check(uint32_t count)
+{
+    double ref = 1e3 * SystemCoreClock / (double)count;
+    double period = (double)count / (double)SystemCoreClock;
+    int old_hz = 1.0 / period;
+    uint32_t mhz = freq_from_ticks(count);
+    int ok;
+
+    if (ref >= 4294967296.0) {
+        ok = (mhz == 0xFFFFFFFFu);
+    } else {
+        ok = (ref - mhz >= -1e-6 && ref - mhz < 1);
+        if (mhz / FREQ_SCALE != (uint32_t)old_hz)
+            ok = ok && (SystemCoreClock % count == 0) && (uint32_t)old_hz + 1 == mhz / FREQ_SCALE;
+    }
+    if (!ok && fm_fails++ < 10)
+        printf("freq math: %u ticks: %u mHz, want %.3f (old code %d Hz)\n", count, mhz, ref, old_hz);
+}
+
+static int check_freq_math(void)
+{
+    uint32_t n = 0, divisors = 0, low = 0;
+
+    // Every count up to 2^24 (down to 2.86 Hz, and the clipped ones below
+    // 12 ticks).
+    for (uint32_t c = 1; c <= 1u << 24; c++, n++) fm_check(c);
+
+    // Powers of two and their neighbours up to the end of the range.
+    for (int b = 24; b < 32; b++)
+        for (int d = -1; d <= 1; d++, n++) fm_check((1u << b) + d);
+    fm_check(0xFFFFFFFFu);
+    n++;
+
+    // Random counts across the whole range, 1 to 32 bits wide.
+    for (uint32_t i = 0; i < 4000000; i++, n++)
+    {
+        uint32_t c = (uint32_t)(rng_next() >> (32 + rng_next() % 32));
+        fm_check(c ? c : 1);
+    }
+
+    // The counts the old code got wrong.
+    for (uint32_t c = 1; c <= SystemCoreClock; c++)
+    {
+        if (SystemCoreClock % c != 0) continue;
+        divisors++;
+        if ((int)(1.0 / ((double)c / (double)SystemCoreClock)) != (int)(SystemCoreClock / c)) low++;
+    }
+
+    printf("freq math: %u counts, %u failed; the old code was 1 Hz low at %u of the %u "
+           "exact divisors\n", n, fm_fails, low, divisors);
+    return fm_fails != 0;
+}
+
+
+// stats_add against a plain recomputation of every window: sum, N * M2
+// (N * sum x^2 - S^2 in 128 bits), min and max must match exactly after
+// every sample, and stats_std_q4 must be sqrt(M2 / N) to 1/16.
+static int check_stats(void)
+{
+    static stats_t st;
+    uint32_t win[STATS_WIN_MAX];
+    uint32_t n = 0, bad = 0, restarts = 0;
+    struct timespec a, b;
+    double ns;
+
+    for (uint8_t log2 = 0; log2 <= STATS_WIN_MAX_LOG2; log2 += 3)
+    {
+        uint32_t N = 1u << log2, filled = 0, restarted = 0;
+        uint32_t base = 0, noise = 0;
+
+        stats_init(&st, log2);
+        for (uint32_t i = 0; i < 300000; i++, n++)
+        {
+            stats_snap_t sn;
+            unsigned __int128 sq = 0;
+            uint64_t sum = 0, nm2;
+            uint32_t lo = UINT32_MAX, hi = 0, x;
+
+            // A new signal now and then: level anywhere, noise up to 2^23 wide.
+            if (i % 5000 == 0) {
+                base = (uint32_t)(rng_next() >> 33);
+                noise = (uint32_t)(rng_next() >> (40 + rng_next() % 24));
+            }
+            x = base + (noise ? (uint32_t)(rng_next() % noise) : 0);
+
+            stats_add(&st, x);
+            if (st.restarts != restarted || filled == 0) {
+                restarted = st.restarts;
+                for (uint32_t k = 0; k < N; k++) win[k] = x;
+                filled = 1;
+            }
+            memmove(win, win + 1, (N - 1) * sizeof(win[0]));
+            win[N - 1] = x;
+
+            for (uint32_t k = 0; k < N; k++) {
+                sum += win[k];
+                sq += (unsigned __int128)win[k] * win[k];
+                if (win[k] < lo) lo = win[k];
+                if (win[k] > hi) hi = win[k];
+            }
+            nm2 = (uint64_t)(sq * N - (unsigned __int128)sum * sum);
+
+            stats_read(&st, &sn);
+            if (sn.sum != sum || sn.nm2 != nm2 || sn.min != lo || sn.max != hi ||
+                fabs(stats_std_q4(&sn) - 16 * sqrt((double)nm2) / N) > 1.0)
+                if (bad++ < 5)
+                    printf("stats: window %u sample %u: sum %llu/%llu nm2 %llu/%llu min %u/%u max %u/%u\n",
+                           N, i, (unsigned long long)sn.sum, (unsigned long long)sum,
+                           (unsigned long long)sn.nm2, (unsigned long long)nm2, sn.min, lo, sn.max, hi);
+        }
+        restarts += st.restarts;
+    }
+
+    // Cost of one sample in a full-size window on this machine.
+    stats_init(&st, STATS_WIN_MAX_LOG2);
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (uint32_t i = 0; i < 10000000; i++) stats_add(&st, 120000 + (uint32_t)(rng_next() & 0xFF));
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    ns = ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / 1e7;
+
+    printf("stats: %u samples, %u wrong, %u windows restarted; host %.1f ns per sample\n", n, bad, restarts, ns);
+    return bad != 0;
+}
+
+
+// font5x7_span must describe the inked columns of each glyph in font5x7, and
+// every character must draw as its glyph's 5 columns plus 3 blank ones (a
+// character the font was generated without as SPACE). font_x2 and
+// font_x3 must be the digits of font5x7 with every pixel made 2x2 / 3x3, and
+// oled_fb_putbig must draw them with a blank scaled column after each. Also
+// times a redraw of the large layout on this machine.
+static int check_font(void)
+{
+    uint32_t bad = 0, big_bad = 0;
+    struct timespec a, b;
+    double ns;
+
+    for (uint32_t c = FONT_FIRST; c <= FONT_LAST; c++)
+    {
+        uint8_t k = font5x7_map[c - FONT_FIRST];
+        const uint8_t *g;
+        uint8_t first = 0, last = 0, span = 0;
+        char str[2] = { (char)c, 0 };
+
+        if (k >= FONT_GLYPHS || (c == ' ' && k != 0)) {
+            if (bad++ < 5) printf("font: character 0x%02X maps to glyph %u\n", c, k);
+            continue;
+        }
+        g = font5x7[k];
+        for (uint8_t i = 0; i < FONT_COLS; i++) if (g[i]) { if (!last) first = i; last = i + 1; }
+        if (last) span = (uint8_t)(first << 4 | (last - first));
+        memset(oled_back[0], 0xAA, FONT_CELL);
+        oled_fb_puts(0, 0, str);
+        if (span != font5x7_span[k] || memcmp(oled_back[0], g, FONT_COLS) ||
+            oled_back[0][5] || oled_back[0][6] || oled_back[0][7])
+            if (bad++ < 5) printf("font: glyph 0x%02X: span 0x%02X, table 0x%02X\n", c, span, font5x7_span[k]);
+    }
+
+    for (uint8_t scale = 2; scale <= 3; scale++)
+    {
+        for (char d = '0'; d <= '9'; d++)
+        {
+            const uint8_t *g = font5x7[font5x7_map[d - FONT_FIRST]];
+            uint8_t wrong = 0;
+
+            oled_fb_clear();
+            memset(oled_back[0], 0xAA, sizeof(oled_back[0]));
+            if (oled_fb_putbig(1, 0, &d, 1, scale) != (FONT_COLS + 1) * scale) wrong = 1;
+            for (uint8_t x = 0; x < (FONT_COLS + 1) * scale; x++)
+                for (uint8_t y = 0; y < 8 * scale; y++) {
+                    uint8_t want = x < FONT_COLS * scale && y < FONT_ROWS * scale && (g[x / scale] >> (y / scale) & 1);
+                    if (((oled_back[1 + y / 8][x] >> (y % 8)) & 1) != want) wrong = 1;
+                }
+            if (oled_back[0][0] != 0xAA || oled_back[1 + scale][0] != 0) wrong = 1;
+            if (wrong && big_bad++ < 5) printf("font: %ux digit %c is wrong\n", scale, d);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (uint32_t i = 0; i < 1000000; i++) {
+        Res = (int)(i % 5001);
+        Freq = (int)(i * 7919u % 4000000u);
+        oled_fb_clear();
+        oled_draw_large();
+        __asm__ volatile ("" ::: "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    ns = ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / 1000000;
+
+    printf("font: %u characters in %u glyphs, %u bad; 20 large digits, %u bad; "
+           "host %.0f ns per large frame\n", FONT_LAST - FONT_FIRST + 1, FONT_GLYPHS, bad, big_bad, ns);
+    return bad != 0 || big_bad != 0;
+}
+
+
+// fmt_u32 and fmt_fixed against snprintf, and refresh_OLED() against the
+// snprintf code it replaced: the back buffer must come out byte for byte the
+// same. Also times both ways of drawing the two readings on this machine.
+static uint32_t fmt_fails;
+
+static void fmt_check(uint32_t v)
+{
+    char want[32], got[32];
+    int n;
+
+    for (uint8_t w = 0; w <= 12; w++)
+    {
+        n = snprintf(want, sizeof(want), "%*u", w, v);
+        if (fmt_u32(got, v, w) != n || memcmp(got, want, n))
+            if (fmt_fails++ < 10) printf("fmt: %u width %u: \"%.*s\", want \"%s\"\n", v, w, n, got, want);
+    }
+    for (uint8_t f = 1; f <= 6; f++)
+    {
+        uint32_t p = 1;
+        char num[24];
+
+        for (uint8_t i = 0; i < f; i++) p *= 10;
+        snprintf(num, sizeof(num), "%u.%0*u", v / p, f, v % p);
+        n = snprintf(want, sizeof(want), "%*s", 10, num);
+        if (fmt_fixed(got, v, f, 10) != n || memcmp(got, want, n))
+            if (fmt_fails++ < 10) printf("fmt: %u with %u decimals: \"%.*s\", want \"%s\"\n", v, f, n, got, want);
+    }
+}
+
+// The display code before the formatter, drawn into oled_back.
+static void fmt_render_old(void)
+{
+    unsigned char Buffer[17];
+
+    oled_fb_clear();
+    snprintf((char *)Buffer, sizeof(Buffer), "ECE 355 PROJECT");
+    oled_fb_puts(0, 0, (const char *)Buffer);
+    snprintf((char *)Buffer, sizeof(Buffer), "   %5u Hz 555", Freq);
+    oled_fb_puts(1, 0, (const char *)Buffer);
+    snprintf((char *)Buffer, sizeof(Buffer), "R: %5u Ohms", Res);
+    oled_fb_puts(2, 0, (const char *)Buffer);
+    snprintf((char *)Buffer, sizeof(Buffer), "F: %5u Hz FG", Freq);
+    oled_fb_puts(3, 0, (const char *)Buffer);
+}
+
+static void fmt_render_new(void)
+{
+    uint8_t col;
+
+    oled_fb_clear();
+    oled_fb_puts(0, 0, "ECE 355 PROJECT");
+    col = oled_fb_putu(1, 3 * FONT_CELL, (uint32_t)Freq, 5);
+    oled_fb_puts(1, col, " Hz 555");
+    col = oled_fb_puts(2, 0, "R: ");
+    col = oled_fb_putu(2, col, (uint32_t)Res, 5);
+    oled_fb_puts(2, col, " Ohms");
+    col = oled_fb_puts(3, 0, "F: ");
+    col = oled_fb_putu(3, col, (uint32_t)Freq, 5);
+    oled_fb_puts(3, col, " Hz FG");
+}
+
+static double fmt_time(void (*render)(void), uint32_t frames)
+{
+    struct timespec a, b;
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for (uint32_t i = 0; i < frames; i++) {
+        Res = (int)(i % 5001);
+        Freq = (int)(i * 7919u % 4000000u);
+        render();
+        __asm__ volatile ("" ::: "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / frames;
+}
+
+static int check_fmt(void)
+{
+    static uint8_t old_back[OLED_PAGES][OLED_COLS];
+    uint32_t n = 0, frames = 0, bad_frames = 0;
+    double t_old, t_new;
+
+    for (uint32_t v = 0; v <= 1000000; v++, n++) fmt_check(v);
+    for (int b = 20; b < 32; b++)
+        for (int d = -1; d <= 1; d++, n++) fmt_check((1u << b) + d);
+    fmt_check(0xFFFFFFFFu);
+    n++;
+    for (uint32_t i = 0; i < 200000; i++, n++)
+        fmt_check((uint32_t)(rng_next() >> (32 + rng_next() % 32)));
+
+    // Every resistance, and frequencies up to 11 digits wide so the
+    // right-hand edge clips the same way snprintf's 17-byte buffer did.
+    for (uint32_t i = 0; i < 300000; i++, frames++)
+    {
+        Res = (i <= 5000) ? (int)i : (int)(rng_next() >> (33 + rng_next() % 31));
+        Freq = (int)(rng_next() >> (32 + rng_next() % 32));
+        if (i % 7 == 0) Freq = -Freq;
+        fmt_render_old();
+        memcpy(old_back, oled_back, sizeof(old_back));
+        fmt_render_new();
+        if (memcmp(old_back, oled_back, sizeof(old_back)) && bad_frames++ < 5)
+            printf("fmt: frame R %d F %d differs from the snprintf one\n", Res, Freq);
+    }
+
+    t_old = fmt_time(fmt_render_old, 2000000);
+    t_new = fmt_time(fmt_render_new, 2000000);
+    printf("fmt: %u values, %u failed; %u frames, %u differ; "
+           "host %.0f ns per frame with snprintf, %.0f ns with fmt_u32\n",
+           n, fmt_fails, frames, bad_frames, t_old, t_new);
+    return fmt_fails != 0 || bad_frames != 0;
+}
+
+
+// snap_read / snap_publish with the "interrupt" landing everywhere. Interrupts
+// are signal handlers on the one host thread, as they are on the M0:
+//
+//   - stepped: the x86 trap flag single-steps one call and the SIGTRAP
+//     handler plays the other side at instruction k of it, k = 1, 2, ... past
+//     its end. The writer preempts the reader (publishing once or twice), and
+//     the reader preempts the writer, where it must not wait at all.
+//   - timer: a 20 us interval timer publishes while the main loop reads
+//     flat out for a second.
+//
+// Every record is derived from its sequence number, so a copy that mixes two
+// records, or does not belong to the number returned, is torn. A plain copy
+// of the channel's latest slot is stepped the same way to show the check
+// catches tearing.
+static snap_chan_t snap_ch;
+static volatile uint32_t snap_step, snap_fire_at, snap_fire_n, snap_fired;
+static volatile uint8_t snap_role;          // 0 = handler writes, 1 = handler reads, 2 = timer writes
+static meas_t snap_isr_out;
+static uint32_t snap_isr_seq, snap_isr_bad;
+
+static void snap_make(meas_t *m, uint32_t k)
+{
+    m->value = k;
+    m->ts = k * 0x9E3779B1u;
+    m->count = ~k;
+    m->status = k ^ 0x5A5A5A5Au;
+}
+
+static int snap_torn(const meas_t *m, uint32_t seq)
+{
+    meas_t want;
+
+    snap_make(&want, seq);
+    return memcmp(m, &want, sizeof(want)) != 0;
+}
+
+static void snap_publish_next(void)
+{
+    meas_t m;
+
+    snap_make(&m, snap_ch.seq + 1);
+    snap_publish(&snap_ch, &m);
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+#define SNAP_TF 0x100ull
+
+static inline void snap_tf(int on)
+{
+    if (on) __asm__ volatile ("pushfq; orq $0x100, (%%rsp); popfq" ::: "memory", "cc");
+    else    __asm__ volatile ("pushfq; andq $~0x100, (%%rsp); popfq" ::: "memory", "cc");
+}
+
+static void snap_trap(int sig, siginfo_t *si, void *ctx)
+{
+    (void)sig; (void)si;
+    if (++snap_step != snap_fire_at) return;
+
+    // Once is enough: the rest of the call runs at full speed.
+    ((ucontext_t *)ctx)->uc_mcontext.gregs[REG_EFL] &= ~SNAP_TF;
+    snap_fired++;
+
+    if (snap_role == 0) {
+        for (uint32_t i = 0; i < snap_fire_n; i++) snap_publish_next();
+    } else {
+        // The writer is stopped mid-publish: this read must come back at once
+        // (a retry would spin forever) with the previous record.
+        snap_isr_seq = snap_read(&snap_ch, &snap_isr_out);
+        if (snap_torn(&snap_isr_out, snap_isr_seq)) snap_isr_bad++;
+    }
+}
+#endif
+
+static void snap_alarm(int sig)
+{
+    (void)sig;
+    snap_publish_next();
+}
+
+static int check_snap(void)
+{
+    uint64_t reads = 0, torn = 0, plain_torn = 0, moved = 0;
+    struct sigaction sa;
+    struct itimerval it = { { 0, 20 }, { 0, 20 } };
+    struct timespec t0, t1;
+    meas_t m;
+    uint32_t seq, last = 0, fired;
+
+    memset(&snap_ch, 0, sizeof(snap_ch));
+    snap_publish_next();
+
+#if defined(__x86_64__) && defined(__linux__)
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = snap_trap;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    // Every instruction boundary, with one and two publishes, from both slots.
+    for (uint32_t round = 0; round < 8; round++)
+    {
+        for (uint32_t k = 1; k <= 64; k++)
+        {
+            // Writer in the handler, once or twice, while snap_read runs.
+            snap_role = 0;
+            snap_fire_n = 1 + (round & 1);
+            if ((round >> 1 & 1) != (snap_ch.seq & 1)) snap_publish_next();
+            snap_step = 0;
+            snap_fire_at = k;
+            snap_tf(1);
+            seq = snap_read(&snap_ch, &m);
+            snap_tf(0);
+            reads++;
+            if (snap_torn(&m, seq)) torn++;
+
+            // The same preemption of an unsynchronised copy of the latest slot.
+            fired = snap_fired;
+            snap_role = 0;
+            snap_step = 0;
+            snap_tf(1);
+            seq = snap_ch.seq;
+            m = snap_ch.slot[1];
+            m = snap_ch.slot[0];
+            m = snap_ch.slot[seq & 1];
+            snap_tf(0);
+            snap_fired = fired;     // Not a point of the channel
+            if (snap_torn(&m, seq)) plain_torn++;
+
+            // Reader in the handler while snap_publish runs.
+            snap_role = 1;
+            snap_step = 0;
+            snap_isr_seq = 0;
+            seq = snap_ch.seq;
+            snap_tf(1);
+            snap_publish_next();
+            snap_tf(0);
+            if (snap_isr_seq != 0) {
+                reads++;
+                if (snap_isr_seq != seq && snap_isr_seq != seq + 1) snap_isr_bad++;
+            }
+        }
+    }
+    torn += snap_isr_bad;
+#else
+    printf("snap: no single-stepping on this host, timer phase only\n");
+#endif
+
+    // Free-running reads against a timer-driven writer.
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = snap_alarm;
+    sigaction(SIGALRM, &sa, NULL);
+    setitimer(ITIMER_REAL, &it, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        for (uint32_t i = 0; i < 1000000; i++) {
+            seq = snap_read(&snap_ch, &m);
+            if (snap_torn(&m, seq)) torn++;
+            if (seq != last) moved++;
+            last = seq;
+        }
+        reads += 1000000;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    } while (t1.tv_sec - t0.tv_sec < 1 || (t1.tv_sec - t0.tv_sec == 1 && t1.tv_nsec < t0.tv_nsec));
+    it.it_value.tv_usec = it.it_interval.tv_usec = 0;
+    setitimer(ITIMER_REAL, &it, NULL);
+    signal(SIGALRM, SIG_DFL);
+
+    printf("snap: %llu reads, %llu torn; %llu stepped preemption points, %llu timer publishes seen; "
+           "unsynchronised copy torn %llu times\n",
+           (unsigned long long)reads, (unsigned long long)torn, (unsigned long long)snap_fired,
+           (unsigned long long)moved, (unsigned long long)plain_torn);
+#if defined(__x86_64__) && defined(__linux__)
+    return torn != 0 || plain_torn == 0;
+#else
+    return torn != 0;
+#endif
+}
+
+
+// The key/value store under power failures: a random workload of kv_set()
+// on KVC_KEYS keys, with the power failing at a random flash operation
+// KVC_CUTS times (see Virtual Hardware for how a cut leaves the cells).
+// After each cut the store is loaded again as at boot and every key must
+// read back its last stored value. The key being set when the power failed
+// may instead hold the new one, which then counts as stored. Every
+// kv_set() that returns must have succeeded.
+#define KVC_KEYS   8u
+#define KVC_CUTS   3000u
+
+static uint8_t kvc_val[KVC_KEYS][KV_VAL_MAX];
+static int     kvc_len[KVC_KEYS];       // -1 = never stored
+static uint8_t kvc_new[KV_VAL_MAX];
+static int     kvc_key, kvc_new_len;    // Being set, kvc_key -1 = none
+static uint32_t kvc_sets, kvc_bad;
+static double   kvc_scan_max;           // ns
+
+
+static void kvc_verify(void)
+{
+    uint8_t buf[KV_VAL_MAX];
+
+    for (uint32_t k = 0; k < KVC_KEYS; k++)
+    {
+        int n = kv_get((uint8_t)k, buf, sizeof(buf));
+
+        if (n == kvc_len[k] && (n < 0 || memcmp(buf, kvc_val[k], (size_t)n) == 0)) continue;
+        if ((int)k == kvc_key && n == kvc_new_len && memcmp(buf, kvc_new, (size_t)n) == 0) {
+            memcpy(kvc_val[k], kvc_new, (size_t)n);
+            kvc_len[k] = n;
+            continue;
+        }
+        if (kvc_bad++ < 5) printf("kv: key %u reads %d bytes, stored %d\n", k, n, kvc_len[k]);
+    }
+}
+
+
+static int check_kv(void)
+{
+    struct timespec t0, t1;
+    double scan_ns;
+    uint32_t p0 = (uint32_t)(KV_PAGE_ADDR(0) - FLASH_BASE) / FLASH_PAGE_BYTES;
+
+    fl_init();
+    kv_init();
+    for (uint32_t k = 0; k < KVC_KEYS; k++) kvc_len[k] = -1;
+    kvc_key = -1;
+
+    for (uint32_t cut = 0; cut < KVC_CUTS; cut++)
+    {
+        fl_cut_in = (int32_t)(rng_next() % 600);
+        if (setjmp(fl_cut_env) == 0) {
+            for (;;)
+            {
+                kvc_key = (int)(rng_next() % KVC_KEYS);
+                kvc_new_len = (int)(rng_next() % 4 ? rng_next() % 9 : rng_next() % (KV_VAL_MAX + 1));
+                for (int i = 0; i < kvc_new_len; i++) kvc_new[i] = (uint8_t)rng_next();
+
+                if (!kv_set((uint8_t)kvc_key, kvc_new, (uint8_t)kvc_new_len)) {
+                    if (kvc_bad++ < 5) printf("kv: set of key %d failed\n", kvc_key);
+                } else {
+                    memcpy(kvc_val[kvc_key], kvc_new, (size_t)kvc_new_len);
+                    kvc_len[kvc_key] = kvc_new_len;
+                }
+                kvc_key = -1;
+                kvc_sets++;
+            }
+        }
+
+        // Power back on.
+        fl_cut_in = -1;
+        fl_reset();
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        kv_init();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        scan_ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+        if (scan_ns > kvc_scan_max) kvc_scan_max = scan_ns;
+
+        kvc_verify();
+        kvc_key = -1;
+    }
+
+    printf("kv: %u sets, %u power cuts, %u wrong; pages erased %u and %u times, "
+           "%u refused programs; boot scan max %.1f us on the host\n",
+           kvc_sets, KVC_CUTS, kvc_bad, fl_page_erases[p0], fl_page_erases[p0 + 1], fl_pgerr, kvc_scan_max / 1e3);
+    return kvc_bad != 0 || fl_pgerr != 0 || fl_stray != 0;
+}
+
+
+//---------- Driver --------------------
+
+typedef struct {
+    const char *csv;
+    double seconds;
+    double settle_ms;
+    double spike_ppm;
+    double max_err, max_spikes;     // < 0 = no limit
+    const char *oled;               // Run the display path, save the panel image here
+    double pi_hz, pi_step_hz;       // < 0 = open loop / no step
+    double pi_cfg;                  // CFG_PI_HZ stored in flash instead, < 0 = none
+    double max_settle, max_overshoot;
+    int cal;                        // Run a calibration sweep
+    double max_cal_err;
+    double contrast;                // Stored in flash before the display starts, < 0 = none
+    double view;                    // CFG_VIEW stored the same way, < 0 = none
+    double spi_br;                  // CFG_SPI_BR stored the same way, < 0 = none
+    uint32_t presses;               // USER button presses over the run
+    int lowpower;                   // Start in low-power mode
+    double max_duty_err;            // ppm of a period, < 0 = no limit
+    double min_rate;                // Input events per second (millions), < 0 = not timed
+} opts_t;
+
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: hostsim [--555 HZ] [--fg HZ] [--duty PM] [--jitter NS] [--glitch PM] [--glitch-ns NS]\n"
+        "               [--miss PM] [--drift PPM/S] [--step X] [--startup MS]\n"
+        "               [--presses N] [--bounce N] [--hold MS] [--lowpower]\n"
+        "               [--adc CODE] [--adc-noise LSB] [--adc-late N] [--seconds S] [--seed N]\n"
+        "               [--settle MS] [--spike PPM] [--csv FILE] [--max-err PPM]\n"
+        "               [--max-spikes N] [--max-duty-err PPM] [--trace FILE] [--oled FILE]\n"
+        "               [--pi HZ | --pi-cfg N] [--pi-step HZ] [--kp Q24] [--ki Q24]\n"
+        "               [--max-settle MS] [--max-overshoot PM] [--cal] [--max-cal-err PPM] [--span HZ]\n"
+        "               [--contrast N] [--view N] [--spi-br N] [--tm FILE | --tm-pty]\n"
+        "               [--record FILE | --replay FILE] [--min-rate MEV/S]\n"
+        "       hostsim --freq-math | --fmt | --font | --stats | --snap | --kv\n"
+        "       hostsim --selftest\n");
+    exit(2);
+}
+
+
+static int run(int argc, char **argv)
+{
+    opts_t o = { NULL, 5.0, 0, 10000, -1, -1, NULL, -1, -1, -1, -1, -1, 0, -1, -1, -1, -1, 0, 0, -1, -1 };
+    double duty = -1, jitter_ns = 0, glitch = 0, glitch_ns = GLITCH_NS, miss = 0, step = 0;
+    ic_stream_t *streams[2] = { &ic_555, &ic_fg };
+    const char *names[2] = { "555", "fg" };
+    const char *range_names[3] = { "recip", "recip/8", "gated" };
+    gen_t *gens[2] = { &gen_555, &gen_fg };
+    uint64_t t_stop, settle, events = 0;
+    struct timespec w0, w1;
+    event_t e = { 0, 0, 0 };
+    check_t c[2];
+    int fail = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *a = argv[i];
+        double v;
+
+        if (!strcmp(a, "--freq-math")) return check_freq_math();
+        if (!strcmp(a, "--fmt")) return check_fmt();
+        if (!strcmp(a, "--font")) return check_font();
+        if (!strcmp(a, "--stats")) return check_stats();
+        if (!strcmp(a, "--snap")) return check_snap();
+        if (!strcmp(a, "--kv")) return check_kv();
+        if (!strcmp(a, "--cal")) { o.cal = 1; continue; }
+        if (!strcmp(a, "--lowpower")) { o.lowpower = 1; continue; }
+        if (!strcmp(a, "--tm-pty")) {
+            if ((tl_fd = tl_open_pty()) < 0) return 2;
+            tl_on = 1;
+            continue;
+        }
+        if (i + 1 >= argc) usage();
+        v = atof(argv[i + 1]);
+
+        if      (!strcmp(a, "--555"))          gen_555.hz = v;
+        else if (!strcmp(a, "--fg"))           gen_fg.hz = v;
+        else if (!strcmp(a, "--duty"))         duty = v / 1000;
+        else if (!strcmp(a, "--jitter"))       jitter_ns = v;
+        else if (!strcmp(a, "--glitch"))       glitch = v / 1000;
+        else if (!strcmp(a, "--glitch-ns"))    glitch_ns = v;
+        else if (!strcmp(a, "--miss"))         miss = v / 1000;
+        else if (!strcmp(a, "--presses"))      o.presses = (uint32_t)v;
+        else if (!strcmp(a, "--bounce"))       bt_bounce = (uint32_t)v;
+        else if (!strcmp(a, "--hold"))         bt_hold_ms = (uint32_t)v;
+        else if (!strcmp(a, "--adc"))          gen_adc_code = (uint32_t)v;
+        else if (!strcmp(a, "--adc-noise"))    gen_adc_noise = (uint32_t)v;
+        else if (!strcmp(a, "--adc-late"))     hw_adc_late = (uint32_t)v;
+        else if (!strcmp(a, "--seconds"))      o.seconds = v;
+        else if (!strcmp(a, "--seed"))         rng_state = (uint64_t)v * 0x9E3779B97F4A7C15ull + 1;
+        else if (!strcmp(a, "--settle"))       o.settle_ms = v;
+        else if (!strcmp(a, "--spike"))        o.spike_ppm = v;
+        else if (!strcmp(a, "--csv"))          o.csv = argv[i + 1];
+        else if (!strcmp(a, "--max-err"))      o.max_err = v;
+        else if (!strcmp(a, "--max-duty-err")) o.max_duty_err = v;
+        else if (!strcmp(a, "--max-spikes"))   o.max_spikes = v;
+        else if (!strcmp(a, "--oled"))         o.oled = argv[i + 1];
+        else if (!strcmp(a, "--pi"))           o.pi_hz = v;
+        else if (!strcmp(a, "--pi-step"))      o.pi_step_hz = v;
+        else if (!strcmp(a, "--pi-cfg"))       o.pi_cfg = v;
+        else if (!strcmp(a, "--drift"))        pl_drift = v / 1e6;
+        else if (!strcmp(a, "--span"))         pl_f_hi = PL_F_LO + v;
+        else if (!strcmp(a, "--kp"))           pi_kp = (int32_t)v;
+        else if (!strcmp(a, "--ki"))           pi_ki = (int32_t)v;
+        else if (!strcmp(a, "--max-settle"))   o.max_settle = v;
+        else if (!strcmp(a, "--max-overshoot")) o.max_overshoot = v;
+        else if (!strcmp(a, "--max-cal-err"))  o.max_cal_err = v;
+        else if (!strcmp(a, "--contrast"))     o.contrast = v;
+        else if (!strcmp(a, "--spi-br"))       o.spi_br = v;
+        else if (!strcmp(a, "--view"))         o.view = v;
+        else if (!strcmp(a, "--tm")) {
+            if ((tl_fd = open(argv[i + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) { perror(argv[i + 1]); return 2; }
+            tl_on = 1;
+        }
+        else if (!strcmp(a, "--startup")) {
+            gen_555.t = v * SystemCoreClock / 1000;
+            gen_555.startup = 1;
+        }
+        else if (!strcmp(a, "--min-rate"))     o.min_rate = v;
+        else if (!strcmp(a, "--step"))         step = v;
+        else if (!strcmp(a, "--record")) {
+            if (ef_record_open(argv[i + 1]) != 0) return 2;
+        }
+        else if (!strcmp(a, "--replay")) {
+            if (ef_replay_open(argv[i + 1]) != 0) return 2;
+        }
+        else if (!strcmp(a, "--trace")) {
+            if (!(hw_trace_out = fopen(argv[i + 1], "wb"))) { perror(argv[i + 1]); return 2; }
+        }
+        else usage();
+        i++;
+    }
+
+    // --pi-cfg leaves closing the loop to the firmware, from its setting.
+    if (o.pi_cfg == 0 || (o.pi_cfg > 0 && o.pi_hz >= 0)) usage();
+    if (o.pi_cfg > 0) o.pi_hz = (o.pi_cfg == 1) ? 0 : o.pi_cfg;
+    if (o.pi_hz == 0 && gen_adc_code == 0) usage();
+    if (o.pi_hz >= 0 || o.cal) {
+        pl_enabled = 1;
+        gen_555.varying = 1;
+    }
+    if (gen_555.hz == 0 && gen_fg.hz == 0 && gen_adc_code == 0 && !pl_enabled && !ef_buf) usage();
+    if (ef_buf && (pl_enabled || ef_out)) usage();
+    for (int k = 0; k < 2; k++) {
+        gen_t *g = gens[k];
+        if (duty >= 0) g->duty = duty;
+        if (!pl_enabled) g->drift = pl_drift;
+        g->step = step;
+        g->step_t = o.seconds * SystemCoreClock / 2;
+        g->jitter = jitter_ns * SystemCoreClock / 1e9;
+        g->glitch = glitch;
+        g->glitch_w = glitch_ns * SystemCoreClock / 1e9;
+        g->miss = miss;
+    }
+    gen_adc_step = SystemCoreClock / ADC_SAMPLE_HZ;
+
+    if (gen_adc_noise == 0) tl_adc_expect = gen_adc_code << ADC_OVERSAMPLE_SHIFT;
+    hw_init(0);
+    for (int k = 0; k < 2; k++) gens[k]->filter = hw_filter_ticks(k == 0 ? IN_555 : IN_FG);
+    tl_start();
+    if (o.contrast >= 0 || o.view >= 0 || o.spi_br >= 0 || o.pi_cfg > 0) {
+        uint32_t v = (uint32_t)o.contrast, view = (uint32_t)o.view, pi_hz = (uint32_t)o.pi_cfg;
+        uint32_t br = (uint32_t)o.spi_br;
+
+        // As set on an earlier run; the settings are loaded again at reset.
+        if (o.contrast >= 0 && !kv_set(CFG_CONTRAST, &v, sizeof(v))) fail = 1;
+        if (o.view >= 0 && !kv_set(CFG_VIEW, &view, sizeof(view))) fail = 1;
+        if (o.spi_br >= 0 && !kv_set(CFG_SPI_BR, &br, sizeof(br))) fail = 1;
+        if (o.pi_cfg > 0 && !kv_set(CFG_PI_HZ, &pi_hz, sizeof(pi_hz))) fail = 1;
+        kv_init();
+        cfg_load();
+    }
+    // After the settings, which open the loop by default.
+    if (o.pi_hz >= 0 && o.pi_cfg < 0) {
+        pi_fixed_mHz = (uint32_t)(o.pi_hz * FREQ_SCALE);
+        pi_enable = 1;
+    }
+    if (o.cal) cal_start();
+    if (pl_enabled) pl_step(0);
+    // Low-power mode turns the panel off, and Stop waits for the transports;
+    // the display task switches the layout.
+    if ((o.lowpower || bt_hold_ms >= BTN_VIEW_MS) && !o.oled) o.oled = "/dev/null";
+    if (o.lowpower || bt_hold_ms >= BTN_LONG_MS) tl_on = 1;
+    if (o.oled) pn_init();
+    pwr_low_want = (uint8_t)o.lowpower;
+    host_wfi_hook = hw_stop;
+    host_pll_hook = hw_pll_lock;
+    // USER button: measure the 555
+    bt_plan(gen_555.hz != 0 && gen_fg.hz == 0, o.presses, o.seconds);
+    t_stop = (uint64_t)(o.seconds * SystemCoreClock);
+    settle = (uint64_t)(o.settle_ms * SystemCoreClock / 1000);
+
+    hw_event = &e;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    while (gen_read(&e) && e.t < t_stop)
+    {
+        // The inputs as they were, before Stop loses any of them.
+        if (ef_out) ef_record(&e);
+        events++;
+
+        if (o.pi_step_hz >= 0 && e.t >= t_stop / 2) {
+            hw_advance(t_stop / 2);
+            if (o.pi_cfg < 0) pi_fixed_mHz = (uint32_t)(o.pi_step_hz * FREQ_SCALE);
+            else if (!cfg_set(CFG_PI_HZ, (uint32_t)o.pi_step_hz)) fail = 1;
+            o.pi_step_hz = -1;
+        }
+        hw_advance(e.t);
+
+        // Input edges and samples are lost while the core is in Stop; the
+        // button still sets its pin and pending flag, taken on wake-up.
+        if (e.t < hw_now) {
+            if (e.kind == EV_BTN) hw_button(hw_now, (uint8_t)e.sample);
+            continue;
+        }
+
+        switch (e.kind)
+        {
+        case EV_555_RISE: hw_rise(e.t, IN_555); break;
+        case EV_555_FALL: hw_fall(e.t); break;
+        case EV_FG_RISE:  hw_rise(e.t, IN_FG); break;
+        case EV_ADC:      hw_adc_sample(e.t, e.sample); break;
+        case EV_BTN:      hw_button(e.t, (uint8_t)e.sample); break;
+        default:          break;
+        }
+    }
+    if (hw_adc_flags) hw_adc_irq();
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    if (hw_trace_out) fclose(hw_trace_out);
+    if (ef_out && fclose(ef_out) != 0) {
+        perror("record");
+        fail = 1;
+    }
+
+    // Throughput of the whole chain: generator or file, virtual hardware
+    // and firmware.
+    if (ef_out || ef_buf || o.min_rate >= 0) {
+        double wall = (double)(w1.tv_sec - w0.tv_sec) + (w1.tv_nsec - w0.tv_nsec) / 1e9;
+        double rate = (wall > 0) ? events / wall / 1e6 : HUGE_VAL;
+
+        printf("rate %llu events in %.0f ms, %.1f M/s\n", (unsigned long long)events, wall * 1000, rate);
+        if (o.min_rate >= 0 && rate < o.min_rate) fail = 1;
+    }
+
+    for (int k = 0; k < 2; k++)
+    {
+        check_input(&readings[k], gens[k], settle, o.spike_ppm, &c[k]);
+        if (c[k].n == 0) {
+            // A generated input that never gave a reading is a failure.
+            if (gens[k]->hz != 0) {
+                printf("%-3s  no readings\n", names[k]);
+                fail = 1;
+            }
+            continue;
+        }
+
+        printf("%-3s  %u readings, %u spikes", names[k], c[k].n, c[k].spikes);
+        if (c[k].err_n)
+            printf(", err max %.0f ppm rms %.0f ppm", c[k].err_max, sqrt(c[k].err_sq / c[k].err_n));
+        printf("; last %s over %u periods, res %u ppb",
+               range_names[readings[k].r[readings[k].n - 1].range],
+               readings[k].r[readings[k].n - 1].periods, readings[k].r[readings[k].n - 1].res_ppb);
+        if (c[k].over_res) printf(", %u outside it", c[k].over_res);
+        if (c[k].duty_n)
+            printf("; duty %.2f%% in %u, err max %.0f ppm", readings[k].r[readings[k].n - 1].duty_ppm / 1e4,
+                   c[k].duty_n, c[k].duty_err_max);
+        if (streams[k]->rejected) printf("; %u edges rejected", streams[k]->rejected);
+        printf("\n");
+        if (c[k].over_res) fail = 1;
+
+        // The 555 is captured in PWM input mode: its settled readings carry a duty cycle.
+        if (o.max_duty_err >= 0 && (c[k].duty_err_max > o.max_duty_err ||
+                                    (gens[k]->kind_fall != EV_NONE && c[k].duty_n == 0))) fail = 1;
+
+        if (o.max_err >= 0 && c[k].err_max > o.max_err) fail = 1;
+        if (o.max_spikes >= 0 && c[k].spikes > o.max_spikes) fail = 1;
+    }
+    if (bt_presses > (gen_555.hz != 0 && gen_fg.hz == 0)) {
+        uint32_t longs = (bt_hold_ms >= BTN_LONG_MS) ? bt_presses : 0;
+        uint32_t views = (bt_hold_ms >= BTN_VIEW_MS) ? bt_presses - longs : 0, view;
+
+        printf("btn  %u presses (%u bounces each way), %u spikes: %u toggles, %u mode changes, "
+               "%u layout changes, %u interrupts, %u windows rejected\n",
+               bt_presses, bt_bounce, bt_spikes, bt_toggles, hw_modes, pn_views, btn_irqs, btn_rejected);
+        if (bt_toggles != bt_presses - longs - views || hw_modes != longs + (uint32_t)o.lowpower) fail = 1;
+        if (btn_irqs != 2 * bt_presses + bt_spikes || btn_rejected != bt_spikes) fail = 1;
+        if (pn_views != views) fail = 1;
+        if (views && (kv_get(CFG_VIEW, &view, sizeof(view)) != sizeof(view) || view != cfg[CFG_VIEW])) fail = 1;
+    }
+    if (o.lowpower || hw_modes) {
+        if (hw_power_report()) fail = 1;
+        if (o.lowpower && hw_stops == 0) fail = 1;
+    }
+    if (hw_sel_bad) {
+        printf("freq %u polls published the wrong input\n", hw_sel_bad);
+        fail = 1;
+    }
+    if (gen_adc_code) {
+        meas_t adc;
+
+        // Every half the DMA completed is decimated, late or not.
+        snap_read(&adc_snap, &adc);
+        printf("adc  %u values of %u halves, %u overruns (%u late interrupts), last %u (expected %u)\n",
+               adc.count, hw_adc_halves, adc_overruns, hw_adc_both, adc.value,
+               gen_adc_code << ADC_OVERSAMPLE_SHIFT);
+        if (adc.count != hw_adc_halves || adc_overruns != hw_adc_both) fail = 1;
+        if (gen_adc_noise == 0 && adc.value != gen_adc_code << ADC_OVERSAMPLE_SHIFT) fail = 1;
+    }
+    if (tl_on) {
+        hw_advance(t_stop);
+        if (tl_report(t_stop)) fail = 1;
+        if (tl_fd >= 0) {
+            // Let a reader on the pty take the rest before it hangs up.
+            if (isatty(tl_fd)) sleep(1);
+            close(tl_fd);
+        }
+    }
+
+    if (o.cal) {
+        double fwd, inv;
+        const cal_table_t *t = cal_tab;
+
+        // What the next reset would find in flash.
+        cal_init();
+        if (cal_point != 0 || !cal_tab || cal_tab != t) {
+            printf("cal  %s\n", cal_point ? "sweep not finished" : "no table in flash");
+            fail = 1;
+        } else {
+            pl_cal_errors(&fwd, &inv);
+            printf("cal  %.3f-%.3f Hz; dac->f max %.0f ppm, f->dac max %.0f ppm\n",
+                   cal_tab->inv_lo_mHz / (double)FREQ_SCALE, cal_tab->inv_hi_mHz / (double)FREQ_SCALE, fwd, inv);
+            if (o.max_cal_err >= 0 && (fwd > o.max_cal_err || inv > o.max_cal_err)) fail = 1;
+        }
+        printf("flash %u erases, %u halfwords programmed, %u refused, %u stray writes\n",
+               fl_erases, fl_programs, fl_pgerr, fl_stray);
+        if (fl_pgerr || fl_stray) fail = 1;
+    }
+
+    if (o.pi_hz >= 0) {
+        pi_metrics_t m;
+        const reading_t *last = &readings[IN_555].r[readings[IN_555].n - 1];
+        double sp = pi.sp_mHz / (double)FREQ_SCALE;
+        double err = readings[IN_555].n ? fabs(last->freq_mHz / (double)FREQ_SCALE - sp) / sp * 1e6 : 1e6;
+
+        pi_metrics_read(&m);
+        printf("pi   setpoint %.3f Hz, last 555 %+.0f ppm off, DAC %u; %u steps",
+               sp, err, (unsigned)(DAC->DHR12R1 & 0xFFF), m.steps);
+        if (m.steps) {
+            if (m.settled) printf(", last settled in %u ms, overshoot %u permille", m.settle_ms, m.overshoot_pm);
+            else printf(", last not settled");
+        }
+        printf("\n");
+        if (err > PI_SETTLE_PM * 1000) fail = 1;
+        if (m.steps && !m.settled) fail = 1;
+        if (m.steps && o.max_settle >= 0 && m.settle_ms > o.max_settle) fail = 1;
+        if (m.steps && o.max_overshoot >= 0 && m.overshoot_pm > o.max_overshoot) fail = 1;
+    }
+
+    if (o.oled) {
+        printf("oled %u frames, %u data + %u command bytes, panel %s, contrast %u; "
+               "%u bytes off oled_front, %u bad transfers; queue peak %u of %u, %u rejected\n",
+               pn_frames, pn_data, pn_cmds, pn_on ? "on" : "off", pn_contrast, pn_diff, pn_bad,
+               oled_q_peak, OLED_Q_LEN, oled_q_rejected);
+        if (pn_diff != 0 || pn_bad != 0 || pn_frames == 0 || pn_on == pwr_low) fail = 1;
+        if (pn_contrast != cfg[CFG_CONTRAST]) fail = 1;
+        // The drain poll looks at the SPI once per byte at the clock in use.
+        if (TIM17->ARR + 1 != 8u << ((SPI_Handle.Init.BaudRatePrescaler >> SPI_CR1_BR_Pos) + 1)) fail = 1;
+        if (pn_dump(o.oled) != 0) fail = 1;
+    }
+
+    if (o.csv) readings_csv(o.csv);
+    return fail;
+}
+
+
+//---------- Self-Test --------------------
+
+// Scenarios and their limits. Tighten a limit after an improvement; a
+// failure means the firmware got worse for that input.
+static const char *const selftests[][24] = {
+    { "fg", "--fg", "5000", "--adc", "2000", "--seconds", "5",
+      "--max-err", "100", "--max-spikes", "0" },
+    { "555", "--555", "400", "--seconds", "5", "--max-err", "100", "--max-spikes", "0",
+      "--max-duty-err", "100" },
+    { "duty", "--555", "3000", "--duty", "150", "--seconds", "3", "--max-err", "100",
+      "--max-duty-err", "100" },
+    { "gated", "--fg", "1000000", "--seconds", "3", "--settle", "1000",
+      "--max-err", "20", "--max-spikes", "0" },
+    { "slow", "--fg", "0.01", "--seconds", "400", "--max-err", "0" },
+    { "dual", "--555", "400", "--fg", "5000", "--seconds", "5",
+      "--max-err", "100", "--max-spikes", "0" },
+    { "jitter", "--fg", "5000", "--jitter", "100", "--seconds", "5",
+      "--max-err", "1000", "--max-spikes", "0" },
+    { "pi step", "--pi", "800", "--pi-step", "1400", "--drift", "200", "--seconds", "6",
+      "--max-settle", "1500", "--max-overshoot", "50" },
+    { "pi pot", "--pi", "0", "--adc", "2000", "--seconds", "4" },
+    { "pi cfg", "--pi-cfg", "800", "--pi-step", "1400", "--drift", "200", "--seconds", "6",
+      "--max-settle", "1500", "--max-overshoot", "50" },
+    { "pi cfg pot", "--pi-cfg", "1", "--adc", "2000", "--seconds", "4" },
+    { "cal", "--cal", "--seconds", "20", "--max-cal-err", "10000" },
+    { "cal narrow", "--cal", "--span", "12", "--seconds", "20", "--max-cal-err", "200" },
+    { "cal steep", "--cal", "--span", "150000", "--seconds", "20", "--max-cal-err", "100000" },
+    { "cal pi", "--cal", "--pi", "800", "--pi-step", "1400", "--drift", "200", "--seconds", "30",
+      "--max-settle", "1000", "--max-overshoot", "150" },
+    { "adc late", "--adc", "1500", "--adc-late", "7", "--seconds", "2" },
+    { "oled panel", "--fg", "5000", "--adc", "2000", "--seconds", "3",
+      "--oled", "/dev/null" },
+    { "oled contrast", "--fg", "5000", "--seconds", "1", "--contrast", "96", "--oled", "/dev/null" },
+    { "oled fast spi", "--fg", "5000", "--seconds", "1", "--spi-br", "0", "--oled", "/dev/null" },
+    { "oled large", "--555", "400", "--fg", "5000", "--adc", "2000", "--seconds", "3", "--view", "1",
+      "--oled", "/dev/null" },
+    { "freq math", "--freq-math" },
+    { "fmt", "--fmt" },
+    { "font", "--font" },
+    { "stats", "--stats" },
+    { "snap", "--snap" },
+    { "kv", "--kv" },
+    { "glitch", "--555", "400", "--glitch", "20", "--miss", "10", "--jitter", "100", "--seconds", "5",
+      "--max-err", "100", "--max-spikes", "0", "--max-duty-err", "100" },
+    { "glitch fg", "--fg", "5000", "--glitch", "10", "--miss", "5", "--seconds", "5",
+      "--max-err", "3000", "--max-spikes", "0" },
+    { "filter", "--fg", "5000", "--glitch", "50", "--glitch-ns", "150", "--seconds", "5",
+      "--max-err", "100", "--max-spikes", "0" },
+    { "button", "--555", "400", "--fg", "5000", "--presses", "9", "--bounce", "8", "--seconds", "5",
+      "--max-err", "100", "--max-spikes", "0" },
+    { "lowpower", "--555", "400", "--fg", "5000", "--lowpower", "--seconds", "10",
+      "--max-err", "100", "--max-spikes", "0" },
+    { "lowpower 555", "--555", "400", "--lowpower", "--seconds", "20",
+      "--max-err", "100", "--max-spikes", "0" },
+    { "long press", "--555", "400", "--fg", "5000", "--presses", "3", "--bounce", "8", "--hold", "1200",
+      "--seconds", "12", "--max-err", "100", "--max-spikes", "0" },
+    { "view press", "--555", "400", "--fg", "5000", "--presses", "3", "--bounce", "8", "--hold", "600",
+      "--seconds", "6", "--max-err", "100", "--max-spikes", "0" },
+    { "telemetry", "--555", "1590", "--fg", "1590", "--adc", "2000", "--seconds", "5",
+      "--tm", "/dev/null" },
+    { "drift", "--555", "400", "--fg", "5000", "--drift", "200", "--seconds", "10",
+      "--max-err", "3", "--max-spikes", "0", "--max-duty-err", "100" },
+    { "startup", "--555", "400", "--startup", "300", "--seconds", "5",
+      "--max-err", "3", "--max-spikes", "0", "--max-duty-err", "100" },
+    { "record", "--555", "400", "--fg", "5000", "--adc", "2000", "--jitter", "100", "--seconds", "5",
+      "--record", "@edges", "--settle", "100", "--max-err", "100", "--max-spikes", "0", "--max-duty-err", "100" },
+    { "replay", "--555", "400", "--fg", "5000", "--adc", "2000", "--jitter", "100", "--seconds", "5",
+      "--replay", "@edges", "--settle", "100", "--max-err", "100", "--max-spikes", "0", "--max-duty-err", "100" },
+    { "step record", "--fg", "300", "--step", "2", "--seconds", "6", "--record", "@edges",
+      "--settle", "3500", "--max-err", "100", "--max-spikes", "0" },
+    { "step replay", "--fg", "300", "--step", "2", "--seconds", "6", "--replay", "@edges",
+      "--settle", "3500", "--max-err", "100", "--max-spikes", "0" },
+    { "throughput", "--555", "400", "--fg", "5000", "--seconds", "20", "--min-rate", "1" },
+};
+
+
+static int selftest(void)
+{
+    char edges[] = "/tmp/hostsim-edges-XXXXXX";     // "@edges": recorded, then replayed
+    int failed = 0, fd = mkstemp(edges);
+
+    if (fd < 0) { perror("mkstemp"); return 1; }
+    close(fd);
+
+    for (size_t i = 0; i < sizeof(selftests) / sizeof(selftests[0]); i++)
+    {
+        const char *args[sizeof(selftests[0]) / sizeof(selftests[0][0])];
+        int argc, status;
+        pid_t pid;
+
+        for (argc = 0; selftests[i][argc]; argc++)
+            args[argc] = strcmp(selftests[i][argc], "@edges") ? selftests[i][argc] : edges;
+        args[argc] = NULL;
+        printf("--- %s\n", args[0]);
+        fflush(stdout);
+
+        // Each scenario needs the firmware in its reset state.
+        pid = fork();
+        if (pid == 0) {
+            status = run(argc, (char **)args);
+            fflush(stdout);
+            _exit(status);
+        }
+        waitpid(pid, &status, 0);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("FAIL %s\n", args[0]);
+            failed++;
+        }
+    }
+    unlink(edges);
+    printf(failed ? "FAIL (%d)\n" : "PASS\n", failed);
+    return failed != 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && !strcmp(argv[1], "--selftest")) return selftest();
+    return run(argc, argv);
+}
@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+"""Decode the USART telemetry stream sent by tm_send() in main.c.
+
+The stream (a capture file, the board's serial port, or the pseudo-terminal
+`hostsim --tm-pty` prints) carries COBS-encoded frames, each ended by a 0:
+
+    uint8 type | uint16 seq | body | uint16 crc16 (CCITT, 0xFFFF start)
+
+all little-endian. Frames with a bad CRC are counted and skipped; a gap in
+seq is a frame the firmware dropped because its ring was full. Timestamps
+(TIM2 ticks) are unwrapped per table and converted to seconds with the
+clock from the TM_BOOT frame (48 MHz until one is seen).
+
+Every frame type goes to its own table, one CSV file per table with a
+header row, so each column can be loaded on its own:
+
+    PREFIX_edges.csv     t_s, input, range, ts          one row per timestamp
+    PREFIX_readings.csv  t_s, input, range, hz, periods, res_ppb, duty,
+                         high_s, low_s  (empty if the input has no duty)
+    PREFIX_adc.csv       count, value, overrun          one row per value
+    PREFIX_stats.csv     frame, which, count, min, max, mean, std
+    PREFIX_link.csv      frame, frames, dropped, peak
+    PREFIX_power.csv     frame, low, run_ms, sleep_ms, stop_ms, wake_us,
+                         wake_max_us, stops, readings
+
+--edges FILE writes the input as an edge file that `hostsim --replay`
+runs again (see Edge Files in hostsim.c): the timestamps of the
+reciprocal range, merged in time order, and each ADC value as
+ADC_OVERSAMPLE samples of value >> 2 from the sample count on. Timestamps
+of every 8th edge (recip/8) cannot be replayed and are left out.
+
+A serial device is switched to raw mode at --baud (default 1000000).
+Without --csv only the summary is printed.
+
+Usage: telemetry_decode.py [--csv PREFIX] [--edges FILE] [--baud N] [capture.bin | /dev/ttyX]
+"""
+
+import argparse
+import csv
+import math
+import os
+import struct
+import sys
+
+TM_BOOT, TM_EDGES, TM_READING, TM_ADC, TM_STATS, TM_LINK, TM_POWER = range(1, 8)
+
+INPUTS = ["fg", "555"]                       # FREQ_SEL_*
+RANGES = ["recip", "recip/8", "gated"]       # RANGE_*
+WINDOWS = ["555", "fg", "res"]               # tm_stats_t.which
+
+EV_555_RISE, EV_FG_RISE, EV_ADC = 0, 2, 3     # Edge file record kinds (hostsim.c)
+ADC_SAMPLE_HZ, ADC_OVERSAMPLE, ADC_OVERSAMPLE_SHIFT = 16000, 16, 2
+
+TABLES = {
+    "edges": ["t_s", "input", "range", "ts"],
+    "readings": ["t_s", "input", "range", "hz", "periods", "res_ppb", "duty", "high_s", "low_s"],
+    "adc": ["count", "value", "overrun"],
+    "stats": ["frame", "which", "count", "min", "max", "mean", "std"],
+    "link": ["frame", "frames", "dropped", "peak"],
+    "power": ["frame", "low", "run_ms", "sleep_ms", "stop_ms", "wake_us", "wake_max_us",
+              "stops", "readings"],
+}
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT, as crc16() in main.c."""
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_decode(enc):
+    out = bytearray()
+    i = 0
+    while i < len(enc):
+        code = enc[i]
+        if code == 0:
+            return None
+        out += enc[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(enc):
+            out.append(0)
+    return bytes(out)
+
+
+def frames(src):
+    """Yield the encoded frames of a byte stream, without their 0 ends."""
+    buf = bytearray()
+    while True:
+        try:
+            chunk = os.read(src.fileno(), 4096)
+        except OSError:         # A pty whose other end was closed
+            return
+        if not chunk:
+            return
+        buf += chunk
+        while True:
+            end = buf.find(0)
+            if end < 0:
+                break
+            if end:
+                yield bytes(buf[:end])
+            del buf[:end + 1]
+
+
+class Clock:
+    """Unwraps 32-bit TIM2 timestamps that only move forwards."""
+
+    def __init__(self):
+        self.prev = None
+        self.high = 0
+
+    def ticks(self, ts):
+        if self.prev is not None and ts < self.prev:
+            self.high += 1 << 32
+        self.prev = ts
+        return self.high + ts
+
+    def seconds(self, ts, hz):
+        return self.ticks(ts) / hz
+
+
+def varint(v):
+    out = bytearray()
+    while v >= 0x80:
+        out.append(v & 0x7F | 0x80)
+        v >>= 7
+    out.append(v)
+    return out
+
+
+def write_edges(path, clock, events):
+    """Writes (ticks, kind, sample) events as an edge file, in time order."""
+    out = bytearray(b"EDG1" + struct.pack("<I", int(clock)))
+    t = 0
+    for ticks, kind, sample in sorted(events, key=lambda e: e[0]):
+        out += varint((ticks - t) << 2 | kind)
+        if kind == EV_ADC:
+            out += varint(sample)
+        t = ticks
+    with open(path, "wb") as f:
+        f.write(out)
+
+
+def open_source(path, baud):
+    if path is None:
+        return sys.stdin.buffer
+    f = open(path, "rb", buffering=0)
+    if f.isatty():
+        import termios
+        import tty
+        tty.setraw(f.fileno())
+        attr = termios.tcgetattr(f.fileno())
+        speed = getattr(termios, f"B{baud}", None)
+        if speed is not None:
+            attr[4] = attr[5] = speed
+            termios.tcsetattr(f.fileno(), termios.TCSANOW, attr)
+    return f
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Decode the telemetry stream of main.c.")
+    ap.add_argument("source", nargs="?", help="capture file or serial device (default stdin)")
+    ap.add_argument("--csv", metavar="PREFIX", help="write one CSV file per table")
+    ap.add_argument("--edges", metavar="FILE", help="write the input as a hostsim edge file")
+    ap.add_argument("--baud", type=int, default=1000000)
+    args = ap.parse_args()
+
+    writers, files = {}, []
+    if args.csv:
+        for name, cols in TABLES.items():
+            f = open(f"{args.csv}_{name}.csv", "w", newline="")
+            files.append(f)
+            writers[name] = csv.writer(f)
+            writers[name].writerow(cols)
+
+    def row(table, *values):
+        if table in writers:
+            writers[table].writerow(values)
+
+    clock = 48e6
+    edge_clock = [Clock(), Clock()]
+    reading_clock = [Clock(), Clock()]
+    n_frames = bad = gaps = dropped_frames = 0
+    counts = {}
+    seq = None
+    adc_next = None
+    adc_gaps = 0
+    link = None
+    power = None
+    events, unplayable = [], 0
+
+    try:
+        for enc in frames(open_source(args.source, args.baud)):
+            f = cobs_decode(enc)
+            if f is None or len(f) < 5 or crc16(f[:-2]) != struct.unpack_from("<H", f, len(f) - 2)[0]:
+                bad += 1
+                continue
+            ftype, fseq = struct.unpack_from("<BH", f)
+            body = f[3:-2]
+            if seq is not None and fseq != (seq + 1) & 0xFFFF:
+                gaps += 1
+                dropped_frames += (fseq - seq - 1) & 0xFFFF
+            seq = fseq
+            n_frames += 1
+            counts[ftype] = counts.get(ftype, 0) + 1
+
+            if ftype == TM_BOOT:
+                clock, baud = struct.unpack_from("<II", body)
+                print(f"# boot: clock {clock} Hz, {baud} baud")
+            elif ftype == TM_EDGES:
+                inp, rng, n, lapped = struct.unpack_from("<BBBB", body)
+                if lapped:
+                    print(f"# {INPUTS[inp & 1]}: capture ring lapped, timestamps lost")
+                for ts in struct.unpack_from(f"<{n}I", body, 4):
+                    ticks = edge_clock[inp & 1].ticks(ts)
+                    row("edges", f"{ticks / clock:.9f}", INPUTS[inp & 1], RANGES[rng % 3], ts)
+                    if rng == 0:
+                        events.append((ticks, EV_555_RISE if inp & 1 else EV_FG_RISE, 0))
+                    else:
+                        unplayable += 1
+            elif ftype == TM_READING:
+                inp, rng, _, ts, mhz, periods, ppb, duty, high, low = struct.unpack_from("<BBHIIIIIII", body)
+                pulse = [f"{duty / 1e6:.6f}", f"{high / clock:.9f}", f"{low / clock:.9f}"] if duty else ["", "", ""]
+                row("readings", f"{reading_clock[inp & 1].seconds(ts, clock):.9f}",
+                    INPUTS[inp & 1], RANGES[rng % 3], f"{mhz / 1000:.3f}", periods, ppb, *pulse)
+            elif ftype == TM_ADC:
+                first, n, overrun, = struct.unpack_from("<IBB", body)
+                if adc_next is not None and first != adc_next:
+                    adc_gaps += 1
+                adc_next = first + n
+                for k, v in enumerate(struct.unpack_from(f"<{n}H", body, 6)):
+                    row("adc", first + k, v, overrun)
+                    for j in range(ADC_OVERSAMPLE if args.edges else 0):
+                        sample = (first + k - 1) * ADC_OVERSAMPLE + j
+                        events.append((sample * int(clock) // ADC_SAMPLE_HZ, EV_ADC, v >> ADC_OVERSAMPLE_SHIFT))
+            elif ftype == TM_STATS:
+                which, log2, _, count, lo, hi, total, nm2 = struct.unpack_from("<BBHIIIQQ", body)
+                win = 1 << log2
+                row("stats", n_frames, WINDOWS[which % 3], count, lo, hi,
+                    f"{total / win:.3f}", f"{math.sqrt(nm2 / win / win):.3f}")
+            elif ftype == TM_LINK:
+                link = struct.unpack_from("<III", body)
+                row("link", n_frames, *link)
+            elif ftype == TM_POWER:
+                power = struct.unpack_from("<B3xIIIIIII", body)
+                row("power", n_frames, *power)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for f in files:
+            f.close()
+
+    if args.edges:
+        write_edges(args.edges, clock, events)
+        print(f"# {len(events)} edges and samples written to {args.edges}, "
+              f"{unplayable} recip/8 timestamps left out")
+
+    names = {TM_BOOT: "boot", TM_EDGES: "edges", TM_READING: "readings",
+             TM_ADC: "adc", TM_STATS: "stats", TM_LINK: "link", TM_POWER: "power"}
+    kinds = ", ".join(f"{c} {names.get(t, t)}" for t, c in sorted(counts.items()))
+    print(f"# {n_frames} frames ({kinds}); {bad} bad, {gaps} seq gaps "
+          f"({dropped_frames} frames dropped), {adc_gaps} adc gaps")
+    if link:
+        print(f"# link: {link[0]} frames queued, {link[1]} dropped, ring peak {link[2]} bytes")
+    if power:
+        low, run, sleep, stop, wake, wake_max, stops, readings = power
+        awake = run + sleep + wake / 1000
+        print(f"# power: {'low' if low else 'normal'}; run {run} ms, sleep {sleep} ms, stop {stop} ms "
+              f"({stops} stops, wake-up {wake_max} us max); {readings} readings"
+              + (f", {awake / readings:.1f} ms awake each" if readings else ""))
+
+
+if __name__ == "__main__":
+    main()
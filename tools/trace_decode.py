@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Decode the binary event trace written by evt_drain() in main.c.
+
+The trace channel (ITM/semihosting capture file, or stdin) carries batches:
+
+    uint32 magic 'TRCE' | uint16 count | uint16 dropped | count x record
+
+with each record being
+
+    uint32 ts (TIM2 ticks) | uint16 id | uint16 a | uint32 b
+
+all little-endian. Timestamps are converted with the clock rate from the
+EVT_BOOT record (48 MHz until one is seen). Matching ISR enter/exit pairs
+are turned into per-IRQ duration statistics printed at the end.
+
+Usage: trace_decode.py [capture.bin]
+"""
+
+import struct
+import sys
+
+MAGIC = 0x45435254
+HDR = struct.Struct("<IHH")
+REC = struct.Struct("<IHHI")
+
+EVENTS = {
+    1: "BOOT",
+    2: "ISR_ENTER",
+    3: "ISR_EXIT",
+    4: "BUTTON",
+    5: "TASK_STAT",
+    6: "TASK_OVERRUN",
+    7: "TASK_SKIP",
+    8: "OLED_SENT",
+    9: "OLED_SKIPPED",
+    10: "OLED_QUEUE",
+    11: "FREQ_RANGE",
+    12: "PI_SETTLED",
+    13: "CAL_POINT",
+    14: "CAL_DONE",
+    15: "CAL_DEV",
+    16: "EDGE_REJECT",
+    17: "POWER_MODE",
+}
+
+IRQS = {
+    0xFFFF: "SysTick",
+    2: "RTC",
+    5: "EXTI0_1",
+    9: "DMA1_Ch1",
+    10: "DMA1_Ch2_3",
+    11: "DMA1_Ch4_5",
+    15: "TIM2",
+    21: "TIM16",
+    22: "TIM17",
+    25: "SPI1",
+}
+
+# Same order as tasks[] in main.c.
+TASKS = ["adc_dac", "trace", "measure", "cal", "telem", "display", "stats"]
+
+
+def records(data):
+    """Yield (dropped, ts, id, a, b) for every record, resyncing on the magic."""
+    pos = 0
+    magic = struct.pack("<I", MAGIC)
+    while True:
+        pos = data.find(magic, pos)
+        if pos < 0 or pos + HDR.size > len(data):
+            return
+        _, count, dropped = HDR.unpack_from(data, pos)
+        pos += HDR.size
+        if dropped:
+            yield dropped, None, None, None, None
+        for _ in range(count):
+            if pos + REC.size > len(data):
+                return
+            yield (0,) + REC.unpack_from(data, pos)
+            pos += REC.size
+
+
+def main():
+    src = open(sys.argv[1], "rb") if len(sys.argv) > 1 else sys.stdin.buffer
+    data = src.read()
+
+    clock = 48e6
+    prev_ts = None
+    elapsed = 0          # Ticks since the first record, unwrapped
+    enter = {}           # irq -> unwrapped tick of the pending enter
+    durations = {}       # irq -> list of ticks
+
+    for dropped, ts, eid, a, b in records(data):
+        if dropped:
+            print(f"# {dropped} event(s) dropped")
+            continue
+
+        if prev_ts is not None:
+            elapsed += (ts - prev_ts) & 0xFFFFFFFF
+        prev_ts = ts
+
+        name = EVENTS.get(eid, f"EVT_{eid}")
+        if eid == 1:
+            clock = float(b)
+        t_us = elapsed * 1e6 / clock
+
+        if eid in (2, 3):
+            irq = IRQS.get(a, f"IRQ{a}")
+            if eid == 2:
+                enter[a] = elapsed
+            elif a in enter:
+                durations.setdefault(irq, []).append(elapsed - enter.pop(a))
+            print(f"{t_us:14.3f} us  {name:<12} {irq:<10} {b}")
+        elif eid in (5, 6, 7):
+            task = TASKS[a] if a < len(TASKS) else str(a)
+            print(f"{t_us:14.3f} us  {name:<12} {task:<10} {b}")
+        else:
+            print(f"{t_us:14.3f} us  {name:<12} {a:<10} {b}")
+
+    if durations:
+        print("\n# ISR durations (us): count min avg max")
+        for irq, d in sorted(durations.items()):
+            us = [x * 1e6 / clock for x in d]
+            print(f"# {irq:<10} {len(us):6d} {min(us):8.2f} {sum(us) / len(us):8.2f} {max(us):8.2f}")
+
+
+if __name__ == "__main__":
+    main()